@@ -7,13 +7,11 @@ public:
   }
 
   std::vector<int> Encode(const std::vector<int>& input) {
-    std::vector<char32> char32_input(input.size());
-    std::transform(
-      input.begin(), 
-      input.end(), 
-      char32_input.begin(), 
-      [](int v) { return static_cast<char32>(v); }
-    );
+    // int and char32 have the same representation, so the input is viewed
+    // as char32 without a copy. -1 becomes the deliminator.
+    static_assert(sizeof(int) == sizeof(char32), "int must be 32 bits");
+    absl::Span<const char32> char32_input(
+      reinterpret_cast<const char32*>(input.data()), input.size());
     std::vector<int> ret;
     auto status = sp_.Encode(char32_input, &ret);
     // check status
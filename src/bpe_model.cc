@@ -14,7 +14,9 @@
 
 #include "bpe_model.h"
 
+#include <algorithm>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <queue>
 #include <random>
@@ -28,83 +30,425 @@
 namespace discretepiece {
 namespace bpe {
 
-Model::Model(const ModelProto &model_proto) {
+Model::Model(const ModelProto &model_proto, const ModelImage *image)
+    : cache_(kDefaultEncodeCacheSize) {
   model_proto_ = &model_proto;
-  InitializePieces();
+  InitializePieces(image);
+  if (!status().ok()) return;
+
+  // Merges come first, then characters.
+  num_merges_ = 0;
+  while (num_merges_ < GetPieceSize() && GetPieceLength(num_merges_) > 1) {
+    ++num_merges_;
+  }
+  for (int i = num_merges_; i < GetPieceSize(); ++i) {
+    if (GetPieceLength(i) > 1) {
+      num_merges_ = -1;
+      break;
+    }
+  }
+
+  if (image == nullptr) {
+    status_ = BuildMergeTables();
+    return;
+  }
+
+  absl::string_view data;
+  status_ = image->section("MERG", &data);
+  if (status_.ok()) status_ = merge_table_.Init(data);
+  if (status_.ok()) status_ = image->section("RANK", &data);
+  if (status_.ok() && (!merge_ranks_.InitFromBytes(data) ||
+                       merge_ranks_.size() != static_cast<size_t>(GetPieceSize()))) {
+    status_ = util::InternalError("broken merge ranks.");
+  }
 }
 
 Model::~Model() {}
 
-EncodeResult Model::Encode(const std::vector<char32> &normalized) const {
+util::Status Model::BuildMergeTables() {
+  bool has_parents = false;
+  for (const auto &sp : model_proto_->pieces()) {
+    has_parents |= sp.has_left_id() || sp.has_right_id();
+  }
+
+  std::vector<std::pair<std::pair<int, int>, int>> merges;
+  for (int id = 0; id < GetPieceSize(); ++id) {
+    const auto piece = GetPieceTokens(id);
+    if (has_parents) {
+      // Replays exactly the merges of the trainer.
+      if (piece.size() < 2) continue;
+      const auto &sp = model_proto_->pieces(id);
+      const int l = sp.left_id();
+      const int r = sp.right_id();
+      CHECK_OR_RETURN(sp.has_left_id() && sp.has_right_id() && l >= 0 &&
+                      r >= 0 && l < GetPieceSize() && r < GetPieceSize())
+          << PieceToString(sp) << " has no valid merge parents.";
+      const auto left = GetPieceTokens(l);
+      const auto right = GetPieceTokens(r);
+      CHECK_OR_RETURN(left.size() + right.size() == piece.size() &&
+                      std::equal(left.begin(), left.end(), piece.begin()) &&
+                      std::equal(right.begin(), right.end(),
+                                 piece.begin() + left.size()))
+          << PieceToString(sp) << " is not the merge of its parents.";
+      merges.push_back(std::make_pair(std::make_pair(l, r), id));
+      continue;
+    }
+
+    // Models without parents: every piece is reachable from any split into
+    // two pieces, since symbols always hold pieces.
+    for (size_t k = 1; k < piece.size(); ++k) {
+      const int l = piece_table_.Find(piece.first(k));
+      const int r = piece_table_.Find(piece.subspan(k));
+      if (l != PieceTable::kNotFound && r != PieceTable::kNotFound) {
+        merges.push_back(std::make_pair(std::make_pair(l, r), id));
+      }
+    }
+  }
+  merge_table_.Build(merges);
+
+  std::vector<int> order(GetPieceSize());
+  for (int id = 0; id < GetPieceSize(); ++id) order[id] = id;
+  std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+    return GetScore(a) > GetScore(b);
+  });
+  std::vector<int> ranks(GetPieceSize());
+  for (size_t i = 0; i < order.size(); ++i) {
+    ranks[order[i]] = (i > 0 && GetScore(order[i]) == GetScore(order[i - 1]))
+                          ? ranks[order[i - 1]]
+                          : i;
+  }
+  merge_ranks_.assign(std::move(ranks));
+  return util::OkStatus();
+}
+
+void Model::SaveImage(ModelImageBuilder *builder) const {
+  ModelInterface::SaveImage(builder);
+  builder->Add("MERG", merge_table_.Serialize());
+  builder->Add("RANK", std::string(merge_ranks_.bytes()));
+}
+
+EncodeResult Model::Encode(absl::Span<const char32> normalized) const {
+  std::vector<int> ids;
+  EncodeIds(normalized, &ids);
+  return PiecesFromIds(normalized, ids);
+}
+
+void Model::EncodeIds(absl::Span<const char32> normalized,
+                      std::vector<int> *ids) const {
   if (!status().ok() || normalized.empty()) {
-    return {};
+    return;
+  }
+
+  TokenSeq key;
+  std::vector<int> chunk_ids;
+
+  const int num_merges = GetPieceSize();
+  auto EncodeCachedChunk = [this, &key, &chunk_ids, ids, num_merges](absl::Span<const char32> chunk) {
+    if (chunk.empty() || word_dictionary_.Lookup(chunk, ids)) return;
+    if (chunk.size() > kMaxCachedChunkSize) {
+      EncodeChunk(chunk, num_merges, ids);
+      return;
+    }
+    key.assign(chunk.begin(), chunk.end());
+    if (!cache_.Lookup(key, &chunk_ids)) {
+      chunk_ids.clear();
+      EncodeChunk(chunk, num_merges, &chunk_ids);
+      cache_.Insert(key, chunk_ids);
+    }
+    ids->insert(ids->end(), chunk_ids.begin(), chunk_ids.end());
+  };
+
+  // Splits the input into chunks by deliminator. Merges never cross a
+  // deliminator in training, so each chunk is encoded independently.
+  size_t begin = 0;
+  for (size_t i = 0; i < normalized.size(); ++i) {
+    if (normalized[i] == deliminator_char32_value_) {
+      EncodeCachedChunk(normalized.subspan(begin, i - begin));
+      begin = i + 1;
+    }
+  }
+  EncodeCachedChunk(normalized.subspan(begin));
+}
+
+void Model::EncodeIdsBatch(const std::vector<absl::Span<const char32>> &inputs,
+                           std::vector<std::vector<int>> *ids) const {
+  ids->assign(inputs.size(), std::vector<int>());
+  if (!status().ok()) return;
+
+  constexpr int kNoMerge = std::numeric_limits<int>::max();
+
+  // Chunks of the batch in input order. Chunks found in the dictionary or
+  // the cache keep their ids in `known_ids`, the others are merged over
+  // the symbols [begin, end).
+  struct Chunk {
+    size_t input;                    // index in `inputs`.
+    absl::Span<const char32> tokens;
+    int begin;                       // first symbol, or -1 if known.
+    int end;                         // end of the symbols.
+    size_t known_begin;              // ids in `known_ids` if known.
+    size_t known_end;
+  };
+  std::vector<Chunk> chunks;
+  std::vector<int> known_ids;
+
+  // Structure of arrays over the symbols of all chunks. rank[i] and
+  // merged[i] describe the pair (i, next[i]); merged away symbols and the
+  // last symbol of a chunk hold kNoMerge.
+  std::vector<uint32> symbol;
+  std::vector<int> prev, next, rank, merged;
+
+  TokenSeq key;
+  std::vector<int> chunk_ids;
+  for (size_t n = 0; n < inputs.size(); ++n) {
+    const auto &input = inputs[n];
+    size_t begin = 0;
+    for (size_t i = 0; i <= input.size(); ++i) {
+      if (i < input.size() && input[i] != deliminator_char32_value_) continue;
+      const auto tokens = input.subspan(begin, i - begin);
+      begin = i + 1;
+      if (tokens.empty()) continue;
+
+      // Every round scans the whole chunk, so long chunks go to the heap
+      // based EncodeChunk() instead.
+      Chunk chunk = {n, tokens, -1, -1, known_ids.size(), 0};
+      bool known = word_dictionary_.Lookup(tokens, &known_ids);
+      if (!known && tokens.size() > kMaxCachedChunkSize) {
+        EncodeChunk(tokens, GetPieceSize(), &known_ids);
+        known = true;
+      } else if (!known) {
+        key.assign(tokens.begin(), tokens.end());
+        if (cache_.Lookup(key, &chunk_ids)) {
+          known_ids.insert(known_ids.end(), chunk_ids.begin(), chunk_ids.end());
+          known = true;
+        }
+      }
+      chunk.known_end = known_ids.size();
+      if (!known) {
+        chunk.begin = symbol.size();
+        chunk.end = chunk.begin + tokens.size();
+        for (size_t k = 0; k < tokens.size(); ++k) {
+          const int id = piece_table_.Find(tokens.subspan(k, 1));
+          CHECK(id != PieceTable::kNotFound)
+              << string_util::VectorChar32ToString(tokens, " ")
+              << " contains a token which cannot found";
+          symbol.push_back(id);
+          prev.push_back(k == 0 ? -1 : symbol.size() - 2);
+          next.push_back(k + 1 == tokens.size() ? -1 : symbol.size());
+        }
+      }
+      chunks.push_back(chunk);
+    }
+  }
+
+  // Initial bigrams are adjacent in `symbol`; pairs crossing two chunks
+  // are looked up too and dropped afterwards.
+  const size_t num_symbols = symbol.size();
+  merged.resize(num_symbols, PairTable::kNotFound);
+  rank.resize(num_symbols, kNoMerge);
+  if (num_symbols > 1) {
+    merge_table_.LookupBatch(symbol.data(), symbol.data() + 1, num_symbols - 1,
+                             merged.data());
+  }
+  std::vector<int> active;
+  for (size_t c = 0; c < chunks.size(); ++c) {
+    if (chunks[c].begin < 0) continue;
+    merged[chunks[c].end - 1] = PairTable::kNotFound;
+    active.push_back(c);
+  }
+  for (size_t i = 0; i < num_symbols; ++i) {
+    if (merged[i] != PairTable::kNotFound) rank[i] = merge_ranks_[merged[i]];
+  }
+
+  // Pairs to look up after each round.
+  std::vector<uint32> lefts, rights;
+  std::vector<int> positions, found;
+  auto AddPair = [&](int i) {
+    if (next[i] < 0) {
+      rank[i] = kNoMerge;
+      return;
+    }
+    lefts.push_back(symbol[i]);
+    rights.push_back(symbol[next[i]]);
+    positions.push_back(i);
+  };
+
+  // Applies one merge to every active chunk per round.
+  while (!active.empty()) {
+    lefts.clear();
+    rights.clear();
+    positions.clear();
+
+    size_t num_active = 0;
+    for (const int c : active) {
+      // The leftmost pair with the best rank.
+      const auto best = std::min_element(rank.begin() + chunks[c].begin,
+                                         rank.begin() + chunks[c].end);
+      if (*best == kNoMerge) continue;
+      active[num_active++] = c;
+
+      const int left = best - rank.begin();
+      const int right = next[left];
+      symbol[left] = merged[left];
+      rank[right] = kNoMerge;
+      next[left] = next[right];
+      if (next[left] >= 0) prev[next[left]] = left;
+      if (prev[left] >= 0) AddPair(prev[left]);
+      AddPair(left);
+    }
+    active.resize(num_active);
+
+    found.resize(positions.size());
+    merge_table_.LookupBatch(lefts.data(), rights.data(), positions.size(),
+                             found.data());
+    for (size_t k = 0; k < positions.size(); ++k) {
+      merged[positions[k]] = found[k];
+      rank[positions[k]] =
+          found[k] == PairTable::kNotFound ? kNoMerge : merge_ranks_[found[k]];
+    }
   }
 
+  for (const auto &chunk : chunks) {
+    auto *output = &(*ids)[chunk.input];
+    if (chunk.begin < 0) {
+      output->insert(output->end(), known_ids.begin() + chunk.known_begin,
+                     known_ids.begin() + chunk.known_end);
+      continue;
+    }
+    chunk_ids.clear();
+    for (int i = chunk.begin; i >= 0; i = next[i]) {
+      chunk_ids.push_back(symbol[i]);
+    }
+    key.assign(chunk.tokens.begin(), chunk.tokens.end());
+    cache_.Insert(key, chunk_ids);
+    output->insert(output->end(), chunk_ids.begin(), chunk_ids.end());
+  }
+}
+
+util::Status Model::GetTruncatedMerges(int max_piece_id, int *num_merges) const {
+  RETURN_IF_ERROR(status());
+  CHECK_OR_RETURN(num_merges_ >= 0)
+      << "pieces are not in merge order, the vocabulary cannot be truncated.";
+  const int num_chars = GetPieceSize() - num_merges_;
+  CHECK_OR_RETURN(max_piece_id + 1 >= num_chars && max_piece_id < GetPieceSize())
+      << "max_piece_id should be in [" << num_chars - 1 << ", "
+      << GetPieceSize() - 1 << "].";
+  *num_merges = max_piece_id + 1 - num_chars;
+  return util::OkStatus();
+}
+
+util::Status Model::EncodeIdsTruncated(absl::Span<const char32> normalized,
+                                       int max_piece_id,
+                                       std::vector<int> *ids) const {
+  int num_merges = 0;
+  RETURN_IF_ERROR(GetTruncatedMerges(max_piece_id, &num_merges));
+
+  // The cache holds the encoding of the full vocabulary, so chunks are
+  // always encoded here.
+  size_t begin = 0;
+  for (size_t i = 0; i <= normalized.size(); ++i) {
+    if (i == normalized.size() || normalized[i] == deliminator_char32_value_) {
+      EncodeChunk(normalized.subspan(begin, i - begin), num_merges, ids);
+      begin = i + 1;
+    }
+  }
+  return util::OkStatus();
+}
+
+util::Status Model::TruncatedIdsToIds(absl::Span<const int> ids,
+                                      int max_piece_id,
+                                      std::vector<int> *full_ids) const {
+  int num_merges = 0;
+  RETURN_IF_ERROR(GetTruncatedMerges(max_piece_id, &num_merges));
+  // Merges keep their ids, characters follow the kept merges.
+  const int shift = num_merges_ - num_merges;
+  full_ids->clear();
+  full_ids->reserve(ids.size());
+  for (const int id : ids) {
+    CHECK_OR_RETURN(id >= 0 && id <= max_piece_id)
+        << "id " << id << " is out of range.";
+    full_ids->push_back(id < num_merges ? id : id + shift);
+  }
+  return util::OkStatus();
+}
+
+model::LRUCacheStats Model::GetEncodeCacheStats() const {
+  return cache_.stats();
+}
+
+void Model::SetEncodeCacheSize(size_t size) const {
+  cache_.SetCapacity(size);
+}
+
+void Model::EncodeChunk(absl::Span<const char32> chunk, int num_merges,
+                        std::vector<int> *ids) const {
   struct Symbol {
     int prev;     // prev index of this symbol. -1 for BOS.
     int next;     // next index of tihs symbol. -1 for EOS.
     bool freeze;  // this symbol is never be merged.
-    std::vector<char32> piece;
+    int id;       // piece id of this symbol.
+    int size;     // length of this symbol. 0 after merged into its left.
   };
 
   struct SymbolPair {
     int left;     // left index of this pair
     int right;    // right index of this pair
-    float score;  // score of this pair. large is better.
+    int rank;     // merge rank of this pair. small is better.
+    int id;       // piece id after merging this pair
     size_t size;  // length of this piece
   };
 
   class SymbolPairComparator {
    public:
     const bool operator()(SymbolPair *h1, SymbolPair *h2) {
-      return (h1->score < h2->score || (h1->score == h2->score && h1->left > h2->left));
+      return (h1->rank > h2->rank || (h1->rank == h2->rank && h1->left > h2->left));
     }
   };
 
   using Agenda = std::priority_queue<SymbolPair *, std::vector<SymbolPair *>, SymbolPairComparator>;
   Agenda agenda;
   std::vector<Symbol> symbols;
-  symbols.reserve(normalized.size());
+  symbols.reserve(chunk.size());
 
   // Pre-allocates SymbolPair for efficiency.
   constexpr size_t kPreallocateSymbolPairSize = 256;
   model::FreeList<SymbolPair> symbol_pair_allocator(kPreallocateSymbolPairSize);
 
   // Lookup new symbol pair at [left, right] and inserts it to agenda.
-  auto MaybeAddNewSymbolPair = [this, &symbol_pair_allocator, &symbols, &agenda](int left, int right) {
+  auto MaybeAddNewSymbolPair = [this, &symbol_pair_allocator, &symbols, &agenda, num_merges](int left, int right) {
     // in this, we can control sos & eos merging rules
     if (left == -1 || right == -1 || symbols[left].freeze || symbols[right].freeze)
       return;
-    
-    std::vector<char32> piece = symbols[left].piece;
-    piece.insert(piece.end(), symbols[right].piece.begin(), symbols[right].piece.end());
 
-    const auto it = pieces_.find(piece);
-    if (it == pieces_.end()) {
-      return; // current bigram not in piece
+    const int id = merge_table_.Lookup(symbols[left].id, symbols[right].id);
+    if (id == PairTable::kNotFound || id >= num_merges) {
+      return; // current bigram is not a merge
     }
 
     auto *h = symbol_pair_allocator.Allocate();
     h->left = left;
     h->right = right;
-    h->score = GetScore(it->second);
-    h->size = piece.size();
+    h->rank = merge_ranks_[id];
+    h->id = id;
+    h->size = symbols[left].size + symbols[right].size;
     agenda.push(h);
   };
 
   // Splits the input into character sequence
-  // TODO: handling deliminator
-  for (auto index=0; index<normalized.size(); index++) {
+  for (auto index=0; index<chunk.size(); index++) {
     Symbol s;
-    s.piece.push_back(normalized[index]);
+    s.id = piece_table_.Find(chunk.subspan(index, 1));
+    CHECK(s.id != PieceTable::kNotFound)
+        << string_util::VectorChar32ToString(chunk, " ")
+        << " contains a token which cannot found";
+    s.size = 1;
     s.prev = (index == 0? -1:index-1);
-    s.next = (index == (normalized.size()-1)? -1:(index+1));
+    s.next = (index == (chunk.size()-1)? -1:(index+1));
     s.freeze = false;
     symbols.emplace_back(s);
   }
 
   if (symbols.empty()) {
-    return {};
+    return;
   }
 
   // Lookup all bigrams.
@@ -118,16 +462,15 @@ EncodeResult Model::Encode(const std::vector<char32> &normalized) const {
     agenda.pop();
 
     // `top` is no longer available.
-    if (symbols[top->left].piece.empty() || symbols[top->right].piece.empty() ||
-        symbols[top->left].piece.size() + symbols[top->right].piece.size() != top->size) {
+    if (symbols[top->left].size == 0 || symbols[top->right].size == 0 ||
+        symbols[top->left].size + symbols[top->right].size != top->size) {
       continue;
     }
 
     // Replace `left` symbols with `top` rule.
-    auto& right_piece = symbols[top->right].piece;
-    auto& left_piece = symbols[top->left].piece;
-    left_piece.insert(left_piece.end(), right_piece.begin(), right_piece.end());
-    right_piece.clear();
+    symbols[top->left].id = top->id;
+    symbols[top->left].size += symbols[top->right].size;
+    symbols[top->right].size = 0;
 
     // Updates prev/next pointers.
     // eg.: [prev, left], [left, right], [right, next]
@@ -142,16 +485,12 @@ EncodeResult Model::Encode(const std::vector<char32> &normalized) const {
     MaybeAddNewSymbolPair(top->left, symbols[top->left].next);
   }
 
-  EncodeResult output;
   for (int index = 0; index != -1; index = symbols[index].next) {
     CHECK_GE(index, 0);
     CHECK_LT(index, static_cast<int>(symbols.size()));
-    const auto& piece = symbols[index].piece;
-    const int id = PieceToId(piece);
-    output.emplace_back(piece, id);
+    const int id = symbols[index].id;
+    ids->push_back(id < num_merges ? id : id - num_merges_ + num_merges);
   }
-
-  return output;
 }
 
 }  // namespace bpe
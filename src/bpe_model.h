@@ -17,6 +17,7 @@
 
 #include "model_interface.h"
 #include "discretepiece_model.pb.h"
+#include "pair_table.h"
 
 namespace discretepiece {
 namespace bpe {
@@ -30,11 +31,78 @@ namespace bpe {
 class Model : public ModelInterface {
  public:
 
-  explicit Model(const ModelProto &model_proto);
+  // Tables are taken from `image` if not null, see ModelImage.
+  explicit Model(const ModelProto &model_proto,
+                 const ModelImage *image = nullptr);
 
   ~Model() override;
 
-  EncodeResult Encode(const std::vector<char32> &normalized) const override;
+  // Splits `normalized` by the deliminator and encodes every chunk
+  // independently, the same as the trainer learns merges within chunks.
+  EncodeResult Encode(absl::Span<const char32> normalized) const override;
+
+  void EncodeIds(absl::Span<const char32> normalized,
+                 std::vector<int> *ids) const override;
+
+  // Encodes many short inputs in lockstep. The symbols of all chunks in the
+  // batch are laid out in flat arrays, and every round applies the best
+  // merge of each chunk and looks up the new adjacent pairs of the whole
+  // batch at once in the merge table. Gives the same ids as EncodeIds().
+  void EncodeIdsBatch(const std::vector<absl::Span<const char32>> &inputs,
+                      std::vector<std::vector<int>> *ids) const override;
+
+  // Pieces are stored in merge order, followed by the characters sorted by
+  // frequency, so a model trained with a smaller vocabulary is the same as
+  // the first merges of this one plus all characters. Ignoring the merges
+  // above the cutoff gives exactly the encoding of that smaller model.
+  util::Status EncodeIdsTruncated(absl::Span<const char32> normalized,
+                                  int max_piece_id,
+                                  std::vector<int> *ids) const override;
+
+  util::Status TruncatedIdsToIds(absl::Span<const int> ids, int max_piece_id,
+                                 std::vector<int> *full_ids) const override;
+
+  model::LRUCacheStats GetEncodeCacheStats() const override;
+
+  void SetEncodeCacheSize(size_t size) const override;
+
+  // Adds merge_table_ and merge_ranks_ to the tables of the base class.
+  void SaveImage(ModelImageBuilder *builder) const override;
+
+  // Default number of chunks kept in the encoding cache.
+  static constexpr size_t kDefaultEncodeCacheSize = 1 << 16;
+
+  // Chunks longer than this are encoded without the cache.
+  static constexpr size_t kMaxCachedChunkSize = 256;
+
+ private:
+  // Runs BPE merges over `chunk` and appends the piece ids to `ids`.
+  // Only the first `num_merges` merges are applied, and the ids of
+  // characters are shifted down to follow them.
+  void EncodeChunk(absl::Span<const char32> chunk, int num_merges,
+                   std::vector<int> *ids) const;
+
+  // Builds merge_table_ and merge_ranks_ from the pieces. Models recording
+  // the merge parents of their pieces get exactly the merges of the
+  // trainer, older models get every split of every piece.
+  util::Status BuildMergeTables();
+
+  // Returns the number of merges kept with `max_piece_id`.
+  util::Status GetTruncatedMerges(int max_piece_id, int *num_merges) const;
+
+  // Number of merges, i.e. the id of the first character piece, or -1 if
+  // the pieces are not in merge order.
+  int num_merges_ = -1;
+
+  // (left id, right id) -> merged id, see BuildMergeTables().
+  PairTable merge_table_;
+
+  // id -> merge priority, 0 is applied first. Pieces with the same score
+  // share a rank and the leftmost pair wins, as in EncodeChunk().
+  FlatArray<int> merge_ranks_;
+
+  // Chunk -> piece ids cache. Frequent chunks repeat many times in a corpus.
+  mutable model::LRUCache<TokenSeq, std::vector<int>, TokenSeqHash> cache_;
 };
 }  // namespace bpe
 
@@ -64,8 +64,8 @@ Trainer::Symbol *Trainer::GetPairSymbol(const Symbol *left,
   CHECK(!left->chars.empty());
   CHECK(!right->chars.empty());
 
-  std::vector<char32> ut = left->chars;
-  ut.insert(ut.end(), right->chars.begin(), right->chars.end());
+  TokenSeq ut = left->chars;
+  ut.append(right->chars);
 
   // Do not make an invalid piece.
   if (!IsValidDiscretePiece(ut)) {
@@ -204,10 +204,11 @@ util::Status Trainer::Train() {
   // We may see duplicated pieces that are extracted with different path.
   // In real segmentation phase, we can consider them as one symbol.
   // e.g., "1 2 3" => "1 2" + "3" or "1" + "2 3"
-  absl::flat_hash_set<std::vector<char32>, port::VectorChar32Hash> dup;
+  absl::flat_hash_set<TokenSeq, TokenSeqHash> dup;
 
-  // vector<char32> comparator
-  using port::operator<;
+  // Left and right symbols of every merged piece, mapped to ids at the end
+  // since characters follow the merges.
+  std::vector<std::pair<const Symbol *, const Symbol *>> parents;
 
   // Main loop.
   CHECK_OR_RETURN(final_pieces_.empty());
@@ -249,6 +250,7 @@ util::Status Trainer::Train() {
 
     // Stores the best_symbol in the final output.
     final_pieces_.emplace_back(best_symbol->chars, -static_cast<float>(final_pieces_.size()));
+    parents.emplace_back(best_symbol->left, best_symbol->right);
 
     if (final_pieces_.size() % 20 == 0) {
       LOG(INFO) << "Added: freq=" << best_symbol->freq
@@ -302,6 +304,21 @@ util::Status Trainer::Train() {
                                -static_cast<float>(final_pieces_.size()));
   }
 
+  // Symbols in `symbols_` are characters or merged pieces, so both parents
+  // of a merge are pieces.
+  absl::flat_hash_map<TokenSeq, int, TokenSeqHash> ids;
+  for (size_t id = 0; id < final_pieces_.size(); ++id) {
+    ids[final_pieces_[id].first] = id;
+  }
+  final_parents_.assign(final_pieces_.size(), std::make_pair(-1, -1));
+  for (size_t id = 0; id < parents.size(); ++id) {
+    const auto left = ids.find(parents[id].first->chars);
+    const auto right = ids.find(parents[id].second->chars);
+    CHECK_OR_RETURN(left != ids.end() && right != ids.end())
+        << "parents of " << final_pieces_[id].first << " are not pieces";
+    final_parents_[id] = std::make_pair(left->second, right->second);
+  }
+
   port::STLDeleteElements(&allocated_);
 
   return Save();
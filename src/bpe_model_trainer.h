@@ -23,6 +23,7 @@
 
 #include "discretepiece_model.pb.h"
 #include "third_party/absl/container/flat_hash_map.h"
+#include "token_seq.h"
 #include "trainer_interface.h"
 
 
@@ -42,7 +43,7 @@ class Trainer : public TrainerInterface {
   struct Symbol {
     const Symbol *left;              // left symbol in bigram
     const Symbol *right;             // right symbol in bigram
-    std::vector<char32> chars;     // all flattend character(integer indices) sequence
+    TokenSeq chars;                  // all flattend character(integer indices) sequence
     uint64_t fp;                     // fingerprint of this symbol.
     uint64_t freq;                   // frequency of this symbol.
 
@@ -72,23 +72,27 @@ namespace discretepiece {
 bool TrainerSpec_ModelType_IsValid(int value) {
   switch (value) {
     case 1:
+    case 2:
       return true;
     default:
       return false;
   }
 }
 
-static ::PROTOBUF_NAMESPACE_ID::internal::ExplicitlyConstructed<std::string> TrainerSpec_ModelType_strings[1] = {};
+static ::PROTOBUF_NAMESPACE_ID::internal::ExplicitlyConstructed<std::string> TrainerSpec_ModelType_strings[2] = {};
 
 static const char TrainerSpec_ModelType_names[] =
-  "BPE";
+  "BPE"
+  "UNIGRAM";
 
 static const ::PROTOBUF_NAMESPACE_ID::internal::EnumEntry TrainerSpec_ModelType_entries[] = {
   { {TrainerSpec_ModelType_names + 0, 3}, 1 },
+  { {TrainerSpec_ModelType_names + 3, 7}, 2 },
 };
 
 static const int TrainerSpec_ModelType_entries_by_number[] = {
   0, // 1 -> BPE
+  1, // 2 -> UNIGRAM
 };
 
 const std::string& TrainerSpec_ModelType_Name(
@@ -97,12 +101,12 @@ const std::string& TrainerSpec_ModelType_Name(
       ::PROTOBUF_NAMESPACE_ID::internal::InitializeEnumStrings(
           TrainerSpec_ModelType_entries,
           TrainerSpec_ModelType_entries_by_number,
-          1, TrainerSpec_ModelType_strings);
+          2, TrainerSpec_ModelType_strings);
   (void) dummy;
   int idx = ::PROTOBUF_NAMESPACE_ID::internal::LookUpEnumName(
       TrainerSpec_ModelType_entries,
       TrainerSpec_ModelType_entries_by_number,
-      1, value);
+      2, value);
   return idx == -1 ? ::PROTOBUF_NAMESPACE_ID::internal::GetEmptyString() :
                      TrainerSpec_ModelType_strings[idx].get();
 }
@@ -110,7 +114,7 @@ bool TrainerSpec_ModelType_Parse(
     ::PROTOBUF_NAMESPACE_ID::ConstStringParam name, TrainerSpec_ModelType* value) {
   int int_value;
   bool success = ::PROTOBUF_NAMESPACE_ID::internal::LookUpEnumValue(
-      TrainerSpec_ModelType_entries, 1, name, &int_value);
+      TrainerSpec_ModelType_entries, 2, name, &int_value);
   if (success) {
     *value = static_cast<TrainerSpec_ModelType>(int_value);
   }
@@ -118,6 +122,7 @@ bool TrainerSpec_ModelType_Parse(
 }
 #if (__cplusplus < 201703) && (!defined(_MSC_VER) || _MSC_VER >= 1900)
 constexpr TrainerSpec_ModelType TrainerSpec::BPE;
+constexpr TrainerSpec_ModelType TrainerSpec::UNIGRAM;
 constexpr TrainerSpec_ModelType TrainerSpec::ModelType_MIN;
 constexpr TrainerSpec_ModelType TrainerSpec::ModelType_MAX;
 constexpr int TrainerSpec::ModelType_ARRAYSIZE;
@@ -214,6 +219,18 @@ class TrainerSpec::_Internal {
   static void set_has_vocabulary_output_piece_score(HasBits* has_bits) {
     (*has_bits)[0] |= 256u;
   }
+  static void set_has_collapse_repeats(HasBits* has_bits) {
+    (*has_bits)[0] |= 2048u;
+  }
+  static void set_has_word_dictionary_size(HasBits* has_bits) {
+    (*has_bits)[0] |= 4096u;
+  }
+  static void set_has_num_codebooks(HasBits* has_bits) {
+    (*has_bits)[0] |= 8192u;
+  }
+  static void set_has_write_legacy_piece(HasBits* has_bits) {
+    (*has_bits)[0] |= 16384u;
+  }
 };
 
 const ::PROTOBUF_NAMESPACE_ID::internal::LazyString TrainerSpec::_i_give_permission_to_break_this_code_default_deliminator_{{{"#", 1}}, {nullptr}};
@@ -247,8 +264,8 @@ TrainerSpec::TrainerSpec(const TrainerSpec& from)
       GetArena());
   }
   ::memcpy(&input_sentence_size_, &from.input_sentence_size_,
-    static_cast<size_t>(reinterpret_cast<char*>(&max_discretepiece_length_) -
-    reinterpret_cast<char*>(&input_sentence_size_)) + sizeof(max_discretepiece_length_));
+    static_cast<size_t>(reinterpret_cast<char*>(&write_legacy_piece_) -
+    reinterpret_cast<char*>(&input_sentence_size_)) + sizeof(write_legacy_piece_));
   // @@protoc_insertion_point(copy_constructor:discretepiece.TrainerSpec)
 }
 
@@ -265,6 +282,10 @@ void TrainerSpec::SharedCtor() {
   vocabulary_output_piece_score_ = true;
   num_sub_iterations_ = 2;
   max_discretepiece_length_ = 16;
+  collapse_repeats_ = false;
+  word_dictionary_size_ = 0;
+  num_codebooks_ = 1;
+  write_legacy_piece_ = true;
 }
 
 TrainerSpec::~TrainerSpec() {
@@ -322,10 +343,14 @@ void TrainerSpec::Clear() {
     num_threads_ = 16;
     shuffle_input_sentence_ = true;
   }
-  if (cached_has_bits & 0x00000700u) {
+  if (cached_has_bits & 0x00007f00u) {
     vocabulary_output_piece_score_ = true;
     num_sub_iterations_ = 2;
     max_discretepiece_length_ = 16;
+    collapse_repeats_ = false;
+    word_dictionary_size_ = 0;
+    num_codebooks_ = 1;
+    write_legacy_piece_ = true;
   }
   _has_bits_.Clear();
   _internal_metadata_.Clear<std::string>();
@@ -444,6 +469,38 @@ const char* TrainerSpec::_InternalParse(const char* ptr, ::PROTOBUF_NAMESPACE_ID
           CHK_(ptr);
         } else goto handle_unusual;
         continue;
+      // optional bool collapse_repeats = 19 [default = false];
+      case 19:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 152)) {
+          _Internal::set_has_collapse_repeats(&has_bits);
+          collapse_repeats_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
+      // optional int32 word_dictionary_size = 20 [default = 0];
+      case 20:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 160)) {
+          _Internal::set_has_word_dictionary_size(&has_bits);
+          word_dictionary_size_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
+      // optional int32 num_codebooks = 21 [default = 1];
+      case 21:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 168)) {
+          _Internal::set_has_num_codebooks(&has_bits);
+          num_codebooks_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
+      // optional bool write_legacy_piece = 22 [default = true];
+      case 22:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 176)) {
+          _Internal::set_has_write_legacy_piece(&has_bits);
+          write_legacy_piece_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
       default: {
       handle_unusual:
         if ((tag & 7) == 4 || tag == 0) {
@@ -553,6 +610,30 @@ failure:
     target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteBoolToArray(12, this->_internal_vocabulary_output_piece_score(), target);
   }
 
+  // optional bool collapse_repeats = 19 [default = false];
+  if (cached_has_bits & 0x00000800u) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteBoolToArray(19, this->_internal_collapse_repeats(), target);
+  }
+
+  // optional int32 word_dictionary_size = 20 [default = 0];
+  if (cached_has_bits & 0x00001000u) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteInt32ToArray(20, this->_internal_word_dictionary_size(), target);
+  }
+
+  // optional int32 num_codebooks = 21 [default = 1];
+  if (cached_has_bits & 0x00002000u) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteInt32ToArray(21, this->_internal_num_codebooks(), target);
+  }
+
+  // optional bool write_legacy_piece = 22 [default = true];
+  if (cached_has_bits & 0x00004000u) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteBoolToArray(22, this->_internal_write_legacy_piece(), target);
+  }
+
   // Extension range [200, 536870912)
   target = _extensions_._InternalSerialize(
       200, 536870912, target, stream);
@@ -639,7 +720,7 @@ size_t TrainerSpec::ByteSizeLong() const {
     }
 
   }
-  if (cached_has_bits & 0x00000700u) {
+  if (cached_has_bits & 0x00007f00u) {
     // optional bool vocabulary_output_piece_score = 12 [default = true];
     if (cached_has_bits & 0x00000100u) {
       total_size += 1 + 1;
@@ -659,6 +740,30 @@ size_t TrainerSpec::ByteSizeLong() const {
           this->_internal_max_discretepiece_length());
     }
 
+    // optional bool collapse_repeats = 19 [default = false];
+    if (cached_has_bits & 0x00000800u) {
+      total_size += 2 + 1;
+    }
+
+    // optional int32 word_dictionary_size = 20 [default = 0];
+    if (cached_has_bits & 0x00001000u) {
+      total_size += 2 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::Int32Size(
+          this->_internal_word_dictionary_size());
+    }
+
+    // optional int32 num_codebooks = 21 [default = 1];
+    if (cached_has_bits & 0x00002000u) {
+      total_size += 2 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::Int32Size(
+          this->_internal_num_codebooks());
+    }
+
+    // optional bool write_legacy_piece = 22 [default = true];
+    if (cached_has_bits & 0x00004000u) {
+      total_size += 2 + 1;
+    }
+
   }
   if (PROTOBUF_PREDICT_FALSE(_internal_metadata_.have_unknown_fields())) {
     total_size += _internal_metadata_.unknown_fields<std::string>(::PROTOBUF_NAMESPACE_ID::internal::GetEmptyString).size();
@@ -711,7 +816,7 @@ void TrainerSpec::MergeFrom(const TrainerSpec& from) {
     }
     _has_bits_[0] |= cached_has_bits;
   }
-  if (cached_has_bits & 0x00000700u) {
+  if (cached_has_bits & 0x00007f00u) {
     if (cached_has_bits & 0x00000100u) {
       vocabulary_output_piece_score_ = from.vocabulary_output_piece_score_;
     }
@@ -721,6 +826,18 @@ void TrainerSpec::MergeFrom(const TrainerSpec& from) {
     if (cached_has_bits & 0x00000400u) {
       max_discretepiece_length_ = from.max_discretepiece_length_;
     }
+    if (cached_has_bits & 0x00000800u) {
+      collapse_repeats_ = from.collapse_repeats_;
+    }
+    if (cached_has_bits & 0x00001000u) {
+      word_dictionary_size_ = from.word_dictionary_size_;
+    }
+    if (cached_has_bits & 0x00002000u) {
+      num_codebooks_ = from.num_codebooks_;
+    }
+    if (cached_has_bits & 0x00004000u) {
+      write_legacy_piece_ = from.write_legacy_piece_;
+    }
     _has_bits_[0] |= cached_has_bits;
   }
 }
@@ -757,6 +874,10 @@ void TrainerSpec::InternalSwap(TrainerSpec* other) {
   swap(vocabulary_output_piece_score_, other->vocabulary_output_piece_score_);
   swap(num_sub_iterations_, other->num_sub_iterations_);
   swap(max_discretepiece_length_, other->max_discretepiece_length_);
+  swap(collapse_repeats_, other->collapse_repeats_);
+  swap(word_dictionary_size_, other->word_dictionary_size_);
+  swap(num_codebooks_, other->num_codebooks_);
+  swap(write_legacy_piece_, other->write_legacy_piece_);
 }
 
 std::string TrainerSpec::GetTypeName() const {
@@ -778,18 +899,26 @@ class ModelProto_DiscretePiece::_Internal {
   static void set_has_type(HasBits* has_bits) {
     (*has_bits)[0] |= 4u;
   }
+  static void set_has_left_id(HasBits* has_bits) {
+    (*has_bits)[0] |= 8u;
+  }
+  static void set_has_right_id(HasBits* has_bits) {
+    (*has_bits)[0] |= 16u;
+  }
 };
 
 ModelProto_DiscretePiece::ModelProto_DiscretePiece(::PROTOBUF_NAMESPACE_ID::Arena* arena)
   : ::PROTOBUF_NAMESPACE_ID::MessageLite(arena),
-  _extensions_(arena) {
+  _extensions_(arena),
+  tokens_(arena) {
   SharedCtor();
   RegisterArenaDtor(arena);
   // @@protoc_insertion_point(arena_constructor:discretepiece.ModelProto.DiscretePiece)
 }
 ModelProto_DiscretePiece::ModelProto_DiscretePiece(const ModelProto_DiscretePiece& from)
   : ::PROTOBUF_NAMESPACE_ID::MessageLite(),
-      _has_bits_(from._has_bits_) {
+      _has_bits_(from._has_bits_),
+      tokens_(from.tokens_) {
   _internal_metadata_.MergeFrom<std::string>(from._internal_metadata_);
   _extensions_.MergeFrom(from._extensions_);
   piece_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
@@ -807,6 +936,8 @@ void ModelProto_DiscretePiece::SharedCtor() {
   ::PROTOBUF_NAMESPACE_ID::internal::InitSCC(&scc_info_ModelProto_DiscretePiece_discretepiece_5fmodel_2eproto.base);
   piece_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
   score_ = 0;
+  left_id_ = 0;
+  right_id_ = 0;
   type_ = 1;
 }
 
@@ -843,12 +974,15 @@ void ModelProto_DiscretePiece::Clear() {
   (void) cached_has_bits;
 
   _extensions_.Clear();
+  tokens_.Clear();
   cached_has_bits = _has_bits_[0];
   if (cached_has_bits & 0x00000001u) {
     piece_.ClearNonDefaultToEmpty();
   }
-  if (cached_has_bits & 0x00000006u) {
+  if (cached_has_bits & 0x0000001eu) {
     score_ = 0;
+    left_id_ = 0;
+    right_id_ = 0;
     type_ = 1;
   }
   _has_bits_.Clear();
@@ -891,6 +1025,32 @@ const char* ModelProto_DiscretePiece::_InternalParse(const char* ptr, ::PROTOBUF
           }
         } else goto handle_unusual;
         continue;
+      // repeated uint32 tokens = 4 [packed = true];
+      case 4:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 34)) {
+          ptr = ::PROTOBUF_NAMESPACE_ID::internal::PackedUInt32Parser(_internal_mutable_tokens(), ptr, ctx);
+          CHK_(ptr);
+        } else if (static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 32) {
+          _internal_add_tokens(::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr));
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
+      // optional int32 left_id = 5;
+      case 5:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 40)) {
+          _Internal::set_has_left_id(&has_bits);
+          left_id_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
+      // optional int32 right_id = 6;
+      case 6:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 48)) {
+          _Internal::set_has_right_id(&has_bits);
+          right_id_ = ::PROTOBUF_NAMESPACE_ID::internal::ReadVarint64(&ptr);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
       default: {
       handle_unusual:
         if ((tag & 7) == 4 || tag == 0) {
@@ -946,6 +1106,27 @@ failure:
       3, this->_internal_type(), target);
   }
 
+  // repeated uint32 tokens = 4 [packed = true];
+  {
+    int byte_size = _tokens_cached_byte_size_.load(std::memory_order_relaxed);
+    if (byte_size > 0) {
+      target = stream->WriteUInt32Packed(
+          4, _internal_tokens(), byte_size, target);
+    }
+  }
+
+  // optional int32 left_id = 5;
+  if (cached_has_bits & 0x00000008u) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteInt32ToArray(5, this->_internal_left_id(), target);
+  }
+
+  // optional int32 right_id = 6;
+  if (cached_has_bits & 0x00000010u) {
+    target = stream->EnsureSpace(target);
+    target = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::WriteInt32ToArray(6, this->_internal_right_id(), target);
+  }
+
   // Extension range [200, 536870912)
   target = _extensions_._InternalSerialize(
       200, 536870912, target, stream);
@@ -968,8 +1149,23 @@ size_t ModelProto_DiscretePiece::ByteSizeLong() const {
   // Prevent compiler warnings about cached_has_bits being unused
   (void) cached_has_bits;
 
+  // repeated uint32 tokens = 4 [packed = true];
+  {
+    size_t data_size = ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::
+      UInt32Size(this->tokens_);
+    if (data_size > 0) {
+      total_size += 1 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::Int32Size(
+            static_cast<::PROTOBUF_NAMESPACE_ID::int32>(data_size));
+    }
+    int cached_size = ::PROTOBUF_NAMESPACE_ID::internal::ToCachedSize(data_size);
+    _tokens_cached_byte_size_.store(cached_size,
+                                    std::memory_order_relaxed);
+    total_size += data_size;
+  }
+
   cached_has_bits = _has_bits_[0];
-  if (cached_has_bits & 0x00000007u) {
+  if (cached_has_bits & 0x0000001fu) {
     // optional string piece = 1;
     if (cached_has_bits & 0x00000001u) {
       total_size += 1 +
@@ -988,6 +1184,20 @@ size_t ModelProto_DiscretePiece::ByteSizeLong() const {
         ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::EnumSize(this->_internal_type());
     }
 
+    // optional int32 left_id = 5;
+    if (cached_has_bits & 0x00000008u) {
+      total_size += 1 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::Int32Size(
+          this->_internal_left_id());
+    }
+
+    // optional int32 right_id = 6;
+    if (cached_has_bits & 0x00000010u) {
+      total_size += 1 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::Int32Size(
+          this->_internal_right_id());
+    }
+
   }
   if (PROTOBUF_PREDICT_FALSE(_internal_metadata_.have_unknown_fields())) {
     total_size += _internal_metadata_.unknown_fields<std::string>(::PROTOBUF_NAMESPACE_ID::internal::GetEmptyString).size();
@@ -1011,8 +1221,9 @@ void ModelProto_DiscretePiece::MergeFrom(const ModelProto_DiscretePiece& from) {
   ::PROTOBUF_NAMESPACE_ID::uint32 cached_has_bits = 0;
   (void) cached_has_bits;
 
+  tokens_.MergeFrom(from.tokens_);
   cached_has_bits = from._has_bits_[0];
-  if (cached_has_bits & 0x00000007u) {
+  if (cached_has_bits & 0x0000001fu) {
     if (cached_has_bits & 0x00000001u) {
       _internal_set_piece(from._internal_piece());
     }
@@ -1022,6 +1233,12 @@ void ModelProto_DiscretePiece::MergeFrom(const ModelProto_DiscretePiece& from) {
     if (cached_has_bits & 0x00000004u) {
       type_ = from.type_;
     }
+    if (cached_has_bits & 0x00000008u) {
+      left_id_ = from.left_id_;
+    }
+    if (cached_has_bits & 0x00000010u) {
+      right_id_ = from.right_id_;
+    }
     _has_bits_[0] |= cached_has_bits;
   }
 }
@@ -1046,8 +1263,11 @@ void ModelProto_DiscretePiece::InternalSwap(ModelProto_DiscretePiece* other) {
   _extensions_.Swap(&other->_extensions_);
   _internal_metadata_.Swap<std::string>(&other->_internal_metadata_);
   swap(_has_bits_[0], other->_has_bits_[0]);
+  tokens_.InternalSwap(&other->tokens_);
   piece_.Swap(&other->piece_, &::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), GetArena());
   swap(score_, other->score_);
+  swap(left_id_, other->left_id_);
+  swap(right_id_, other->right_id_);
   swap(type_, other->type_);
 }
 
@@ -1065,6 +1285,12 @@ class ModelProto::_Internal {
   static void set_has_trainer_spec(HasBits* has_bits) {
     (*has_bits)[0] |= 1u;
   }
+  static void set_has_word_dictionary(HasBits* has_bits) {
+    (*has_bits)[0] |= 2u;
+  }
+  static void set_has_tuple_vocab(HasBits* has_bits) {
+    (*has_bits)[0] |= 4u;
+  }
 };
 
 const ::discretepiece::TrainerSpec&
@@ -1090,12 +1316,24 @@ ModelProto::ModelProto(const ModelProto& from)
   } else {
     trainer_spec_ = nullptr;
   }
+  word_dictionary_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
+  if (from._internal_has_word_dictionary()) {
+    word_dictionary_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, from._internal_word_dictionary(), 
+      GetArena());
+  }
+  tuple_vocab_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
+  if (from._internal_has_tuple_vocab()) {
+    tuple_vocab_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, from._internal_tuple_vocab(), 
+      GetArena());
+  }
   // @@protoc_insertion_point(copy_constructor:discretepiece.ModelProto)
 }
 
 void ModelProto::SharedCtor() {
   ::PROTOBUF_NAMESPACE_ID::internal::InitSCC(&scc_info_ModelProto_discretepiece_5fmodel_2eproto.base);
   trainer_spec_ = nullptr;
+  word_dictionary_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
+  tuple_vocab_.UnsafeSetDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
 }
 
 ModelProto::~ModelProto() {
@@ -1107,6 +1345,8 @@ ModelProto::~ModelProto() {
 void ModelProto::SharedDtor() {
   GOOGLE_DCHECK(GetArena() == nullptr);
   if (this != internal_default_instance()) delete trainer_spec_;
+  word_dictionary_.DestroyNoArena(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
+  tuple_vocab_.DestroyNoArena(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited());
 }
 
 void ModelProto::ArenaDtor(void* object) {
@@ -1133,9 +1373,17 @@ void ModelProto::Clear() {
   _extensions_.Clear();
   pieces_.Clear();
   cached_has_bits = _has_bits_[0];
-  if (cached_has_bits & 0x00000001u) {
-    GOOGLE_DCHECK(trainer_spec_ != nullptr);
-    trainer_spec_->Clear();
+  if (cached_has_bits & 0x00000007u) {
+    if (cached_has_bits & 0x00000001u) {
+      GOOGLE_DCHECK(trainer_spec_ != nullptr);
+      trainer_spec_->Clear();
+    }
+    if (cached_has_bits & 0x00000002u) {
+      word_dictionary_.ClearNonDefaultToEmpty();
+    }
+    if (cached_has_bits & 0x00000004u) {
+      tuple_vocab_.ClearNonDefaultToEmpty();
+    }
   }
   _has_bits_.Clear();
   _internal_metadata_.Clear<std::string>();
@@ -1168,6 +1416,22 @@ const char* ModelProto::_InternalParse(const char* ptr, ::PROTOBUF_NAMESPACE_ID:
           CHK_(ptr);
         } else goto handle_unusual;
         continue;
+      // optional bytes word_dictionary = 3;
+      case 3:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 26)) {
+          auto str = _internal_mutable_word_dictionary();
+          ptr = ::PROTOBUF_NAMESPACE_ID::internal::InlineGreedyStringParser(str, ptr, ctx);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
+      // optional bytes tuple_vocab = 4;
+      case 4:
+        if (PROTOBUF_PREDICT_TRUE(static_cast<::PROTOBUF_NAMESPACE_ID::uint8>(tag) == 34)) {
+          auto str = _internal_mutable_tuple_vocab();
+          ptr = ::PROTOBUF_NAMESPACE_ID::internal::InlineGreedyStringParser(str, ptr, ctx);
+          CHK_(ptr);
+        } else goto handle_unusual;
+        continue;
       default: {
       handle_unusual:
         if ((tag & 7) == 4 || tag == 0) {
@@ -1220,6 +1484,18 @@ failure:
         2, _Internal::trainer_spec(this), target, stream);
   }
 
+  // optional bytes word_dictionary = 3;
+  if (cached_has_bits & 0x00000002u) {
+    target = stream->WriteBytesMaybeAliased(
+        3, this->_internal_word_dictionary(), target);
+  }
+
+  // optional bytes tuple_vocab = 4;
+  if (cached_has_bits & 0x00000004u) {
+    target = stream->WriteBytesMaybeAliased(
+        4, this->_internal_tuple_vocab(), target);
+  }
+
   // Extension range [200, 536870912)
   target = _extensions_._InternalSerialize(
       200, 536870912, target, stream);
@@ -1249,12 +1525,29 @@ size_t ModelProto::ByteSizeLong() const {
       ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::MessageSize(msg);
   }
 
-  // optional .discretepiece.TrainerSpec trainer_spec = 2;
   cached_has_bits = _has_bits_[0];
-  if (cached_has_bits & 0x00000001u) {
-    total_size += 1 +
-      ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::MessageSize(
-        *trainer_spec_);
+  if (cached_has_bits & 0x00000007u) {
+    // optional .discretepiece.TrainerSpec trainer_spec = 2;
+    if (cached_has_bits & 0x00000001u) {
+      total_size += 1 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::MessageSize(
+          *trainer_spec_);
+    }
+
+    // optional bytes word_dictionary = 3;
+    if (cached_has_bits & 0x00000002u) {
+      total_size += 1 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::BytesSize(
+          this->_internal_word_dictionary());
+    }
+
+    // optional bytes tuple_vocab = 4;
+    if (cached_has_bits & 0x00000004u) {
+      total_size += 1 +
+        ::PROTOBUF_NAMESPACE_ID::internal::WireFormatLite::BytesSize(
+          this->_internal_tuple_vocab());
+    }
+
   }
 
   if (PROTOBUF_PREDICT_FALSE(_internal_metadata_.have_unknown_fields())) {
@@ -1280,8 +1573,17 @@ void ModelProto::MergeFrom(const ModelProto& from) {
   (void) cached_has_bits;
 
   pieces_.MergeFrom(from.pieces_);
-  if (from._internal_has_trainer_spec()) {
-    _internal_mutable_trainer_spec()->::discretepiece::TrainerSpec::MergeFrom(from._internal_trainer_spec());
+  cached_has_bits = from._has_bits_[0];
+  if (cached_has_bits & 0x00000007u) {
+    if (cached_has_bits & 0x00000001u) {
+      _internal_mutable_trainer_spec()->::discretepiece::TrainerSpec::MergeFrom(from._internal_trainer_spec());
+    }
+    if (cached_has_bits & 0x00000002u) {
+      _internal_set_word_dictionary(from._internal_word_dictionary());
+    }
+    if (cached_has_bits & 0x00000004u) {
+      _internal_set_tuple_vocab(from._internal_tuple_vocab());
+    }
   }
 }
 
@@ -1311,6 +1613,8 @@ void ModelProto::InternalSwap(ModelProto* other) {
   swap(_has_bits_[0], other->_has_bits_[0]);
   pieces_.InternalSwap(&other->pieces_);
   swap(trainer_spec_, other->trainer_spec_);
+  word_dictionary_.Swap(&other->word_dictionary_, &::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), GetArena());
+  tuple_vocab_.Swap(&other->tuple_vocab_, &::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), GetArena());
 }
 
 std::string ModelProto::GetTypeName() const {
@@ -70,11 +70,12 @@ PROTOBUF_NAMESPACE_CLOSE
 namespace discretepiece {
 
 enum TrainerSpec_ModelType : int {
-  TrainerSpec_ModelType_BPE = 1
+  TrainerSpec_ModelType_BPE = 1,
+  TrainerSpec_ModelType_UNIGRAM = 2
 };
 bool TrainerSpec_ModelType_IsValid(int value);
 constexpr TrainerSpec_ModelType TrainerSpec_ModelType_ModelType_MIN = TrainerSpec_ModelType_BPE;
-constexpr TrainerSpec_ModelType TrainerSpec_ModelType_ModelType_MAX = TrainerSpec_ModelType_BPE;
+constexpr TrainerSpec_ModelType TrainerSpec_ModelType_ModelType_MAX = TrainerSpec_ModelType_UNIGRAM;
 constexpr int TrainerSpec_ModelType_ModelType_ARRAYSIZE = TrainerSpec_ModelType_ModelType_MAX + 1;
 
 const std::string& TrainerSpec_ModelType_Name(TrainerSpec_ModelType value);
@@ -211,6 +212,8 @@ class TrainerSpec PROTOBUF_FINAL :
   typedef TrainerSpec_ModelType ModelType;
   static constexpr ModelType BPE =
     TrainerSpec_ModelType_BPE;
+  static constexpr ModelType UNIGRAM =
+    TrainerSpec_ModelType_UNIGRAM;
   static inline bool ModelType_IsValid(int value) {
     return TrainerSpec_ModelType_IsValid(value);
   }
@@ -247,6 +250,10 @@ class TrainerSpec PROTOBUF_FINAL :
     kVocabularyOutputPieceScoreFieldNumber = 12,
     kNumSubIterationsFieldNumber = 10,
     kMaxDiscretepieceLengthFieldNumber = 11,
+    kCollapseRepeatsFieldNumber = 19,
+    kWordDictionarySizeFieldNumber = 20,
+    kNumCodebooksFieldNumber = 21,
+    kWriteLegacyPieceFieldNumber = 22,
   };
   // repeated string input = 1;
   int input_size() const;
@@ -436,6 +443,58 @@ class TrainerSpec PROTOBUF_FINAL :
   void _internal_set_max_discretepiece_length(::PROTOBUF_NAMESPACE_ID::int32 value);
   public:
 
+  // optional bool collapse_repeats = 19 [default = false];
+  bool has_collapse_repeats() const;
+  private:
+  bool _internal_has_collapse_repeats() const;
+  public:
+  void clear_collapse_repeats();
+  bool collapse_repeats() const;
+  void set_collapse_repeats(bool value);
+  private:
+  bool _internal_collapse_repeats() const;
+  void _internal_set_collapse_repeats(bool value);
+  public:
+
+  // optional int32 word_dictionary_size = 20 [default = 0];
+  bool has_word_dictionary_size() const;
+  private:
+  bool _internal_has_word_dictionary_size() const;
+  public:
+  void clear_word_dictionary_size();
+  ::PROTOBUF_NAMESPACE_ID::int32 word_dictionary_size() const;
+  void set_word_dictionary_size(::PROTOBUF_NAMESPACE_ID::int32 value);
+  private:
+  ::PROTOBUF_NAMESPACE_ID::int32 _internal_word_dictionary_size() const;
+  void _internal_set_word_dictionary_size(::PROTOBUF_NAMESPACE_ID::int32 value);
+  public:
+
+  // optional int32 num_codebooks = 21 [default = 1];
+  bool has_num_codebooks() const;
+  private:
+  bool _internal_has_num_codebooks() const;
+  public:
+  void clear_num_codebooks();
+  ::PROTOBUF_NAMESPACE_ID::int32 num_codebooks() const;
+  void set_num_codebooks(::PROTOBUF_NAMESPACE_ID::int32 value);
+  private:
+  ::PROTOBUF_NAMESPACE_ID::int32 _internal_num_codebooks() const;
+  void _internal_set_num_codebooks(::PROTOBUF_NAMESPACE_ID::int32 value);
+  public:
+
+  // optional bool write_legacy_piece = 22 [default = true];
+  bool has_write_legacy_piece() const;
+  private:
+  bool _internal_has_write_legacy_piece() const;
+  public:
+  void clear_write_legacy_piece();
+  bool write_legacy_piece() const;
+  void set_write_legacy_piece(bool value);
+  private:
+  bool _internal_write_legacy_piece() const;
+  void _internal_set_write_legacy_piece(bool value);
+  public:
+
   GOOGLE_PROTOBUF_EXTENSION_ACCESSORS(TrainerSpec)
   // @@protoc_insertion_point(class_scope:discretepiece.TrainerSpec)
  private:
@@ -461,6 +520,10 @@ class TrainerSpec PROTOBUF_FINAL :
   bool vocabulary_output_piece_score_;
   ::PROTOBUF_NAMESPACE_ID::int32 num_sub_iterations_;
   ::PROTOBUF_NAMESPACE_ID::int32 max_discretepiece_length_;
+  bool collapse_repeats_;
+  ::PROTOBUF_NAMESPACE_ID::int32 word_dictionary_size_;
+  ::PROTOBUF_NAMESPACE_ID::int32 num_codebooks_;
+  bool write_legacy_piece_;
   friend struct ::TableStruct_discretepiece_5fmodel_2eproto;
 };
 // -------------------------------------------------------------------
@@ -593,10 +656,35 @@ class ModelProto_DiscretePiece PROTOBUF_FINAL :
   // accessors -------------------------------------------------------
 
   enum : int {
+    kTokensFieldNumber = 4,
     kPieceFieldNumber = 1,
     kScoreFieldNumber = 2,
+    kLeftIdFieldNumber = 5,
+    kRightIdFieldNumber = 6,
     kTypeFieldNumber = 3,
   };
+  // repeated uint32 tokens = 4 [packed = true];
+  int tokens_size() const;
+  private:
+  int _internal_tokens_size() const;
+  public:
+  void clear_tokens();
+  private:
+  ::PROTOBUF_NAMESPACE_ID::uint32 _internal_tokens(int index) const;
+  const ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >&
+      _internal_tokens() const;
+  void _internal_add_tokens(::PROTOBUF_NAMESPACE_ID::uint32 value);
+  ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >*
+      _internal_mutable_tokens();
+  public:
+  ::PROTOBUF_NAMESPACE_ID::uint32 tokens(int index) const;
+  void set_tokens(int index, ::PROTOBUF_NAMESPACE_ID::uint32 value);
+  void add_tokens(::PROTOBUF_NAMESPACE_ID::uint32 value);
+  const ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >&
+      tokens() const;
+  ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >*
+      mutable_tokens();
+
   // optional string piece = 1;
   bool has_piece() const;
   private:
@@ -630,6 +718,32 @@ class ModelProto_DiscretePiece PROTOBUF_FINAL :
   void _internal_set_score(float value);
   public:
 
+  // optional int32 left_id = 5;
+  bool has_left_id() const;
+  private:
+  bool _internal_has_left_id() const;
+  public:
+  void clear_left_id();
+  ::PROTOBUF_NAMESPACE_ID::int32 left_id() const;
+  void set_left_id(::PROTOBUF_NAMESPACE_ID::int32 value);
+  private:
+  ::PROTOBUF_NAMESPACE_ID::int32 _internal_left_id() const;
+  void _internal_set_left_id(::PROTOBUF_NAMESPACE_ID::int32 value);
+  public:
+
+  // optional int32 right_id = 6;
+  bool has_right_id() const;
+  private:
+  bool _internal_has_right_id() const;
+  public:
+  void clear_right_id();
+  ::PROTOBUF_NAMESPACE_ID::int32 right_id() const;
+  void set_right_id(::PROTOBUF_NAMESPACE_ID::int32 value);
+  private:
+  ::PROTOBUF_NAMESPACE_ID::int32 _internal_right_id() const;
+  void _internal_set_right_id(::PROTOBUF_NAMESPACE_ID::int32 value);
+  public:
+
   // optional .discretepiece.ModelProto.DiscretePiece.Type type = 3 [default = NORMAL];
   bool has_type() const;
   private:
@@ -655,8 +769,12 @@ class ModelProto_DiscretePiece PROTOBUF_FINAL :
   typedef void DestructorSkippable_;
   ::PROTOBUF_NAMESPACE_ID::internal::HasBits<1> _has_bits_;
   mutable ::PROTOBUF_NAMESPACE_ID::internal::CachedSize _cached_size_;
+  ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 > tokens_;
+  mutable std::atomic<int> _tokens_cached_byte_size_;
   ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr piece_;
   float score_;
+  ::PROTOBUF_NAMESPACE_ID::int32 left_id_;
+  ::PROTOBUF_NAMESPACE_ID::int32 right_id_;
   int type_;
   friend struct ::TableStruct_discretepiece_5fmodel_2eproto;
 };
@@ -769,6 +887,8 @@ class ModelProto PROTOBUF_FINAL :
 
   enum : int {
     kPiecesFieldNumber = 1,
+    kWordDictionaryFieldNumber = 3,
+    kTupleVocabFieldNumber = 4,
     kTrainerSpecFieldNumber = 2,
   };
   // repeated .discretepiece.ModelProto.DiscretePiece pieces = 1;
@@ -807,6 +927,46 @@ class ModelProto PROTOBUF_FINAL :
       ::discretepiece::TrainerSpec* trainer_spec);
   ::discretepiece::TrainerSpec* unsafe_arena_release_trainer_spec();
 
+  // optional bytes word_dictionary = 3;
+  bool has_word_dictionary() const;
+  private:
+  bool _internal_has_word_dictionary() const;
+  public:
+  void clear_word_dictionary();
+  const std::string& word_dictionary() const;
+  void set_word_dictionary(const std::string& value);
+  void set_word_dictionary(std::string&& value);
+  void set_word_dictionary(const char* value);
+  void set_word_dictionary(const void* value, size_t size);
+  std::string* mutable_word_dictionary();
+  std::string* release_word_dictionary();
+  void set_allocated_word_dictionary(std::string* word_dictionary);
+  private:
+  const std::string& _internal_word_dictionary() const;
+  void _internal_set_word_dictionary(const std::string& value);
+  std::string* _internal_mutable_word_dictionary();
+  public:
+
+  // optional bytes tuple_vocab = 4;
+  bool has_tuple_vocab() const;
+  private:
+  bool _internal_has_tuple_vocab() const;
+  public:
+  void clear_tuple_vocab();
+  const std::string& tuple_vocab() const;
+  void set_tuple_vocab(const std::string& value);
+  void set_tuple_vocab(std::string&& value);
+  void set_tuple_vocab(const char* value);
+  void set_tuple_vocab(const void* value, size_t size);
+  std::string* mutable_tuple_vocab();
+  std::string* release_tuple_vocab();
+  void set_allocated_tuple_vocab(std::string* tuple_vocab);
+  private:
+  const std::string& _internal_tuple_vocab() const;
+  void _internal_set_tuple_vocab(const std::string& value);
+  std::string* _internal_mutable_tuple_vocab();
+  public:
+
   GOOGLE_PROTOBUF_EXTENSION_ACCESSORS(ModelProto)
   // @@protoc_insertion_point(class_scope:discretepiece.ModelProto)
  private:
@@ -821,6 +981,8 @@ class ModelProto PROTOBUF_FINAL :
   mutable ::PROTOBUF_NAMESPACE_ID::internal::CachedSize _cached_size_;
   ::PROTOBUF_NAMESPACE_ID::RepeatedPtrField< ::discretepiece::ModelProto_DiscretePiece > pieces_;
   ::discretepiece::TrainerSpec* trainer_spec_;
+  ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr word_dictionary_;
+  ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr tuple_vocab_;
   friend struct ::TableStruct_discretepiece_5fmodel_2eproto;
 };
 // ===================================================================
@@ -1353,6 +1515,118 @@ inline void TrainerSpec::set_vocabulary_output_piece_score(bool value) {
   // @@protoc_insertion_point(field_set:discretepiece.TrainerSpec.vocabulary_output_piece_score)
 }
 
+// optional bool collapse_repeats = 19 [default = false];
+inline bool TrainerSpec::_internal_has_collapse_repeats() const {
+  bool value = (_has_bits_[0] & 0x00000800u) != 0;
+  return value;
+}
+inline bool TrainerSpec::has_collapse_repeats() const {
+  return _internal_has_collapse_repeats();
+}
+inline void TrainerSpec::clear_collapse_repeats() {
+  collapse_repeats_ = false;
+  _has_bits_[0] &= ~0x00000800u;
+}
+inline bool TrainerSpec::_internal_collapse_repeats() const {
+  return collapse_repeats_;
+}
+inline bool TrainerSpec::collapse_repeats() const {
+  // @@protoc_insertion_point(field_get:discretepiece.TrainerSpec.collapse_repeats)
+  return _internal_collapse_repeats();
+}
+inline void TrainerSpec::_internal_set_collapse_repeats(bool value) {
+  _has_bits_[0] |= 0x00000800u;
+  collapse_repeats_ = value;
+}
+inline void TrainerSpec::set_collapse_repeats(bool value) {
+  _internal_set_collapse_repeats(value);
+  // @@protoc_insertion_point(field_set:discretepiece.TrainerSpec.collapse_repeats)
+}
+
+// optional int32 word_dictionary_size = 20 [default = 0];
+inline bool TrainerSpec::_internal_has_word_dictionary_size() const {
+  bool value = (_has_bits_[0] & 0x00001000u) != 0;
+  return value;
+}
+inline bool TrainerSpec::has_word_dictionary_size() const {
+  return _internal_has_word_dictionary_size();
+}
+inline void TrainerSpec::clear_word_dictionary_size() {
+  word_dictionary_size_ = 0;
+  _has_bits_[0] &= ~0x00001000u;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 TrainerSpec::_internal_word_dictionary_size() const {
+  return word_dictionary_size_;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 TrainerSpec::word_dictionary_size() const {
+  // @@protoc_insertion_point(field_get:discretepiece.TrainerSpec.word_dictionary_size)
+  return _internal_word_dictionary_size();
+}
+inline void TrainerSpec::_internal_set_word_dictionary_size(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _has_bits_[0] |= 0x00001000u;
+  word_dictionary_size_ = value;
+}
+inline void TrainerSpec::set_word_dictionary_size(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _internal_set_word_dictionary_size(value);
+  // @@protoc_insertion_point(field_set:discretepiece.TrainerSpec.word_dictionary_size)
+}
+
+// optional int32 num_codebooks = 21 [default = 1];
+inline bool TrainerSpec::_internal_has_num_codebooks() const {
+  bool value = (_has_bits_[0] & 0x00002000u) != 0;
+  return value;
+}
+inline bool TrainerSpec::has_num_codebooks() const {
+  return _internal_has_num_codebooks();
+}
+inline void TrainerSpec::clear_num_codebooks() {
+  num_codebooks_ = 1;
+  _has_bits_[0] &= ~0x00002000u;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 TrainerSpec::_internal_num_codebooks() const {
+  return num_codebooks_;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 TrainerSpec::num_codebooks() const {
+  // @@protoc_insertion_point(field_get:discretepiece.TrainerSpec.num_codebooks)
+  return _internal_num_codebooks();
+}
+inline void TrainerSpec::_internal_set_num_codebooks(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _has_bits_[0] |= 0x00002000u;
+  num_codebooks_ = value;
+}
+inline void TrainerSpec::set_num_codebooks(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _internal_set_num_codebooks(value);
+  // @@protoc_insertion_point(field_set:discretepiece.TrainerSpec.num_codebooks)
+}
+
+// optional bool write_legacy_piece = 22 [default = true];
+inline bool TrainerSpec::_internal_has_write_legacy_piece() const {
+  bool value = (_has_bits_[0] & 0x00004000u) != 0;
+  return value;
+}
+inline bool TrainerSpec::has_write_legacy_piece() const {
+  return _internal_has_write_legacy_piece();
+}
+inline void TrainerSpec::clear_write_legacy_piece() {
+  write_legacy_piece_ = true;
+  _has_bits_[0] &= ~0x00004000u;
+}
+inline bool TrainerSpec::_internal_write_legacy_piece() const {
+  return write_legacy_piece_;
+}
+inline bool TrainerSpec::write_legacy_piece() const {
+  // @@protoc_insertion_point(field_get:discretepiece.TrainerSpec.write_legacy_piece)
+  return _internal_write_legacy_piece();
+}
+inline void TrainerSpec::_internal_set_write_legacy_piece(bool value) {
+  _has_bits_[0] |= 0x00004000u;
+  write_legacy_piece_ = value;
+}
+inline void TrainerSpec::set_write_legacy_piece(bool value) {
+  _internal_set_write_legacy_piece(value);
+  // @@protoc_insertion_point(field_set:discretepiece.TrainerSpec.write_legacy_piece)
+}
+
 // -------------------------------------------------------------------
 
 // ModelProto_DiscretePiece
@@ -1487,6 +1761,109 @@ inline void ModelProto_DiscretePiece::set_type(::discretepiece::ModelProto_Discr
   // @@protoc_insertion_point(field_set:discretepiece.ModelProto.DiscretePiece.type)
 }
 
+// repeated uint32 tokens = 4 [packed = true];
+inline int ModelProto_DiscretePiece::_internal_tokens_size() const {
+  return tokens_.size();
+}
+inline int ModelProto_DiscretePiece::tokens_size() const {
+  return _internal_tokens_size();
+}
+inline void ModelProto_DiscretePiece::clear_tokens() {
+  tokens_.Clear();
+}
+inline ::PROTOBUF_NAMESPACE_ID::uint32 ModelProto_DiscretePiece::_internal_tokens(int index) const {
+  return tokens_.Get(index);
+}
+inline ::PROTOBUF_NAMESPACE_ID::uint32 ModelProto_DiscretePiece::tokens(int index) const {
+  // @@protoc_insertion_point(field_get:discretepiece.ModelProto.DiscretePiece.tokens)
+  return _internal_tokens(index);
+}
+inline void ModelProto_DiscretePiece::set_tokens(int index, ::PROTOBUF_NAMESPACE_ID::uint32 value) {
+  tokens_.Set(index, value);
+  // @@protoc_insertion_point(field_set:discretepiece.ModelProto.DiscretePiece.tokens)
+}
+inline void ModelProto_DiscretePiece::_internal_add_tokens(::PROTOBUF_NAMESPACE_ID::uint32 value) {
+  tokens_.Add(value);
+}
+inline void ModelProto_DiscretePiece::add_tokens(::PROTOBUF_NAMESPACE_ID::uint32 value) {
+  _internal_add_tokens(value);
+  // @@protoc_insertion_point(field_add:discretepiece.ModelProto.DiscretePiece.tokens)
+}
+inline const ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >&
+ModelProto_DiscretePiece::_internal_tokens() const {
+  return tokens_;
+}
+inline const ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >&
+ModelProto_DiscretePiece::tokens() const {
+  // @@protoc_insertion_point(field_list:discretepiece.ModelProto.DiscretePiece.tokens)
+  return _internal_tokens();
+}
+inline ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >*
+ModelProto_DiscretePiece::_internal_mutable_tokens() {
+  return &tokens_;
+}
+inline ::PROTOBUF_NAMESPACE_ID::RepeatedField< ::PROTOBUF_NAMESPACE_ID::uint32 >*
+ModelProto_DiscretePiece::mutable_tokens() {
+  // @@protoc_insertion_point(field_mutable_list:discretepiece.ModelProto.DiscretePiece.tokens)
+  return _internal_mutable_tokens();
+}
+
+// optional int32 left_id = 5;
+inline bool ModelProto_DiscretePiece::_internal_has_left_id() const {
+  bool value = (_has_bits_[0] & 0x00000008u) != 0;
+  return value;
+}
+inline bool ModelProto_DiscretePiece::has_left_id() const {
+  return _internal_has_left_id();
+}
+inline void ModelProto_DiscretePiece::clear_left_id() {
+  left_id_ = 0;
+  _has_bits_[0] &= ~0x00000008u;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 ModelProto_DiscretePiece::_internal_left_id() const {
+  return left_id_;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 ModelProto_DiscretePiece::left_id() const {
+  // @@protoc_insertion_point(field_get:discretepiece.ModelProto.DiscretePiece.left_id)
+  return _internal_left_id();
+}
+inline void ModelProto_DiscretePiece::_internal_set_left_id(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _has_bits_[0] |= 0x00000008u;
+  left_id_ = value;
+}
+inline void ModelProto_DiscretePiece::set_left_id(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _internal_set_left_id(value);
+  // @@protoc_insertion_point(field_set:discretepiece.ModelProto.DiscretePiece.left_id)
+}
+
+// optional int32 right_id = 6;
+inline bool ModelProto_DiscretePiece::_internal_has_right_id() const {
+  bool value = (_has_bits_[0] & 0x00000010u) != 0;
+  return value;
+}
+inline bool ModelProto_DiscretePiece::has_right_id() const {
+  return _internal_has_right_id();
+}
+inline void ModelProto_DiscretePiece::clear_right_id() {
+  right_id_ = 0;
+  _has_bits_[0] &= ~0x00000010u;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 ModelProto_DiscretePiece::_internal_right_id() const {
+  return right_id_;
+}
+inline ::PROTOBUF_NAMESPACE_ID::int32 ModelProto_DiscretePiece::right_id() const {
+  // @@protoc_insertion_point(field_get:discretepiece.ModelProto.DiscretePiece.right_id)
+  return _internal_right_id();
+}
+inline void ModelProto_DiscretePiece::_internal_set_right_id(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _has_bits_[0] |= 0x00000010u;
+  right_id_ = value;
+}
+inline void ModelProto_DiscretePiece::set_right_id(::PROTOBUF_NAMESPACE_ID::int32 value) {
+  _internal_set_right_id(value);
+  // @@protoc_insertion_point(field_set:discretepiece.ModelProto.DiscretePiece.right_id)
+}
+
 // -------------------------------------------------------------------
 
 // ModelProto
@@ -1613,6 +1990,152 @@ inline void ModelProto::set_allocated_trainer_spec(::discretepiece::TrainerSpec*
   // @@protoc_insertion_point(field_set_allocated:discretepiece.ModelProto.trainer_spec)
 }
 
+// optional bytes word_dictionary = 3;
+inline bool ModelProto::_internal_has_word_dictionary() const {
+  bool value = (_has_bits_[0] & 0x00000002u) != 0;
+  return value;
+}
+inline bool ModelProto::has_word_dictionary() const {
+  return _internal_has_word_dictionary();
+}
+inline void ModelProto::clear_word_dictionary() {
+  word_dictionary_.ClearToEmpty();
+  _has_bits_[0] &= ~0x00000002u;
+}
+inline const std::string& ModelProto::word_dictionary() const {
+  // @@protoc_insertion_point(field_get:discretepiece.ModelProto.word_dictionary)
+  return _internal_word_dictionary();
+}
+inline void ModelProto::set_word_dictionary(const std::string& value) {
+  _internal_set_word_dictionary(value);
+  // @@protoc_insertion_point(field_set:discretepiece.ModelProto.word_dictionary)
+}
+inline std::string* ModelProto::mutable_word_dictionary() {
+  // @@protoc_insertion_point(field_mutable:discretepiece.ModelProto.word_dictionary)
+  return _internal_mutable_word_dictionary();
+}
+inline const std::string& ModelProto::_internal_word_dictionary() const {
+  return word_dictionary_.Get();
+}
+inline void ModelProto::_internal_set_word_dictionary(const std::string& value) {
+  _has_bits_[0] |= 0x00000002u;
+  word_dictionary_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, value, GetArena());
+}
+inline void ModelProto::set_word_dictionary(std::string&& value) {
+  _has_bits_[0] |= 0x00000002u;
+  word_dictionary_.Set(
+    ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, ::std::move(value), GetArena());
+  // @@protoc_insertion_point(field_set_rvalue:discretepiece.ModelProto.word_dictionary)
+}
+inline void ModelProto::set_word_dictionary(const char* value) {
+  GOOGLE_DCHECK(value != nullptr);
+  _has_bits_[0] |= 0x00000002u;
+  word_dictionary_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, ::std::string(value), GetArena());
+  // @@protoc_insertion_point(field_set_char:discretepiece.ModelProto.word_dictionary)
+}
+inline void ModelProto::set_word_dictionary(const void* value,
+    size_t size) {
+  _has_bits_[0] |= 0x00000002u;
+  word_dictionary_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, ::std::string(
+      reinterpret_cast<const char*>(value), size), GetArena());
+  // @@protoc_insertion_point(field_set_pointer:discretepiece.ModelProto.word_dictionary)
+}
+inline std::string* ModelProto::_internal_mutable_word_dictionary() {
+  _has_bits_[0] |= 0x00000002u;
+  return word_dictionary_.Mutable(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, GetArena());
+}
+inline std::string* ModelProto::release_word_dictionary() {
+  // @@protoc_insertion_point(field_release:discretepiece.ModelProto.word_dictionary)
+  if (!_internal_has_word_dictionary()) {
+    return nullptr;
+  }
+  _has_bits_[0] &= ~0x00000002u;
+  return word_dictionary_.ReleaseNonDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), GetArena());
+}
+inline void ModelProto::set_allocated_word_dictionary(std::string* word_dictionary) {
+  if (word_dictionary != nullptr) {
+    _has_bits_[0] |= 0x00000002u;
+  } else {
+    _has_bits_[0] &= ~0x00000002u;
+  }
+  word_dictionary_.SetAllocated(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), word_dictionary,
+      GetArena());
+  // @@protoc_insertion_point(field_set_allocated:discretepiece.ModelProto.word_dictionary)
+}
+
+// optional bytes tuple_vocab = 4;
+inline bool ModelProto::_internal_has_tuple_vocab() const {
+  bool value = (_has_bits_[0] & 0x00000004u) != 0;
+  return value;
+}
+inline bool ModelProto::has_tuple_vocab() const {
+  return _internal_has_tuple_vocab();
+}
+inline void ModelProto::clear_tuple_vocab() {
+  tuple_vocab_.ClearToEmpty();
+  _has_bits_[0] &= ~0x00000004u;
+}
+inline const std::string& ModelProto::tuple_vocab() const {
+  // @@protoc_insertion_point(field_get:discretepiece.ModelProto.tuple_vocab)
+  return _internal_tuple_vocab();
+}
+inline void ModelProto::set_tuple_vocab(const std::string& value) {
+  _internal_set_tuple_vocab(value);
+  // @@protoc_insertion_point(field_set:discretepiece.ModelProto.tuple_vocab)
+}
+inline std::string* ModelProto::mutable_tuple_vocab() {
+  // @@protoc_insertion_point(field_mutable:discretepiece.ModelProto.tuple_vocab)
+  return _internal_mutable_tuple_vocab();
+}
+inline const std::string& ModelProto::_internal_tuple_vocab() const {
+  return tuple_vocab_.Get();
+}
+inline void ModelProto::_internal_set_tuple_vocab(const std::string& value) {
+  _has_bits_[0] |= 0x00000004u;
+  tuple_vocab_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, value, GetArena());
+}
+inline void ModelProto::set_tuple_vocab(std::string&& value) {
+  _has_bits_[0] |= 0x00000004u;
+  tuple_vocab_.Set(
+    ::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, ::std::move(value), GetArena());
+  // @@protoc_insertion_point(field_set_rvalue:discretepiece.ModelProto.tuple_vocab)
+}
+inline void ModelProto::set_tuple_vocab(const char* value) {
+  GOOGLE_DCHECK(value != nullptr);
+  _has_bits_[0] |= 0x00000004u;
+  tuple_vocab_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, ::std::string(value), GetArena());
+  // @@protoc_insertion_point(field_set_char:discretepiece.ModelProto.tuple_vocab)
+}
+inline void ModelProto::set_tuple_vocab(const void* value,
+    size_t size) {
+  _has_bits_[0] |= 0x00000004u;
+  tuple_vocab_.Set(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, ::std::string(
+      reinterpret_cast<const char*>(value), size), GetArena());
+  // @@protoc_insertion_point(field_set_pointer:discretepiece.ModelProto.tuple_vocab)
+}
+inline std::string* ModelProto::_internal_mutable_tuple_vocab() {
+  _has_bits_[0] |= 0x00000004u;
+  return tuple_vocab_.Mutable(::PROTOBUF_NAMESPACE_ID::internal::ArenaStringPtr::EmptyDefault{}, GetArena());
+}
+inline std::string* ModelProto::release_tuple_vocab() {
+  // @@protoc_insertion_point(field_release:discretepiece.ModelProto.tuple_vocab)
+  if (!_internal_has_tuple_vocab()) {
+    return nullptr;
+  }
+  _has_bits_[0] &= ~0x00000004u;
+  return tuple_vocab_.ReleaseNonDefault(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), GetArena());
+}
+inline void ModelProto::set_allocated_tuple_vocab(std::string* tuple_vocab) {
+  if (tuple_vocab != nullptr) {
+    _has_bits_[0] |= 0x00000004u;
+  } else {
+    _has_bits_[0] &= ~0x00000004u;
+  }
+  tuple_vocab_.SetAllocated(&::PROTOBUF_NAMESPACE_ID::internal::GetEmptyStringAlreadyInited(), tuple_vocab,
+      GetArena());
+  // @@protoc_insertion_point(field_set_allocated:discretepiece.ModelProto.tuple_vocab)
+}
+
 #ifdef __GNUC__
   #pragma GCC diagnostic pop
 #endif  // __GNUC__
@@ -14,6 +14,8 @@
 
 #include "discretepiece_processor.h"
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <set>
 #include <utility>
@@ -34,14 +36,213 @@
 
 namespace discretepiece {
 
+StreamingEncoder::StreamingEncoder(std::shared_ptr<const CompiledModel> model,
+                                   EncodeMode mode)
+    : compiled_(std::move(model)),
+      model_(compiled_ ? compiled_->model() : nullptr),
+      mode_(mode) {}
+
+StreamingEncoder::~StreamingEncoder() {}
+
+util::Status StreamingEncoder::AcceptTokens(absl::Span<const char32> tokens) {
+  CHECK_OR_RETURN(model_) << "Model is not initialized.";
+  RETURN_IF_ERROR(model_->status());
+
+  std::vector<char32> interned;
+  if (model_->num_codebooks() > 1) {
+    RETURN_IF_ERROR(model_->tuple_vocab().Intern(
+        tokens, model_->deliminator_char32_value(), &interned));
+    tokens = absl::MakeConstSpan(interned);
+  }
+
+  // A safe cut always has a token on its right which differs from the one
+  // on its left, so a run is never split between two emitted prefixes.
+  const bool collapse = model_->collapse_repeats();
+  for (const char32 c : tokens) {
+    if (collapse && !pending_.empty() && pending_.back() == c) {
+      ++pending_durations_.back();
+    } else {
+      pending_.push_back(c);
+      pending_durations_.push_back(1);
+    }
+  }
+
+  // A cut is decided once the lookahead of IsSafeCut() is available.
+  const size_t lookahead = std::max(model_->GetMaxPieceLength() - 1, 0);
+  size_t last_safe_cut = 0;
+  for (; next_cut_ < pending_.size(); ++next_cut_) {
+    if (model_->IsSafeCut(pending_, next_cut_)) {
+      last_safe_cut = next_cut_;
+    } else if (next_cut_ + lookahead > pending_.size()) {
+      break;
+    }
+  }
+
+  if (last_safe_cut > 0) EmitPrefix(last_safe_cut);
+
+  return util::OkStatus();
+}
+
+std::vector<int> StreamingEncoder::PopStableIds() {
+  std::vector<int> ids;
+  ids.swap(stable_ids_);
+  return ids;
+}
+
+std::vector<int> StreamingEncoder::PopStableDurations() {
+  std::vector<int> durations;
+  durations.swap(stable_durations_);
+  return durations;
+}
+
+util::Status StreamingEncoder::Finish() {
+  CHECK_OR_RETURN(model_) << "Model is not initialized.";
+  RETURN_IF_ERROR(model_->status());
+  EmitPrefix(pending_.size());
+  return util::OkStatus();
+}
+
+void StreamingEncoder::EmitPrefix(size_t pos) {
+  model_->EncodeIdsWithMode(absl::MakeConstSpan(pending_).first(pos), mode_,
+                            &stable_ids_);
+  for (size_t i = 0; i < pos; ++i) {
+    if (pending_[i] != model_->deliminator_char32_value()) {
+      stable_durations_.push_back(pending_durations_[i]);
+    }
+  }
+  pending_.erase(pending_.begin(), pending_.begin() + pos);
+  pending_durations_.erase(pending_durations_.begin(),
+                           pending_durations_.begin() + pos);
+  next_cut_ = next_cut_ > pos ? next_cut_ - pos : 1;
+}
+
+CompiledModel::CompiledModel() {}
+
+CompiledModel::~CompiledModel() {}
+
+std::shared_ptr<const CompiledModel> CompiledModel::Load(absl::string_view filename) {
+  std::shared_ptr<CompiledModel> model(new CompiledModel);
+  if (ModelImage::IsImageFile(filename)) {
+    model->status_ = model->LoadImage(filename);
+    return model;
+  }
+  model->model_proto_ = absl::make_unique<ModelProto>();
+  model->status_ = io::LoadModelProto(filename, model->model_proto_.get());
+  if (model->status_.ok()) model->status_ = model->Build();
+  return model;
+}
+
+std::shared_ptr<const CompiledModel> CompiledModel::Create(
+    std::unique_ptr<ModelProto> model_proto) {
+  std::shared_ptr<CompiledModel> model(new CompiledModel);
+  model->model_proto_ = std::move(model_proto);
+  model->status_ = model->Build();
+  return model;
+}
+
+util::Status CompiledModel::Build() {
+  model_ = ModelFactory::Create(*model_proto_);
+  fingerprint_ = port::Fingerprint(model_proto_->SerializeAsString());
+
+  RETURN_IF_ERROR(status());
+  return InitializeDecodeTables();
+}
+
+util::Status CompiledModel::LoadImage(absl::string_view filename) {
+  image_ = absl::make_unique<ModelImage>();
+  RETURN_IF_ERROR(image_->Open(filename));
+  absl::string_view data;
+  RETURN_IF_ERROR(image_->section("PROT", &data));
+  model_proto_ = absl::make_unique<ModelProto>();
+  CHECK_OR_RETURN(model_proto_->ParseFromArray(data.data(), data.size()))
+      << "broken model proto in " << filename;
+
+  model_ = ModelFactory::Create(*model_proto_, image_.get());
+  fingerprint_ = image_->fingerprint();
+
+  RETURN_IF_ERROR(status());
+  return InitializeDecodeTables();
+}
+
+util::Status CompiledModel::SaveImage(absl::string_view filename) const {
+  RETURN_IF_ERROR(status());
+
+  // The pieces and the serialized tables are in their own sections.
+  ModelProto model_proto = *model_proto_;
+  model_proto.clear_pieces();
+  model_proto.clear_word_dictionary();
+  model_proto.clear_tuple_vocab();
+
+  ModelImageBuilder builder;
+  builder.Add("PROT", model_proto.SerializeAsString());
+  model_->SaveImage(&builder);
+  builder.Add("DTOK", std::string(decoded_tokens_.bytes()));
+  builder.Add("DOFF", std::string(decoded_offsets_.bytes()));
+  builder.Add("STRS", std::string(piece_chars_.bytes()));
+  builder.Add("SOFF", std::string(piece_string_offsets_.bytes()));
+  return builder.Write(filename, fingerprint_);
+}
+
+util::Status CompiledModel::InitializeDecodeTables() {
+  const size_t piece_size = model_->GetPieceSize();
+  if (image_ != nullptr) {
+    absl::string_view data;
+    RETURN_IF_ERROR(image_->section("DTOK", &data));
+    CHECK_OR_RETURN(decoded_tokens_.InitFromBytes(data)) << "broken decode table.";
+    RETURN_IF_ERROR(image_->section("DOFF", &data));
+    CHECK_OR_RETURN(decoded_offsets_.InitFromBytes(data) &&
+                    decoded_offsets_.size() == piece_size + 1 &&
+                    decoded_offsets_[piece_size] == decoded_tokens_.size())
+        << "broken decode table.";
+    RETURN_IF_ERROR(image_->section("STRS", &data));
+    CHECK_OR_RETURN(piece_chars_.InitFromBytes(data)) << "broken piece strings.";
+    RETURN_IF_ERROR(image_->section("SOFF", &data));
+    CHECK_OR_RETURN(piece_string_offsets_.InitFromBytes(data) &&
+                    piece_string_offsets_.size() == piece_size + 1 &&
+                    piece_string_offsets_[piece_size] == piece_chars_.size())
+        << "broken piece strings.";
+    for (size_t id = 0; id < piece_size; ++id) {
+      CHECK_OR_RETURN(decoded_offsets_[id] <= decoded_offsets_[id + 1] &&
+                      piece_string_offsets_[id] <= piece_string_offsets_[id + 1])
+          << "broken decode table.";
+    }
+    return util::OkStatus();
+  }
+
+  std::vector<char32> tokens;
+  std::vector<uint32> offsets = {0};
+  std::string chars;
+  std::vector<uint32> string_offsets = {0};
+  for (size_t id = 0; id < piece_size; ++id) {
+    const size_t begin = tokens.size();
+    RETURN_IF_ERROR(ExpandTuples(model_->GetPieceTokens(id), &tokens));
+    offsets.push_back(tokens.size());
+    const auto piece = absl::MakeConstSpan(tokens).subspan(begin);
+    chars.append(model_->num_codebooks() > 1
+                     ? string_util::TuplesToString(piece, model_->num_codebooks(), "_")
+                     : string_util::VectorChar32ToString(piece, "_"));
+    string_offsets.push_back(chars.size());
+  }
+  decoded_tokens_.assign(std::move(tokens));
+  decoded_offsets_.assign(std::move(offsets));
+  piece_chars_.assign(std::vector<char>(chars.begin(), chars.end()));
+  piece_string_offsets_.assign(std::move(string_offsets));
+  return util::OkStatus();
+}
+
+util::Status CompiledModel::status() const {
+  RETURN_IF_ERROR(status_);
+  CHECK_OR_RETURN(model_) << "Model is not initialized.";
+  RETURN_IF_ERROR(model_->status());
+  return util::OkStatus();
+}
+
 DiscretePieceProcessor::DiscretePieceProcessor() {}
 
 DiscretePieceProcessor::~DiscretePieceProcessor() {}
 
 util::Status DiscretePieceProcessor::Load(absl::string_view filename) {
-  auto model_proto = absl::make_unique<ModelProto>();
-  RETURN_IF_ERROR(io::LoadModelProto(filename, model_proto.get()));
-  return Load(std::move(model_proto));
+  return Load(CompiledModel::Load(filename));
 }
 
 void DiscretePieceProcessor::LoadOrDie(absl::string_view filename) {
@@ -49,33 +250,147 @@ void DiscretePieceProcessor::LoadOrDie(absl::string_view filename) {
 }
 
 util::Status DiscretePieceProcessor::Load(std::unique_ptr<ModelProto> model_proto) {
-  model_proto_ = std::move(model_proto);
-  model_ = ModelFactory::Create(*model_proto_);
-
-  RETURN_IF_ERROR(status());
+  return Load(CompiledModel::Create(std::move(model_proto)));
+}
 
+util::Status DiscretePieceProcessor::Load(std::shared_ptr<const CompiledModel> model) {
+  CHECK_OR_RETURN(model) << "Model is not initialized.";
+  RETURN_IF_ERROR(model->status());
+  const int64 cache_size = encode_cache_size_.load();
+  if (cache_size >= 0) model->model()->SetEncodeCacheSize(cache_size);
+  std::atomic_store(&model_, model);
   return util::OkStatus();
 }
 
+util::Status DiscretePieceProcessor::Reload(absl::string_view filename) {
+  return Load(CompiledModel::Load(filename));
+}
+
+std::shared_ptr<const CompiledModel> DiscretePieceProcessor::compiled_model() const {
+  return std::atomic_load(&model_);
+}
+
+util::Status DiscretePieceProcessor::GetModel(
+    std::shared_ptr<const CompiledModel> *model) const {
+  *model = std::atomic_load(&model_);
+  CHECK_OR_RETURN(*model) << "Model is not initialized.";
+  return (*model)->status();
+}
+
 util::Status DiscretePieceProcessor::status() const {
-  CHECK_OR_RETURN(model_) << "Model is not initialized.";
-  RETURN_IF_ERROR(model_->status());
-  return util::OkStatus();
+  std::shared_ptr<const CompiledModel> model;
+  return GetModel(&model);
+}
+
+util::Status DiscretePieceProcessor::SaveImage(absl::string_view filename) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  return model->SaveImage(filename);
+}
+
+uint64 DiscretePieceProcessor::model_fingerprint() const {
+  const auto model = compiled_model();
+  return model ? model->fingerprint() : 0;
 }
 
 //////////////////////////////////////////////////////////////
 // Simple API.
-util::Status DiscretePieceProcessor::Encode(const std::vector<char32> &input, std::vector<std::vector<char32>> *tokenized) const {
-  for (const auto &p: model_->Encode(input)) {
-    tokenized->push_back(p.first);
+util::Status DiscretePieceProcessor::Encode(absl::Span<const char32> input, std::vector<std::vector<char32>> *tokenized) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  std::vector<char32> buffer;
+  RETURN_IF_ERROR(model->PrepareInput(&input, &buffer, nullptr));
+  for (const auto &p: model->model()->EncodeParallel(input, encode_mode_, num_encode_threads_, parallel_window_size_)) {
+    tokenized->emplace_back();
+    RETURN_IF_ERROR(model->ExpandTuples(p.first, &tokenized->back()));
   }
   return util::OkStatus();
 }
 
-util::Status DiscretePieceProcessor::Encode(const std::vector<char32> &input, std::vector<int> *tokenized) const {
-  for (const auto &p: model_->Encode(input)) {
-    tokenized->push_back(p.second);
+util::Status DiscretePieceProcessor::Encode(absl::Span<const char32> input, std::vector<int> *tokenized) const {
+  return Encode(input, tokenized, nullptr);
+}
+
+util::Status DiscretePieceProcessor::Encode(absl::Span<const char32> input, std::vector<int> *tokenized,
+                                            std::vector<int> *durations) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  std::vector<char32> buffer;
+  RETURN_IF_ERROR(model->PrepareInput(&input, &buffer, durations));
+  model->model()->EncodeIdsParallel(input, encode_mode_, num_encode_threads_,
+                                    parallel_window_size_, tokenized);
+  return util::OkStatus();
+}
+
+util::Status DiscretePieceProcessor::Encode(absl::Span<const char32> input, int max_piece_id,
+                                            std::vector<int> *tokenized) const {
+  return Encode(input, max_piece_id, tokenized, nullptr);
+}
+
+util::Status DiscretePieceProcessor::Encode(absl::Span<const char32> input, int max_piece_id,
+                                            std::vector<int> *tokenized,
+                                            std::vector<int> *durations) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  std::vector<char32> buffer;
+  RETURN_IF_ERROR(model->PrepareInput(&input, &buffer, durations));
+  return model->model()->EncodeIdsTruncated(input, max_piece_id, tokenized);
+}
+
+util::Status DiscretePieceProcessor::EncodeBatch(
+    const std::vector<absl::Span<const char32>> &inputs,
+    std::vector<std::vector<int>> *tokenized,
+    std::vector<std::vector<int>> *durations) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  std::vector<std::vector<char32>> buffers(inputs.size());
+  std::vector<absl::Span<const char32>> spans(inputs.begin(), inputs.end());
+  if (durations != nullptr) durations->assign(inputs.size(), std::vector<int>());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    RETURN_IF_ERROR(model->PrepareInput(&spans[i], &buffers[i],
+                                        durations == nullptr ? nullptr : &(*durations)[i]));
+  }
+
+  if (encode_mode_ == EncodeMode::kModel) {
+    model->model()->EncodeIdsBatch(spans, tokenized);
+    return util::OkStatus();
+  }
+  tokenized->assign(spans.size(), std::vector<int>());
+  for (size_t i = 0; i < spans.size(); ++i) {
+    model->model()->EncodeIdsWithMode(spans[i], encode_mode_, &(*tokenized)[i]);
+  }
+  return util::OkStatus();
+}
+
+util::Status CompiledModel::PrepareInput(absl::Span<const char32> *input,
+                                         std::vector<char32> *buffer,
+                                         std::vector<int> *durations) const {
+  const char32 deliminator = model_->deliminator_char32_value();
+  if (model_->num_codebooks() > 1) {
+    std::vector<char32> interned;
+    RETURN_IF_ERROR(model_->tuple_vocab().Intern(*input, deliminator, &interned));
+    buffer->swap(interned);
+    *input = absl::MakeConstSpan(*buffer);
+  }
+  if (model_->collapse_repeats()) {
+    std::vector<char32> collapsed;
+    string_util::CollapseRepeats(*input, deliminator, &collapsed, durations);
+    buffer->swap(collapsed);
+    *input = absl::MakeConstSpan(*buffer);
+  } else if (durations != nullptr) {
+    for (const char32 c : *input) {
+      if (c != deliminator) durations->push_back(1);
+    }
+  }
+  return util::OkStatus();
+}
+
+util::Status CompiledModel::ExpandTuples(absl::Span<const char32> ids,
+                                         std::vector<char32> *output) const {
+  if (model_->num_codebooks() > 1) {
+    return model_->tuple_vocab().Expand(ids, model_->deliminator_char32_value(), output);
   }
+  output->insert(output->end(), ids.begin(), ids.end());
   return util::OkStatus();
 }
 
@@ -87,14 +402,127 @@ util::Status DiscretePieceProcessor::Decode(const std::vector<std::vector<char32
 }
 
 
+util::Status CompiledModel::DecodeIds(absl::Span<const int> ids,
+                                      std::vector<char32> *detokenized) const {
+  const int piece_size = static_cast<int>(decoded_offsets_.size()) - 1;
+  size_t size = detokenized->size();
+  for (const int id : ids) {
+    CHECK_OR_RETURN(id >= 0 && id < piece_size) << "id " << id << " is out of range.";
+    size += decoded_offsets_[id + 1] - decoded_offsets_[id];
+  }
+  size_t pos = detokenized->size();
+  detokenized->resize(size);
+  char32 *out = detokenized->data();
+  for (const int id : ids) {
+    const uint32 begin = decoded_offsets_[id];
+    const uint32 length = decoded_offsets_[id + 1] - begin;
+    std::memcpy(out + pos, decoded_tokens_.data() + begin, length * sizeof(char32));
+    pos += length;
+  }
+  return util::OkStatus();
+}
+
 util::Status DiscretePieceProcessor::Decode(const std::vector<int> &ids, std::vector<char32> *detokenized) const {
-  for (int id: ids) {
-    auto piece = model_->IdToPiece(id);
-    detokenized->insert(detokenized->end(), piece.begin(), piece.end());
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  return model->DecodeIds(ids, detokenized);
+}
+
+util::Status DiscretePieceProcessor::DecodeBatch(const std::vector<std::vector<int>> &ids,
+                                                 std::vector<std::vector<char32>> *detokenized) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  detokenized->resize(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i) {
+    (*detokenized)[i].clear();
+    RETURN_IF_ERROR(model->DecodeIds(ids[i], &(*detokenized)[i]));
   }
   return util::OkStatus();
 }
 
+util::Status DiscretePieceProcessor::Decode(const std::vector<int> &ids, const std::vector<int> &durations,
+                                            std::vector<char32> *detokenized) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  std::vector<char32> expanded;
+  size_t n = 0;
+  for (int id: ids) {
+    CHECK_OR_RETURN(id >= 0 && id < model->model()->GetPieceSize()) << "id " << id << " is out of range.";
+    for (const char32 c : model->model()->GetPieceTokens(id)) {
+      CHECK_LT_OR_RETURN(n, durations.size()) << "too few durations.";
+      CHECK_GT_OR_RETURN(durations[n], 0) << "durations must be positive.";
+      expanded.insert(expanded.end(), durations[n++], c);
+    }
+  }
+  CHECK_EQ_OR_RETURN(n, durations.size()) << "too many durations.";
+  return model->ExpandTuples(expanded, detokenized);
+}
+
+util::Status DiscretePieceProcessor::Decode(const std::vector<int> &ids, int max_piece_id,
+                                            std::vector<char32> *detokenized) const {
+  std::shared_ptr<const CompiledModel> model;
+  RETURN_IF_ERROR(GetModel(&model));
+  std::vector<int> full_ids;
+  RETURN_IF_ERROR(model->model()->TruncatedIdsToIds(ids, max_piece_id, &full_ids));
+  return model->DecodeIds(full_ids, detokenized);
+}
+
+TokenSeq DiscretePieceProcessor::IdToPiece(int id) const {
+  std::shared_ptr<const CompiledModel> model;
+  if (!GetModel(&model).ok()) return TokenSeq();
+  return model->model()->IdToPiece(id);
+}
+
+absl::string_view CompiledModel::IdToPieceString(int id) const {
+  if (id < 0 || static_cast<size_t>(id) + 1 >= piece_string_offsets_.size()) {
+    return absl::string_view();
+  }
+  return absl::string_view(piece_chars_.data() + piece_string_offsets_[id],
+                           piece_string_offsets_[id + 1] - piece_string_offsets_[id]);
+}
+
+std::string DiscretePieceProcessor::IdToPieceString(int id) const {
+  std::shared_ptr<const CompiledModel> model;
+  if (!GetModel(&model).ok()) return std::string();
+  return std::string(model->IdToPieceString(id));
+}
+
+std::unique_ptr<StreamingEncoder> DiscretePieceProcessor::NewStreamingEncoder() const {
+  return absl::make_unique<StreamingEncoder>(compiled_model(), encode_mode_);
+}
+
+void DiscretePieceProcessor::SetEncodeMode(EncodeMode mode) {
+  encode_mode_ = mode;
+}
+
+void DiscretePieceProcessor::SetEncodeThreads(int num_threads, size_t window_size) {
+  num_encode_threads_ = num_threads;
+  parallel_window_size_ = window_size;
+}
+
+model::LRUCacheStats DiscretePieceProcessor::GetEncodeCacheStats() const {
+  std::shared_ptr<const CompiledModel> model;
+  if (!GetModel(&model).ok()) return {};
+  return model->model()->GetEncodeCacheStats();
+}
+
+void DiscretePieceProcessor::SetEncodeCacheSize(size_t size) {
+  encode_cache_size_ = size;
+  std::shared_ptr<const CompiledModel> model;
+  if (GetModel(&model).ok()) model->model()->SetEncodeCacheSize(size);
+}
+
+int DiscretePieceProcessor::num_codebooks() const {
+  std::shared_ptr<const CompiledModel> model;
+  if (!GetModel(&model).ok()) return 1;
+  return model->model()->num_codebooks();
+}
+
+absl::flat_hash_map<char, char32> DiscretePieceProcessor::deliminator_map() const {
+  std::shared_ptr<const CompiledModel> model;
+  if (!GetModel(&model).ok()) return {};
+  return model->model()->deliminator_map();
+}
 
 namespace io {
 
@@ -123,7 +551,7 @@ util::Status SaveModelProto(absl::string_view filename,
   RETURN_IF_ERROR(output->status());
   CHECK_OR_RETURN(output->Write(model_proto.SerializeAsString()));
 
-  return util::OkStatus();
+  return output->Close();
 }
 }  // namespace io
 
@@ -15,6 +15,7 @@
 #ifndef DISCRETEPIECE_PROCESSOR_H_
 #define DISCRETEPIECE_PROCESSOR_H_
 
+#include <atomic>
 #include <cstring>
 #include <memory>
 #include <string>
@@ -26,6 +27,150 @@
 
 namespace discretepiece {
 
+// Immutable compiled model: the ModelProto, the model built from it, the
+// mapped model image if loaded from one, and the decode tables. It is held
+// through std::shared_ptr<const CompiledModel>, so any number of processors
+// and threads share one copy. A call holds its own reference for its whole
+// duration, so DiscretePieceProcessor::Reload() never frees the model under
+// a running encode; the old model is released with its last reference.
+class CompiledModel {
+ public:
+  ~CompiledModel();
+
+  CompiledModel(const CompiledModel &) = delete;
+  CompiledModel &operator=(const CompiledModel &) = delete;
+
+  // Loads `filename`, either a serialized ModelProto or a model image.
+  // Never returns null; errors are reported by status().
+  static std::shared_ptr<const CompiledModel> Load(absl::string_view filename);
+
+  // Compiles `model_proto`, which is moved. Never returns null.
+  static std::shared_ptr<const CompiledModel> Create(
+      std::unique_ptr<ModelProto> model_proto);
+
+  // Returns the status. The model is usable when status is OK.
+  util::Status status() const;
+
+  const ModelInterface *model() const { return model_.get(); }
+
+  const ModelProto &model_proto() const { return *model_proto_; }
+
+  // Fingerprint of the serialized ModelProto, see
+  // DiscretePieceProcessor::model_fingerprint().
+  uint64 fingerprint() const { return fingerprint_; }
+
+  // Writes the model image (.dpm) of this model.
+  util::Status SaveImage(absl::string_view filename) const;
+
+  // Points `input` to its interned tuples if num_codebooks() > 1, then to
+  // its collapsed copy if the model was trained with collapse_repeats. The
+  // copies are kept in `buffer`. Durations are appended if not null.
+  util::Status PrepareInput(absl::Span<const char32> *input,
+                            std::vector<char32> *buffer,
+                            std::vector<int> *durations) const;
+
+  // Appends `ids` to `output`, expanded to flattened tuples if
+  // num_codebooks() > 1.
+  util::Status ExpandTuples(absl::Span<const char32> ids,
+                            std::vector<char32> *output) const;
+
+  // Appends the decoded tokens of `ids` to `detokenized`.
+  util::Status DecodeIds(absl::Span<const int> ids,
+                         std::vector<char32> *detokenized) const;
+
+  // Returns the text form of the piece of `id`, or an empty view if `id` is
+  // out of range. The view lives as long as this model.
+  absl::string_view IdToPieceString(int id) const;
+
+ private:
+  CompiledModel();
+
+  // Maps the model image `filename`.
+  util::Status LoadImage(absl::string_view filename);
+
+  // Builds the model from model_proto_.
+  util::Status Build();
+
+  // Builds decoded_tokens_, decoded_offsets_, piece_chars_ and
+  // piece_string_offsets_, or points them into image_ if not null.
+  util::Status InitializeDecodeTables();
+
+  util::Status status_;
+
+  // Mapped model image the tables point into, if loaded from one. Declared
+  // before model_ so that it outlives the model.
+  std::unique_ptr<ModelImage> image_;
+
+  // Underlying model protocol buffer. Declared before model_, which
+  // refers to it.
+  std::unique_ptr<ModelProto> model_proto_;
+
+  std::unique_ptr<ModelInterface> model_;
+
+  uint64 fingerprint_ = 0;
+
+  // Output tokens of every piece, expanded to tuples if num_codebooks() > 1.
+  // The tokens of id i are decoded_tokens_[decoded_offsets_[i],
+  // decoded_offsets_[i + 1]), so decoding is a gather of memcpy's.
+  FlatArray<char32> decoded_tokens_;
+  FlatArray<uint32> decoded_offsets_;
+
+  // Preformatted IdToPieceString() of every piece, the string of id i is
+  // piece_chars_[piece_string_offsets_[i], piece_string_offsets_[i + 1]).
+  FlatArray<char> piece_chars_;
+  FlatArray<uint32> piece_string_offsets_;
+};
+
+// Incremental encoder for token streams which arrive a few tokens at a time.
+// Pieces are emitted once no future input can change them, i.e. at cuts
+// accepted by ModelInterface::IsSafeCut(), so the concatenation of all
+// emitted ids is the same as the offline encoding of the whole stream.
+// Created by DiscretePieceProcessor::NewStreamingEncoder(). The encoder
+// keeps its model, so a stream is finished on the model it started with
+// even if the processor is reloaded. Runs of the same token are collapsed
+// on the fly when the model was trained with collapse_repeats.
+class StreamingEncoder {
+ public:
+  explicit StreamingEncoder(std::shared_ptr<const CompiledModel> model,
+                            EncodeMode mode = EncodeMode::kModel);
+
+  virtual ~StreamingEncoder();
+
+  // Appends `tokens` to the stream and encodes the part which became stable.
+  virtual util::Status AcceptTokens(absl::Span<const char32> tokens);
+
+  // Returns the ids which became stable since the last call.
+  virtual std::vector<int> PopStableIds();
+
+  // Returns the durations of the tokens of the ids returned by
+  // PopStableIds(), see DiscretePieceProcessor::Encode().
+  virtual std::vector<int> PopStableDurations();
+
+  // Marks the end of the stream and encodes all pending tokens.
+  // The encoder can be used for a new stream afterwards.
+  virtual util::Status Finish();
+
+  // Returns the number of accepted tokens which are not encoded yet.
+  size_t pending_size() const { return pending_.size(); }
+
+ private:
+  // Encodes pending_[0, pos) into stable_ids_ and drops it from pending_.
+  void EmitPrefix(size_t pos);
+
+  std::shared_ptr<const CompiledModel> compiled_;
+  const ModelInterface *model_ = nullptr;
+  const EncodeMode mode_ = EncodeMode::kModel;
+
+  // Accepted tokens which are not encoded yet, and their run lengths.
+  std::vector<char32> pending_;
+  std::vector<int> pending_durations_;
+
+  // The next cut in pending_ which is not decided yet.
+  size_t next_cut_ = 1;
+
+  std::vector<int> stable_ids_;
+  std::vector<int> stable_durations_;
+};
 
 class DiscretePieceProcessor {
  public:
@@ -33,7 +178,8 @@ class DiscretePieceProcessor {
   
   virtual ~DiscretePieceProcessor();
 
-  // Loads model from `filename`.
+  // Loads model from `filename`, either a serialized ModelProto or a
+  // model image written by SaveImage().
   // Returns false if `filename` cannot be loaded.
   virtual util::Status Load(absl::string_view filename);
 
@@ -45,17 +191,67 @@ class DiscretePieceProcessor {
   // `model_proto` is moved.
   virtual util::Status Load(std::unique_ptr<ModelProto> model_proto);
 
+  // Uses `model`, which may be shared with other processors. The current
+  // model is kept if `model` failed to load.
+  virtual util::Status Load(std::shared_ptr<const CompiledModel> model);
+
+  // Loads `filename` and swaps it in atomically. Calls running on other
+  // threads finish on the old model, later calls use the new one. The old
+  // model is kept if `filename` cannot be loaded. The encoding cache size
+  // set by SetEncodeCacheSize() is applied to the new model.
+  virtual util::Status Reload(absl::string_view filename);
+
+  // Returns the current model, to be shared with other processors.
+  virtual std::shared_ptr<const CompiledModel> compiled_model() const;
+
+  // Saves the loaded model as a model image (.dpm), which Load() maps and
+  // uses in place instead of parsing the pieces and building the tables.
+  // Encodings and model_fingerprint() are the same as the original model.
+  virtual util::Status SaveImage(absl::string_view filename) const;
+
   // Returns the status. Encode/Decode methods are valid when status is OK.
   virtual util::Status status() const;
 
+  // Returns the fingerprint of the serialized ModelProto, computed at load.
+  // Models with the same fingerprint give the same encodings.
+  virtual uint64 model_fingerprint() const;
+
   //////////////////////////////////////////////////////////////
   // Simple Encode and Decode API.
   //
-  // Given a vector<char32> input, encodes it into a sequence of pieces
-  virtual util::Status Encode(const std::vector<char32> &input, std::vector<std::vector<char32>> *tokenized) const;
+  // Given a char32 sequence, encodes it into a sequence of pieces
+  virtual util::Status Encode(absl::Span<const char32> input, std::vector<std::vector<char32>> *tokenized) const;
 
-  // Given a vector<char32> input, encodes it into a sequence of piece_ids
-  virtual util::Status Encode(const std::vector<char32> &input, std::vector<int> *tokenized) const;
+  // Given a char32 sequence, encodes it into a sequence of piece_ids.
+  // Pieces are never materialized.
+  virtual util::Status Encode(absl::Span<const char32> input, std::vector<int> *tokenized) const;
+
+  // Same as above, and also returns the duration of every token of the
+  // decoded ids, i.e. the length of the run it was collapsed from.
+  // Deliminators have no duration. Durations are all 1 unless the model
+  // was trained with collapse_repeats.
+  virtual util::Status Encode(absl::Span<const char32> input, std::vector<int> *tokenized,
+                              std::vector<int> *durations) const;
+
+  // Same as Encode(input, tokenized), but gives exactly the ids of the same
+  // model trained with a vocabulary of `max_piece_id + 1` pieces, so one
+  // loaded BPE model serves every smaller vocabulary size. Uses the model's
+  // segmentation regardless of encode_mode() and is not parallelized.
+  virtual util::Status Encode(absl::Span<const char32> input, int max_piece_id,
+                              std::vector<int> *tokenized) const;
+
+  // Same as above, and also returns the durations, the same as those of
+  // Encode(input, tokenized, durations).
+  virtual util::Status Encode(absl::Span<const char32> input, int max_piece_id,
+                              std::vector<int> *tokenized,
+                              std::vector<int> *durations) const;
+
+  // Encodes every span of `inputs` into (*tokenized)[i], and the durations
+  // into (*durations)[i] if not null. Same as Encode() on each input, but
+  // many short inputs are encoded faster in one call. Not parallelized.
+  virtual util::Status EncodeBatch(const std::vector<absl::Span<const char32>> &inputs,
+                                   std::vector<std::vector<int>> *tokenized,
+                                   std::vector<std::vector<int>> *durations = nullptr) const;
 
   // Given a sequence of pieces, decodes it into a detokenized output.
   virtual util::Status Decode(const std::vector<std::vector<char32>> &pieces, std::vector<char32> *detokenized) const;
@@ -63,12 +259,92 @@ class DiscretePieceProcessor {
   // Given a sequence of ids, decodes it into a detokenized output.
   virtual util::Status Decode(const std::vector<int> &ids, std::vector<char32> *detokenized) const;
 
+  // Given a sequence of ids and the durations returned by Encode(), decodes
+  // it into a detokenized output with every token repeated by its duration.
+  virtual util::Status Decode(const std::vector<int> &ids, const std::vector<int> &durations,
+                              std::vector<char32> *detokenized) const;
+
+  // Given a sequence of ids returned by Encode() with `max_piece_id`,
+  // decodes it into a detokenized output.
+  virtual util::Status Decode(const std::vector<int> &ids, int max_piece_id,
+                              std::vector<char32> *detokenized) const;
+
+  // Decodes every sequence of `ids` into (*detokenized)[i].
+  virtual util::Status DecodeBatch(const std::vector<std::vector<int>> &ids,
+                                   std::vector<std::vector<char32>> *detokenized) const;
+
+  // Returns the piece of `id`, or an empty piece if no model is loaded.
+  virtual TokenSeq IdToPiece(int id) const;
+
+  // Returns the text form of the piece of `id`, its tokens joined by "_",
+  // e.g. "12_7". Tuples are written as "a:b", e.g. "3:17_3:18". Empty if
+  // no model is loaded or `id` is out of range. To format many pieces
+  // without copies, use CompiledModel::IdToPieceString() on the snapshot
+  // returned by compiled_model().
+  virtual std::string IdToPieceString(int id) const;
+
+  // Returns a new incremental encoder on the current model.
+  virtual std::unique_ptr<StreamingEncoder> NewStreamingEncoder() const;
+
+  //////////////////////////////////////////////////////////////
+  // Segmentation algorithm.
+  //
+  // EncodeMode::kLongestMatch trades the model's segmentation for a cheaper
+  // greedy longest match. Default is EncodeMode::kModel.
+  virtual void SetEncodeMode(EncodeMode mode);
+
+  virtual EncodeMode encode_mode() const { return encode_mode_; }
+
+  //////////////////////////////////////////////////////////////
+  // Parallel encoding.
+  //
+  // Default minimum number of tokens per window.
+  static constexpr size_t kDefaultParallelWindowSize = 1 << 14;
+
+  // Encodes sequences of at least 2 * `window_size` tokens in windows
+  // with `num_threads` threads. The output is the same as serial encoding.
+  virtual void SetEncodeThreads(int num_threads,
+                                size_t window_size = kDefaultParallelWindowSize);
+
+  //////////////////////////////////////////////////////////////
+  // Encoding cache.
+  //
+  // Returns hit/miss statistics of the chunk encoding cache.
+  virtual model::LRUCacheStats GetEncodeCacheStats() const;
+
+  // Sets the number of chunks kept in the encoding cache. 0 disables it.
+  // The cache belongs to the model, so processors sharing it share the
+  // setting, and the last call wins. It is safe to call while other
+  // threads encode. The size is also applied to models loaded later.
+  virtual void SetEncodeCacheSize(size_t size);
+
+  // Returns the number of codebooks of an input position. With more than
+  // one, Encode() takes flattened tuples of num_codebooks() tokens, and
+  // pieces and Decode() outputs are flattened tuples as well. 1 if no model
+  // is loaded.
+  virtual int num_codebooks() const;
+
+  // Returns the mapping from deliminator characters in the text input
+  // to the char32 value expected by Encode(). Empty if no model is loaded.
+  virtual absl::flat_hash_map<char, char32> deliminator_map() const;
+
  private:
+  // Takes a reference to the current model and returns its status.
+  util::Status GetModel(std::shared_ptr<const CompiledModel> *model) const;
 
-  std::unique_ptr<ModelInterface> model_;
+  // The current model. Read and written with std::atomic_load()
+  // and std::atomic_store() only, as Reload() may run concurrently with
+  // any call.
+  std::shared_ptr<const CompiledModel> model_;
 
-  // Underlying model protocol buffer. The same lifetime as model_.
-  std::unique_ptr<ModelProto> model_proto_;
+  // Encoding cache size set by SetEncodeCacheSize(), or -1 if not set.
+  std::atomic<int64> encode_cache_size_{-1};
+
+  EncodeMode encode_mode_ = EncodeMode::kModel;
+
+  // Parallel encoding of long sequences. Disabled when num_encode_threads_ <= 1.
+  int num_encode_threads_ = 1;
+  size_t parallel_window_size_ = kDefaultParallelWindowSize;
 };
 
 
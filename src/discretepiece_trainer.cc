@@ -51,6 +51,7 @@ util::Status DiscretePieceTrainer::Train(const TrainerSpec &trainer_spec, Senten
 util::Status DiscretePieceTrainer::PopulateModelTypeFromString(absl::string_view type, TrainerSpec *spec) {
   static const std::unordered_map<std::string, TrainerSpec::ModelType> kModelTypeMap = {
     {"bpe", TrainerSpec::BPE},
+    {"unigram", TrainerSpec::UNIGRAM},
     // for future extension
   };
   const auto it = kModelTypeMap.find(absl::AsciiStrToLower(type));
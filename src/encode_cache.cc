@@ -0,0 +1,274 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include "encode_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include "third_party/absl/strings/str_cat.h"
+
+namespace discretepiece {
+namespace {
+
+constexpr char kMagic[4] = {'D', 'P', 'E', 'C'};
+constexpr uint32 kVersion = 2;
+constexpr size_t kHeaderSize = sizeof(kMagic) + sizeof(uint32) + sizeof(uint64);
+constexpr size_t kRecordHeaderSize = 4 * sizeof(uint32) + sizeof(uint64);
+
+template <typename T>
+T ReadValue(const char *p) {
+  T value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+template <typename T>
+void AppendValue(T value, std::string *out) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+util::Status ErrnoError(absl::string_view filename) {
+  return util::StatusBuilder(util::StatusCode::kInternal, GTL_LOC)
+         << "\"" << filename << "\": " << util::StrError(errno);
+}
+
+// CRC-32 (IEEE 802.3) of `data`.
+uint32 Crc32(absl::string_view data) {
+  static const uint32 *const kTable = [] {
+    uint32 *table = new uint32[256];
+    for (uint32 i = 0; i < 256; ++i) {
+      uint32 c = i;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    return table;
+  }();
+  uint32 crc = 0xFFFFFFFF;
+  for (const char c : data) {
+    crc = kTable[(crc ^ static_cast<uint8>(c)) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFF;
+}
+
+#ifdef _WIN32
+int OpenLog(const std::string &name) {
+  return _open(name.c_str(),
+               _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY | _O_NOINHERIT,
+               _S_IREAD | _S_IWRITE);
+}
+int CloseLog(int fd) { return _close(fd); }
+int TruncateLog(int fd, uint64 size) { return _chsize_s(fd, size) == 0 ? 0 : -1; }
+int64 Write(int fd, absl::string_view data) {
+  return _write(fd, data.data(), static_cast<unsigned int>(data.size()));
+}
+bool LockLog(int fd) {
+  OVERLAPPED overlapped = {};
+  return LockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(fd)),
+                    LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD,
+                    &overlapped) != 0;
+}
+void UnlockLog(int fd) {
+  OVERLAPPED overlapped = {};
+  UnlockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(fd)), 0, MAXDWORD,
+               MAXDWORD, &overlapped);
+}
+#else
+int OpenLog(const std::string &name) {
+  return open(name.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+}
+int CloseLog(int fd) { return close(fd); }
+int TruncateLog(int fd, uint64 size) { return ftruncate(fd, size); }
+int64 Write(int fd, absl::string_view data) {
+  return write(fd, data.data(), data.size());
+}
+bool LockLog(int fd) { return flock(fd, LOCK_EX) == 0; }
+void UnlockLog(int fd) { flock(fd, LOCK_UN); }
+#endif
+
+// Holds an exclusive lock on a file while in scope.
+class FileLock {
+ public:
+  explicit FileLock(int fd) : fd_(fd), locked_(LockLog(fd)) {}
+  ~FileLock() {
+    if (locked_) UnlockLog(fd_);
+  }
+  bool locked() const { return locked_; }
+
+ private:
+  const int fd_;
+  const bool locked_;
+};
+
+// Writes all of `data` with one write() call, which appends it atomically
+// to a regular file opened with O_APPEND.
+bool WriteAll(int fd, absl::string_view data) {
+  int64 n;
+  do {
+    n = Write(fd, data);
+  } while (n < 0 && errno == EINTR);
+  return n == static_cast<int64>(data.size());
+}
+
+}  // namespace
+
+EncodeCache::~EncodeCache() { Close().IgnoreError(); }
+
+util::Status EncodeCache::Open(absl::string_view dirname, uint64 fingerprint) {
+  RETURN_IF_ERROR(Close());
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.dpcache",
+           static_cast<unsigned long long>(fingerprint));
+  filename_ = absl::StrCat(dirname, "/", name);
+
+  fd_ = OpenLog(filename_);
+  if (fd_ < 0) return ErrnoError(filename_);
+
+  util::Status status;
+  {
+    // Other processes do not append while the log is indexed and its tail
+    // is dropped.
+    FileLock lock(fd_);
+    status = lock.locked() ? IndexLog(fingerprint) : ErrnoError(filename_);
+  }
+  if (!status.ok()) Close().IgnoreError();
+  return status;
+}
+
+util::Status EncodeCache::IndexLog(uint64 fingerprint) {
+  RETURN_IF_ERROR(log_.Open(fd_, filename_));
+  const char *data = log_.data();
+  const size_t size = log_.size();
+
+  size_t valid_size = 0;
+  if (size > 0) {
+    if (size >= kHeaderSize && memcmp(data, kMagic, sizeof(kMagic)) == 0 &&
+        ReadValue<uint32>(data + sizeof(kMagic)) == kVersion &&
+        ReadValue<uint64>(data + sizeof(kMagic) + sizeof(uint32)) ==
+            fingerprint) {
+      valid_size = IndexRecords();
+    } else {
+      LOG(WARNING) << filename_ << " is not a cache of this model, overwriting.";
+    }
+  }
+
+  // Drops a broken tail so that new records follow the last valid one.
+  if (valid_size != size && TruncateLog(fd_, valid_size) != 0) {
+    return ErrnoError(filename_);
+  }
+
+  if (valid_size == 0) {
+    std::string header(kMagic, sizeof(kMagic));
+    AppendValue(kVersion, &header);
+    AppendValue(fingerprint, &header);
+    if (!WriteAll(fd_, header)) return ErrnoError(filename_);
+  }
+  return util::OkStatus();
+}
+
+size_t EncodeCache::IndexRecords() {
+  const char *data = log_.data();
+  const size_t size = log_.size();
+  size_t pos = kHeaderSize;
+  while (pos + kRecordHeaderSize <= size) {
+    const char *p = data + pos;
+    const uint32 crc = ReadValue<uint32>(p);
+    const uint32 key_size = ReadValue<uint32>(p + 4);
+    const uint32 num_ids = ReadValue<uint32>(p + 8);
+    const uint32 num_durations = ReadValue<uint32>(p + 12);
+    const uint64 record_size = kRecordHeaderSize + static_cast<uint64>(key_size) +
+                               (static_cast<uint64>(num_ids) + num_durations) *
+                                   sizeof(int32);
+    if (record_size > size - pos) break;
+    if (Crc32(absl::string_view(p + sizeof(uint32),
+                                record_size - sizeof(uint32))) != crc) {
+      LOG(WARNING) << filename_ << ": broken record at offset " << pos
+                   << ", dropping the rest of the log.";
+      break;
+    }
+
+    const absl::string_view key(p + kRecordHeaderSize, key_size);
+    index_[key] = {ReadValue<uint64>(p + 16), p + kRecordHeaderSize + key_size,
+                   num_ids, num_durations};
+    pos += record_size;
+  }
+  return pos;
+}
+
+bool EncodeCache::Lookup(absl::string_view key, absl::Span<const char32> input,
+                         std::vector<int> *ids,
+                         std::vector<int> *durations) const {
+  const auto it = index_.find(key);
+  if (it == index_.end() || it->second.input_hash != HashInput(input)) {
+    return false;
+  }
+  const Entry &entry = it->second;
+  ids->resize(entry.num_ids);
+  durations->resize(entry.num_durations);
+  memcpy(ids->data(), entry.ids, entry.num_ids * sizeof(int32));
+  memcpy(durations->data(), entry.ids + entry.num_ids * sizeof(int32),
+         entry.num_durations * sizeof(int32));
+  return true;
+}
+
+util::Status EncodeCache::Insert(absl::string_view key,
+                                 absl::Span<const char32> input,
+                                 const std::vector<int> &ids,
+                                 const std::vector<int> &durations) {
+  CHECK_OR_RETURN(fd_ >= 0) << "encode cache is not opened.";
+  std::string record;
+  AppendValue(static_cast<uint32>(0), &record);  // CRC, set below.
+  AppendValue(static_cast<uint32>(key.size()), &record);
+  AppendValue(static_cast<uint32>(ids.size()), &record);
+  AppendValue(static_cast<uint32>(durations.size()), &record);
+  AppendValue(HashInput(input), &record);
+  record.append(key.data(), key.size());
+  for (const int id : ids) AppendValue(static_cast<int32>(id), &record);
+  for (const int d : durations) AppendValue(static_cast<int32>(d), &record);
+  const uint32 crc = Crc32(absl::string_view(record).substr(sizeof(uint32)));
+  memcpy(&record[0], &crc, sizeof(crc));
+
+  FileLock lock(fd_);
+  if (!lock.locked() || !WriteAll(fd_, record)) return ErrnoError(filename_);
+  return util::OkStatus();
+}
+
+util::Status EncodeCache::Close() {
+  util::Status status;
+  if (fd_ >= 0) {
+    if (CloseLog(fd_) != 0) status = ErrnoError(filename_);
+    fd_ = -1;
+  }
+  log_.Close();
+  index_.clear();
+  return status;
+}
+
+uint64 EncodeCache::HashInput(absl::Span<const char32> input) {
+  return port::Fingerprint(absl::string_view(
+      reinterpret_cast<const char *>(input.data()),
+      input.size() * sizeof(char32)));
+}
+
+}  // namespace discretepiece
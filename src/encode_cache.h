@@ -0,0 +1,107 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef ENCODE_CACHE_H_
+#define ENCODE_CACHE_H_
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "filesystem.h"
+#include "third_party/absl/container/flat_hash_map.h"
+#include "third_party/absl/strings/string_view.h"
+#include "third_party/absl/types/span.h"
+#include "util.h"
+
+namespace discretepiece {
+
+// Persistent cache of encoded utterances, keyed by (fingerprint, utterance
+// key, input hash). Every fingerprint has its own append-only log
+// <dirname>/<fingerprint>.dpcache, which is mapped at Open() and indexed
+// by utterance key; the last record of a key wins, so a changed utterance
+// is simply appended again. Records inserted after Open() are written to
+// the log but only found by the next run.
+//
+// Several processes may share a log: Open() and every Insert() hold an
+// exclusive lock on it (flock(), or LockFileEx() on Windows), and each
+// record is appended with a single write() to an O_APPEND descriptor, so
+// records never interleave.
+//
+// Log layout, native byte order:
+//   header: "DPEC", uint32 version, uint64 fingerprint
+//   records: uint32 CRC-32 of the rest of the record, uint32 key size,
+//            uint32 number of ids, uint32 number of durations,
+//            uint64 input hash, key, int32 ids, int32 durations
+// Indexing stops at the first truncated or corrupted record, e.g. after a
+// crash, and Open() drops it and everything after it.
+class EncodeCache {
+ public:
+  EncodeCache() {}
+  virtual ~EncodeCache();
+
+  EncodeCache(const EncodeCache &) = delete;
+  EncodeCache &operator=(const EncodeCache &) = delete;
+
+  // Opens or creates the log of `fingerprint` in the existing directory
+  // `dirname`.
+  util::Status Open(absl::string_view dirname, uint64 fingerprint);
+
+  // Returns true and replaces `ids` and `durations` with the cached result
+  // if `key` was stored with the same `input`.
+  bool Lookup(absl::string_view key, absl::Span<const char32> input,
+              std::vector<int> *ids, std::vector<int> *durations) const;
+
+  // Appends the result of `key` to the log.
+  util::Status Insert(absl::string_view key, absl::Span<const char32> input,
+                      const std::vector<int> &ids,
+                      const std::vector<int> &durations);
+
+  // Closes the log.
+  util::Status Close();
+
+  // Number of keys found in the log at Open().
+  size_t size() const { return index_.size(); }
+
+ private:
+  struct Entry {
+    uint64 input_hash;
+    const char *ids;  // ids followed by durations, in the mapped log.
+    uint32 num_ids;
+    uint32 num_durations;
+  };
+
+  // Maps and indexes the log opened at Open(), drops its broken tail and
+  // writes the header of a new log. The log must be locked.
+  util::Status IndexLog(uint64 fingerprint);
+
+  // Indexes the records of the mapped log and returns the size of the
+  // valid prefix.
+  size_t IndexRecords();
+
+  static uint64 HashInput(absl::Span<const char32> input);
+
+  // Log at Open(), mapped or read on Windows. Keys of `index_` point into
+  // it.
+  filesystem::MappedFile log_;
+
+  absl::flat_hash_map<absl::string_view, Entry> index_;
+
+  // Log opened with O_APPEND, or -1.
+  int fd_ = -1;
+  std::string filename_;
+};
+
+}  // namespace discretepiece
+#endif  // ENCODE_CACHE_H_
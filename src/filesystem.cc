@@ -12,6 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.!
 
+#include <errno.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
 #include <iostream>
 
 #include "filesystem.h"
@@ -27,20 +42,22 @@
 namespace discretepiece {
 namespace filesystem {
 
-class PosixReadableFile : public ReadableFile {
+#ifdef _WIN32
+
+class StdReadableFile : public ReadableFile {
  public:
-  PosixReadableFile(absl::string_view filename, bool is_binary = false)
+  StdReadableFile(absl::string_view filename, bool is_binary = false)
       : is_(filename.empty()
                 ? &std::cin
-                : new std::ifstream(WPATH(filename.data()),
+                : new std::ifstream(WPATH(std::string(filename).c_str()),
                                     is_binary ? std::ios::binary | std::ios::in
                                               : std::ios::in)) {
     if (!*is_)
       status_ = util::StatusBuilder(util::StatusCode::kNotFound, GTL_LOC)
-                << "\"" << filename.data() << "\": " << util::StrError(errno);
+                << "\"" << filename << "\": " << util::StrError(errno);
   }
 
-  ~PosixReadableFile() {
+  ~StdReadableFile() {
     if (is_ != &std::cin) delete is_;
   }
 
@@ -50,6 +67,12 @@ class PosixReadableFile : public ReadableFile {
     return static_cast<bool>(std::getline(*is_, *line));
   }
 
+  bool ReadLine(absl::string_view *line) {
+    if (!ReadLine(&line_)) return false;
+    *line = line_;
+    return true;
+  }
+
   bool ReadAll(std::string *line) {
     if (is_ == &std::cin) {
       LOG(ERROR) << "ReadAll is not supported for stdin.";
@@ -63,43 +86,279 @@ class PosixReadableFile : public ReadableFile {
  private:
   util::Status status_;
   std::istream *is_;
+  std::string line_;
 };
 
-class PosixWritableFile : public WritableFile {
+class StdWritableFile : public WritableFile {
  public:
-  PosixWritableFile(absl::string_view filename, bool is_binary = false)
+  StdWritableFile(absl::string_view filename, bool is_binary = false)
       : os_(filename.empty()
                 ? &std::cout
-                : new std::ofstream(WPATH(filename.data()),
+                : new std::ofstream(WPATH(std::string(filename).c_str()),
                                     is_binary ? std::ios::binary | std::ios::out
                                               : std::ios::out)) {
     if (!*os_)
       status_ =
           util::StatusBuilder(util::StatusCode::kPermissionDenied, GTL_LOC)
-          << "\"" << filename.data() << "\": " << util::StrError(errno);
+          << "\"" << filename << "\": " << util::StrError(errno);
   }
 
-  ~PosixWritableFile() {
-    if (os_ != &std::cout) delete os_;
-  }
+  ~StdWritableFile() { Close().IgnoreError(); }
 
   util::Status status() const { return status_; }
 
   bool Write(absl::string_view text) {
+    if (os_ == nullptr) return false;
     os_->write(text.data(), text.size());
     return os_->good();
   }
 
   bool WriteLine(absl::string_view text) { return Write(text) && Write("\n"); }
 
+  bool Flush() {
+    if (os_ == nullptr) return false;
+    os_->flush();
+    return os_->good();
+  }
+
+  util::Status Close() {
+    if (os_ == nullptr) return status_;
+    os_->flush();
+    if (os_ != &std::cout) static_cast<std::ofstream *>(os_)->close();
+    if (!*os_ && status_.ok()) {
+      status_ = util::StatusBuilder(util::StatusCode::kInternal, GTL_LOC)
+                << util::StrError(errno);
+    }
+    if (os_ != &std::cout) delete os_;
+    os_ = nullptr;
+    return status_;
+  }
+
  private:
   util::Status status_;
   std::ostream *os_;
 };
 
+using DefaultReadableFile = StdReadableFile;
+using DefaultWritableFile = StdWritableFile;
+
+#else  // _WIN32
+
+// Reads a memory-mapped regular file in place, or any other file through
+// a buffer which grows to hold the longest line.
+class PosixReadableFile : public ReadableFile {
+ public:
+  PosixReadableFile(absl::string_view filename, bool /*is_binary*/ = false)
+      : fd_(filename.empty()
+                ? STDIN_FILENO
+                : open(std::string(filename).c_str(), O_RDONLY | O_CLOEXEC)) {
+    if (fd_ < 0) {
+      status_ = util::StatusBuilder(util::StatusCode::kNotFound, GTL_LOC)
+                << "\"" << filename << "\": " << util::StrError(errno);
+      eof_ = true;
+      return;
+    }
+    struct stat st;
+    if (fd_ != STDIN_FILENO && fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) &&
+        st.st_size > 0) {
+      void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (data != MAP_FAILED) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        mapped_ = static_cast<const char *>(data);
+        data_ = mapped_;
+        end_ = st.st_size;
+        eof_ = true;
+      }
+    }
+  }
+
+  ~PosixReadableFile() {
+    if (mapped_ != nullptr) munmap(const_cast<char *>(mapped_), end_);
+    if (fd_ > STDIN_FILENO) close(fd_);
+  }
+
+  util::Status status() const { return status_; }
+
+  bool ReadLine(std::string *line) {
+    absl::string_view view;
+    if (!ReadLine(&view)) return false;
+    line->assign(view.data(), view.size());
+    return true;
+  }
+
+  bool ReadLine(absl::string_view *line) {
+    size_t scanned = pos_;
+    for (;;) {
+      const void *newline = memchr(data_ + scanned, '\n', end_ - scanned);
+      if (newline != nullptr) {
+        const size_t pos = static_cast<const char *>(newline) - data_;
+        *line = absl::string_view(data_ + pos_, pos - pos_);
+        pos_ = pos + 1;
+        return true;
+      }
+      if (eof_) break;
+      // Fill() moves the partial line to the front of the buffer.
+      scanned = end_ - pos_;
+      Fill();
+    }
+    // The last line has no newline.
+    if (pos_ == end_) return false;
+    *line = absl::string_view(data_ + pos_, end_ - pos_);
+    pos_ = end_;
+    return true;
+  }
+
+  bool ReadAll(std::string *line) {
+    if (!status_.ok()) return false;
+    while (!eof_) Fill();
+    line->assign(data_ + pos_, end_ - pos_);
+    pos_ = end_;
+    return status_.ok();
+  }
+
+ private:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  // Reads more input after the unread part of buffer_.
+  void Fill() {
+    if (pos_ > 0) {
+      memmove(&buffer_[0], &buffer_[pos_], end_ - pos_);
+      end_ -= pos_;
+      pos_ = 0;
+    }
+    if (buffer_.size() - end_ < kBufferSize / 2) {
+      buffer_.resize(std::max(kBufferSize, 2 * buffer_.size()));
+    }
+    data_ = buffer_.data();
+    ssize_t n = 0;
+    do {
+      n = read(fd_, &buffer_[end_], buffer_.size() - end_);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+      status_ = util::StatusBuilder(util::StatusCode::kInternal, GTL_LOC)
+                << util::StrError(errno);
+    }
+    if (n <= 0) {
+      eof_ = true;
+    } else {
+      end_ += n;
+    }
+  }
+
+  util::Status status_;
+  int fd_ = -1;
+
+  // The mapped file, or nullptr if read through buffer_.
+  const char *mapped_ = nullptr;
+  std::string buffer_;
+
+  // Input is data_[pos_, end_), where data_ is mapped_ or buffer_.
+  const char *data_ = "";
+  size_t pos_ = 0;
+  size_t end_ = 0;
+
+  // True once the whole input is in data_.
+  bool eof_ = false;
+};
+
+// Collects output in a buffer and writes it together with the text which
+// does not fit in one writev().
+class PosixWritableFile : public WritableFile {
+ public:
+  PosixWritableFile(absl::string_view filename, bool /*is_binary*/ = false)
+      : fd_(filename.empty()
+                ? STDOUT_FILENO
+                : open(std::string(filename).c_str(),
+                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) {
+    if (fd_ < 0) {
+      status_ =
+          util::StatusBuilder(util::StatusCode::kPermissionDenied, GTL_LOC)
+          << "\"" << filename << "\": " << util::StrError(errno);
+      return;
+    }
+    buffer_.reserve(kBufferSize);
+  }
+
+  ~PosixWritableFile() { Close().IgnoreError(); }
+
+  util::Status status() const { return status_; }
+
+  bool Write(absl::string_view text) { return Append(text, absl::string_view()); }
+
+  bool WriteLine(absl::string_view text) { return Append(text, "\n"); }
+
+  bool Flush() {
+    if (!status_.ok() || fd_ < 0) return false;
+    struct iovec iov = {&buffer_[0], buffer_.size()};
+    const bool ok = WriteVector(&iov, 1);
+    buffer_.clear();
+    return ok;
+  }
+
+  util::Status Close() {
+    if (fd_ < 0) return status_;
+    Flush();
+    if (fd_ != STDOUT_FILENO && close(fd_) != 0 && status_.ok()) {
+      status_ = util::StatusBuilder(util::StatusCode::kInternal, GTL_LOC)
+                << util::StrError(errno);
+    }
+    fd_ = -1;
+    return status_;
+  }
+
+ private:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  bool Append(absl::string_view text, absl::string_view suffix) {
+    if (!status_.ok() || fd_ < 0) return false;
+    if (buffer_.size() + text.size() + suffix.size() <= kBufferSize) {
+      buffer_.append(text.data(), text.size());
+      buffer_.append(suffix.data(), suffix.size());
+      return true;
+    }
+    struct iovec iov[3] = {
+        {&buffer_[0], buffer_.size()},
+        {const_cast<char *>(text.data()), text.size()},
+        {const_cast<char *>(suffix.data()), suffix.size()}};
+    const bool ok = WriteVector(iov, 3);
+    buffer_.clear();
+    return ok;
+  }
+
+  // Writes all of `iov`, resuming after partial writes.
+  bool WriteVector(struct iovec *iov, int n) {
+    for (;;) {
+      while (n > 0 && iov->iov_len == 0) {
+        ++iov;
+        --n;
+      }
+      if (n == 0) return true;
+      const ssize_t written = writev(fd_, iov, n);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        status_ = util::StatusBuilder(util::StatusCode::kInternal, GTL_LOC)
+                  << util::StrError(errno);
+        return false;
+      }
+      size_t left = written;
+      for (; n > 0 && left >= iov->iov_len; ++iov, --n) left -= iov->iov_len;
+      if (n > 0) {
+        iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+        iov->iov_len -= left;
+      }
+    }
+  }
+
+  util::Status status_;
+  int fd_ = -1;
+  std::string buffer_;
+};
+
 using DefaultReadableFile = PosixReadableFile;
 using DefaultWritableFile = PosixWritableFile;
 
+#endif  // _WIN32
+
 std::unique_ptr<ReadableFile> NewReadableFile(absl::string_view filename,
                                               bool is_binary) {
   return absl::make_unique<DefaultReadableFile>(filename, is_binary);
@@ -110,5 +369,125 @@ std::unique_ptr<WritableFile> NewWritableFile(absl::string_view filename,
   return absl::make_unique<DefaultWritableFile>(filename, is_binary);
 }
 
+namespace {
+util::Status MapError(absl::string_view filename) {
+  return util::StatusBuilder(util::StatusCode::kInternal, GTL_LOC)
+         << "\"" << filename << "\": " << util::StrError(errno);
+}
+}  // namespace
+
+bool StartsWithMagic(absl::string_view filename, absl::string_view magic) {
+  std::string head(magic.size(), '\0');
+#ifdef _WIN32
+  std::ifstream is(WPATH(std::string(filename).c_str()),
+                   std::ios::binary | std::ios::in);
+  if (!is || !is.read(&head[0], head.size())) return false;
+#else
+  const std::string name(filename);
+  struct stat st;
+  if (stat(name.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+  const int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  const bool ok = read(fd, &head[0], head.size()) ==
+                  static_cast<ssize_t>(head.size());
+  close(fd);
+  if (!ok) return false;
+#endif
+  return head == magic;
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+void MappedFile::Close() {
+#ifndef _WIN32
+  if (mapped_) munmap(const_cast<char *>(data_), size_);
+#endif
+  mapped_ = false;
+  owned_.clear();
+  owned_.shrink_to_fit();
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#ifdef _WIN32
+
+util::Status MappedFile::Open(absl::string_view filename, bool /*sequential*/) {
+  Close();
+  std::ifstream is(WPATH(std::string(filename).c_str()),
+                   std::ios::binary | std::ios::in);
+  if (!is) {
+    return util::StatusBuilder(util::StatusCode::kNotFound, GTL_LOC)
+           << "\"" << filename << "\": " << util::StrError(errno);
+  }
+  is.seekg(0, std::ios::end);
+  const std::streamoff size = is.tellg();
+  is.seekg(0, std::ios::beg);
+  if (size < 0) return MapError(filename);
+  owned_.resize((size + sizeof(uint64) - 1) / sizeof(uint64));
+  if (!is.read(reinterpret_cast<char *>(owned_.data()), size)) {
+    Close();
+    return MapError(filename);
+  }
+  data_ = reinterpret_cast<const char *>(owned_.data());
+  size_ = size;
+  return util::OkStatus();
+}
+
+util::Status MappedFile::Open(int fd, absl::string_view filename,
+                              bool /*sequential*/) {
+  Close();
+  struct _stat64 st;
+  if (_fstat64(fd, &st) != 0 || _lseeki64(fd, 0, SEEK_SET) < 0) {
+    return MapError(filename);
+  }
+  owned_.resize((st.st_size + sizeof(uint64) - 1) / sizeof(uint64));
+  char *data = reinterpret_cast<char *>(owned_.data());
+  for (size_t done = 0; done < static_cast<size_t>(st.st_size);) {
+    const int n = _read(fd, data + done,
+                        static_cast<unsigned int>(std::min<size_t>(
+                            st.st_size - done, 1 << 30)));
+    if (n <= 0) {
+      Close();
+      return MapError(filename);
+    }
+    done += n;
+  }
+  data_ = data;
+  size_ = st.st_size;
+  return util::OkStatus();
+}
+
+#else  // _WIN32
+
+util::Status MappedFile::Open(absl::string_view filename, bool sequential) {
+  Close();
+  const int fd = open(std::string(filename).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return util::StatusBuilder(util::StatusCode::kNotFound, GTL_LOC)
+           << "\"" << filename << "\": " << util::StrError(errno);
+  }
+  const util::Status status = Open(fd, filename, sequential);
+  close(fd);
+  return status;
+}
+
+util::Status MappedFile::Open(int fd, absl::string_view filename,
+                              bool sequential) {
+  Close();
+  struct stat st;
+  if (fstat(fd, &st) != 0) return MapError(filename);
+  // mmap() fails on empty files.
+  if (st.st_size == 0) return util::OkStatus();
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) return MapError(filename);
+  if (sequential) madvise(data, st.st_size, MADV_SEQUENTIAL);
+  data_ = static_cast<const char *>(data);
+  size_ = st.st_size;
+  mapped_ = true;
+  return util::OkStatus();
+}
+
+#endif  // _WIN32
+
 }  // namespace filesystem
 }  // namespace discretepiece
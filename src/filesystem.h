@@ -20,6 +20,7 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "common.h"
 #include "util.h"
@@ -35,6 +36,11 @@ class ReadableFile {
 
   virtual util::Status status() const = 0;
   virtual bool ReadLine(std::string *line) = 0;
+
+  // Reads the next line without copying it. `line` is valid until the next
+  // read from this file.
+  virtual bool ReadLine(absl::string_view *line) = 0;
+
   virtual bool ReadAll(std::string *line) = 0;
 };
 
@@ -45,15 +51,67 @@ class WritableFile {
   virtual ~WritableFile() {}
 
   virtual util::Status status() const = 0;
+
+  // Write() and WriteLine() may only buffer `text`, so true means that no
+  // error has occurred yet, not that `text` is written.
   virtual bool Write(absl::string_view text) = 0;
   virtual bool WriteLine(absl::string_view text) = 0;
+  virtual bool Flush() = 0;
+
+  // Flushes and closes the file. Returns the first error of any write, so
+  // the output is complete only if Close() returns OK. Later writes fail.
+  virtual util::Status Close() = 0;
 };
 
+// Regular files are memory-mapped and read in place. stdin (empty
+// `filename`), pipes and other files are read through a buffer. On Windows
+// files are read with std::ifstream.
 std::unique_ptr<ReadableFile> NewReadableFile(absl::string_view filename,
                                               bool is_binary = false);
+
+// Output is collected in a large buffer and written with writev(), so a
+// line is not written until the buffer fills or Flush() is called. Writes
+// to stdout (empty `filename`) are buffered the same way. On Windows files
+// are written with std::ofstream.
 std::unique_ptr<WritableFile> NewWritableFile(absl::string_view filename,
                                               bool is_binary = false);
 
+// Returns true if `filename` is a regular file starting with `magic`. Pipes
+// and devices are never read, so probing does not consume their input.
+bool StartsWithMagic(absl::string_view filename, absl::string_view magic);
+
+// A whole file, memory-mapped read-only, or read into memory on Windows.
+// The data is aligned for any integer type.
+class MappedFile {
+ public:
+  MappedFile() {}
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Maps `filename`. `sequential` advises the kernel that the data is read
+  // in order, so that it reads ahead.
+  util::Status Open(absl::string_view filename, bool sequential = false);
+
+  // Maps the file opened as `fd`, which may be closed afterwards.
+  // `filename` is used in errors.
+  util::Status Open(int fd, absl::string_view filename, bool sequential = false);
+
+  void Close();
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool mapped_ = false;
+
+  // The contents if they are read instead of mapped.
+  std::vector<uint64> owned_;
+};
+
 }  // namespace filesystem
 }  // namespace discretepiece
 #endif  // FILESYSTEM_H_
@@ -0,0 +1,117 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef FLAT_ARRAY_H_
+#define FLAT_ARRAY_H_
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "third_party/absl/strings/string_view.h"
+#include "third_party/absl/types/span.h"
+
+namespace discretepiece {
+
+// Read-only array which either owns its elements or views memory owned by
+// someone else, e.g. a memory-mapped model file. Tables of the model are
+// built into owned arrays, or point into the mapped file without a copy.
+template <typename T>
+class FlatArray {
+ public:
+  FlatArray() {}
+
+  FlatArray(const FlatArray &other) { *this = other; }
+
+  FlatArray(FlatArray &&other) noexcept { *this = std::move(other); }
+
+  FlatArray &operator=(const FlatArray &other) {
+    if (this == &other) return *this;
+    if (other.is_owned()) {
+      assign(other.owned_);
+    } else {
+      set_view(other.view_);
+    }
+    return *this;
+  }
+
+  FlatArray &operator=(FlatArray &&other) noexcept {
+    if (this == &other) return *this;
+    const bool owned = other.is_owned();
+    owned_ = std::move(other.owned_);
+    view_ = owned ? absl::MakeConstSpan(owned_) : other.view_;
+    other.owned_.clear();
+    other.view_ = absl::Span<const T>();
+    return *this;
+  }
+
+  // Takes the ownership of `values`.
+  void assign(std::vector<T> values) {
+    owned_ = std::move(values);
+    view_ = absl::MakeConstSpan(owned_);
+  }
+
+  // Views `values`, which must outlive the array.
+  void set_view(absl::Span<const T> values) {
+    owned_.clear();
+    view_ = values;
+  }
+
+  // Views the elements serialized in `data`, or copies them if `data` is
+  // not aligned for T. Returns false if the size is not a multiple of T.
+  // Elements are in the byte order of the host; files storing them check
+  // that it is little-endian (see ModelImage).
+  bool InitFromBytes(absl::string_view data) {
+    if (data.size() % sizeof(T) != 0) return false;
+    const size_t n = data.size() / sizeof(T);
+    if (reinterpret_cast<uintptr_t>(data.data()) % alignof(T) == 0) {
+      set_view(absl::MakeConstSpan(reinterpret_cast<const T *>(data.data()), n));
+    } else {
+      std::vector<T> values(n);
+      std::memcpy(values.data(), data.data(), data.size());
+      assign(std::move(values));
+    }
+    return true;
+  }
+
+  // Returns the elements as bytes, the inverse of InitFromBytes().
+  absl::string_view bytes() const {
+    return absl::string_view(reinterpret_cast<const char *>(view_.data()),
+                             view_.size() * sizeof(T));
+  }
+
+  void clear() {
+    owned_.clear();
+    view_ = absl::Span<const T>();
+  }
+
+  const T *data() const { return view_.data(); }
+  size_t size() const { return view_.size(); }
+  bool empty() const { return view_.empty(); }
+  const T &operator[](size_t i) const { return view_[i]; }
+  const T *begin() const { return view_.data(); }
+  const T *end() const { return view_.data() + view_.size(); }
+  absl::Span<const T> span() const { return view_; }
+
+ private:
+  bool is_owned() const { return !owned_.empty() && view_.data() == owned_.data(); }
+
+  std::vector<T> owned_;
+  absl::Span<const T> view_;
+};
+
+}  // namespace discretepiece
+#endif  // FLAT_ARRAY_H_
@@ -3,6 +3,7 @@
 #include "io_utils.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/str_join.h"
+#include "absl/strings/match.h"
 
 
 bool io_utils::is_valid_kaldi_rspec(const std::string &rspec) {
@@ -20,26 +21,115 @@ bool io_utils::is_valid_kaldi_wspec(const std::string &wspec) {
   return is_kaldiio;
 }
 
-io_utils::GeneralIndexReader::GeneralIndexReader(const std::string &filename): done_(false) {
+bool io_utils::ParseKaldiValueType(const std::string &name, KaldiValueType *type) {
+  if (name == "float_matrix") {
+    *type = KaldiValueType::FLOAT_MATRIX;
+  } else if (name == "int32_vector") {
+    *type = KaldiValueType::INT32_VECTOR;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+// Peeks at the value `is` is positioned at. In binary, int32 vectors start
+// with the size of their length (4) and matrices with a token such as "FM";
+// in text, matrices start with '['.
+io_utils::KaldiValueType PeekKaldiValue(std::istream &is) {
+  bool binary = false;
+  if (!kaldiio::InitKaldiInputStream(is, &binary))
+    return io_utils::KaldiValueType::FLOAT_MATRIX;
+  if (!binary) {
+    while (is.peek() == ' ') is.get();
+  }
+  const int c = is.peek();
+  if (binary ? c == sizeof(int32_t) : c != '[')
+    return io_utils::KaldiValueType::INT32_VECTOR;
+  return io_utils::KaldiValueType::FLOAT_MATRIX;
+}
+
+// Only plain files are opened twice.
+bool CanPeek(const std::string &rxfilename) {
+  const auto type = kaldiio::ClassifyRxfilename(rxfilename);
+  return type == kaldiio::kFileInput || type == kaldiio::kOffsetFileInput;
+}
+
+}  // namespace
+
+io_utils::KaldiValueType io_utils::DetectKaldiValueType(const std::string &rspec) {
+  std::string rxfilename;
+  const auto type = kaldiio::ClassifyRspecifier(rspec, &rxfilename, NULL);
+  if (!CanPeek(rxfilename)) return KaldiValueType::FLOAT_MATRIX;
+  kaldiio::Input input;
+  if (!input.Open(rxfilename)) return KaldiValueType::FLOAT_MATRIX;
+  std::istream &is = input.Stream();
+  if (type == kaldiio::RspecifierType::kArchiveRspecifier) {
+    // "key " precedes the value.
+    std::string key;
+    is >> key;
+    if (!is || is.get() != ' ') return KaldiValueType::FLOAT_MATRIX;
+    return PeekKaldiValue(is);
+  }
+  // The first line of a script is "key rxfilename" of the first value.
+  std::string line;
+  if (!std::getline(is, line)) return KaldiValueType::FLOAT_MATRIX;
+  const auto begin = line.find_first_not_of(" \t", line.find_first_of(" \t"));
+  const auto end = line.find_last_not_of(" \t\r");
+  if (begin == std::string::npos) return KaldiValueType::FLOAT_MATRIX;
+  const std::string value_rxfilename = line.substr(begin, end + 1 - begin);
+  if (!CanPeek(value_rxfilename)) return KaldiValueType::FLOAT_MATRIX;
+  kaldiio::Input value_input;
+  if (!value_input.Open(value_rxfilename)) return KaldiValueType::FLOAT_MATRIX;
+  return PeekKaldiValue(value_input.Stream());
+}
+
+bool io_utils::is_token_corpus_output(const std::string &filename) {
+  return absl::EndsWith(filename, ".dptok");
+}
+
+io_utils::GeneralIndexReader::GeneralIndexReader(const std::string &filename,
+                                                 const absl::flat_hash_map<char, char32> &special_mapping,
+                                                 int num_codebooks)
+    : special_mapping_(special_mapping), parser_(special_mapping_),
+      num_codebooks_(num_codebooks), done_(false) {
     if (is_valid_kaldi_rspec(filename)) {
         input_type_ = IO_TYPES::KALDI_INPUT;
-        kaldi_reader_ = std::make_unique<io_utils::SequentialFloatMatrixReader>(filename);
-        CHECK(kaldi_reader_->IsOpen()) << "error open rspec: " << filename;
+        kaldi_value_type_ = DetectKaldiValueType(filename);
+        if (kaldi_value_type_ == KaldiValueType::INT32_VECTOR) {
+            kaldi_int32_reader_ = std::make_unique<io_utils::SequentialInt32VectorReader>(filename);
+            CHECK(kaldi_int32_reader_->IsOpen()) << "error open rspec: " << filename;
+        } else {
+            kaldi_reader_ = std::make_unique<io_utils::SequentialFloatMatrixReader>(filename);
+            CHECK(kaldi_reader_->IsOpen()) << "error open rspec: " << filename;
+        }
+    } else if (discretepiece::TokenCorpus::IsTokenCorpusFile(filename)) {
+        input_type_ = IO_TYPES::TOKEN_CORPUS;
+        corpus_ = std::make_unique<discretepiece::TokenCorpus>();
+        CHECK_OK(corpus_->Open(filename));
     } else {
         input_type_ = IO_TYPES::TEXT_FILE;
         auto input = discretepiece::filesystem::NewReadableFile(filename);
         CHECK_OK(input->status());
         file_reader_.swap(input);
     }
-    // init reading
-    Next();
+    // init reading, the kaldi reader is already at its first entry
+    if (input_type_ == IO_TYPES::KALDI_INPUT) {
+        ReadKaldiValue();
+    } else if (input_type_ == IO_TYPES::TOKEN_CORPUS) {
+        ReadCorpusValue();
+    } else {
+        Next();
+    }
 }
 
 io_utils::GeneralIndexReader::~GeneralIndexReader() {
     if (input_type_ == IO_TYPES::TEXT_FILE) {
         // pass
     } else if (input_type_ == IO_TYPES::KALDI_INPUT) {
-        kaldi_reader_->Close();
+        if (kaldi_int32_reader_ != nullptr) kaldi_int32_reader_->Close();
+        if (kaldi_reader_ != nullptr) kaldi_reader_->Close();
     } else {
         // pass
     }
@@ -51,49 +141,103 @@ bool io_utils::GeneralIndexReader::Done() {
 
 void io_utils::GeneralIndexReader::Next() {
     if (input_type_ == IO_TYPES::TEXT_FILE) {
-        std::string line;
+        absl::string_view line;
         done_ = !file_reader_->ReadLine(&line);
         if (!done_) {
-            std::vector<std::string> str_parts = absl::StrSplit(line, ' ', false);
-            key_ = str_parts[0];
-            value_.resize(str_parts.size()-1);
-            std::transform(
-                str_parts.begin()+1, str_parts.end(),
-                value_.begin(),
-                [] (const std::string &s) { return static_cast<char32>(std::stoi(s)); }
-            );
+            const auto pos = line.find(' ');
+            key_ = std::string(line.substr(0, pos));
+            if (pos == std::string::npos) {
+                value_.clear();
+            } else if (num_codebooks_ > 1) {
+                value_.clear();
+                CHECK(discretepiece::string_util::StringToTuples(
+                    line.substr(pos + 1), special_mapping_,
+                    num_codebooks_, &value_))
+                    << "tuples of " << key_ << " should have " << num_codebooks_
+                << " integer tokens";
+            } else {
+                value_.clear();
+                CHECK(parser_.Parse(line.substr(pos + 1), &value_))
+                    << "tokens of " << key_ << " should be integers: " << line;
+            }
         }
     } else if (input_type_ == IO_TYPES::KALDI_INPUT) {
-        kaldi_reader_->Next();
-        done_ = kaldi_reader_->Done();
-        if (!done_) {
-            key_ = kaldi_reader_->Key();
-            auto v = kaldi_reader_->Value();
-            CHECK(v.NumCols() == 1) << "input kaldi shape should be (t, 1)";
-            value_.resize(v.NumRows());
-            for (int i=0; i<v.NumRows(); i++)
-                value_[i] = static_cast<char32>(v(i, 0));
-            // free current
-            kaldi_reader_->FreeCurrent();
+        if (kaldi_value_type_ == KaldiValueType::INT32_VECTOR) {
+            kaldi_int32_reader_->Next();
+        } else {
+            kaldi_reader_->Next();
         }
+        ReadKaldiValue();
+    } else if (input_type_ == IO_TYPES::TOKEN_CORPUS) {
+        ++corpus_index_;
+        ReadCorpusValue();
     } else {
         // invalid
     }
 }
 
+void io_utils::GeneralIndexReader::ReadCorpusValue() {
+    done_ = corpus_index_ >= corpus_->size();
+    if (!done_) {
+        key_ = corpus_->has_keys() ? std::string(corpus_->key(corpus_index_))
+                                   : std::to_string(corpus_index_);
+        value_.clear();
+        corpus_->Append(corpus_index_, &value_);
+        CHECK(value_.size() % num_codebooks_ == 0)
+            << "tuples of " << key_ << " should have " << num_codebooks_ << " tokens";
+    }
+}
+
+void io_utils::GeneralIndexReader::ReadKaldiValue() {
+    // The holders keep their buffers for the next entry.
+    if (kaldi_value_type_ == KaldiValueType::INT32_VECTOR) {
+        done_ = kaldi_int32_reader_->Done();
+        if (!done_) {
+            key_ = kaldi_int32_reader_->Key();
+            const Int32Vector &v = kaldi_int32_reader_->Value();
+            CHECK(v.size() % num_codebooks_ == 0)
+                << "tuples of " << key_ << " should have " << num_codebooks_ << " tokens";
+            value_.assign(v.begin(), v.end());
+        }
+        return;
+    }
+    done_ = kaldi_reader_->Done();
+    if (!done_) {
+        key_ = kaldi_reader_->Key();
+        const FloatMatrix &v = kaldi_reader_->Value();
+        CHECK(v.NumCols() == num_codebooks_)
+            << "input kaldi shape should be (t, " << num_codebooks_ << ")";
+        value_.resize(v.NumRows() * num_codebooks_);
+        for (int i=0; i<v.NumRows(); i++)
+            for (int j=0; j<num_codebooks_; j++)
+                value_[i * num_codebooks_ + j] = static_cast<char32>(v(i, j));
+    }
+}
+
 std::string io_utils::GeneralIndexReader::Key() {
     return key_;
 }
 
-std::vector<char32> io_utils::GeneralIndexReader::Value() {
+const std::vector<char32> &io_utils::GeneralIndexReader::Value() const {
     return value_;
 }
 
-io_utils::GeneralIndexWriter::GeneralIndexWriter(const std::string &filename) {
+io_utils::GeneralIndexWriter::GeneralIndexWriter(const std::string &filename, int num_codebooks,
+                                                 KaldiValueType kaldi_value_type)
+    : kaldi_value_type_(kaldi_value_type), num_codebooks_(num_codebooks) {
     if (is_valid_kaldi_wspec(filename)) {
         output_type_ = IO_TYPES::KALDI_OUTPUT;
-        kaldi_writer_ = std::make_unique<io_utils::FloatMatrixWriter>(filename);
-        CHECK(kaldi_writer_->IsOpen()) << "error open wspec: " << filename;
+        if (kaldi_value_type_ == KaldiValueType::INT32_VECTOR) {
+            kaldi_int32_writer_ = std::make_unique<io_utils::Int32VectorWriter>(filename);
+            CHECK(kaldi_int32_writer_->IsOpen()) << "error open wspec: " << filename;
+        } else {
+            kaldi_writer_ = std::make_unique<io_utils::FloatMatrixWriter>(filename);
+            CHECK(kaldi_writer_->IsOpen()) << "error open wspec: " << filename;
+        }
+    } else if (is_token_corpus_output(filename)) {
+        output_type_ = IO_TYPES::TOKEN_CORPUS;
+        corpus_writer_ = std::make_unique<discretepiece::TokenCorpusWriter>();
+        CHECK_OK(corpus_writer_->Open(filename));
     } else {
         output_type_ = IO_TYPES::TEXT_FILE;
         auto output = discretepiece::filesystem::NewWritableFile(filename);
@@ -104,34 +248,97 @@ io_utils::GeneralIndexWriter::GeneralIndexWriter(const std::string &filename) {
 
 io_utils::GeneralIndexWriter::~GeneralIndexWriter() {
     if (output_type_ == IO_TYPES::TEXT_FILE) {
-        // pass
+        CHECK_OK(file_writer_->Close());
     } else if (output_type_ == IO_TYPES::KALDI_OUTPUT) {
-        kaldi_writer_->Close();
+        // Errors of background ("bg") writes are only reported here.
+        if (kaldi_int32_writer_ != nullptr)
+            CHECK(kaldi_int32_writer_->Close()) << "error writing kaldi output";
+        if (kaldi_writer_ != nullptr)
+            CHECK(kaldi_writer_->Close()) << "error writing kaldi output";
+    } else if (output_type_ == IO_TYPES::TOKEN_CORPUS) {
+        CHECK_OK(corpus_writer_->Close());
     } else {
         // pass
     }
 }
 
 void io_utils::GeneralIndexWriter::Write(const std::string &key, const std::vector<char32> &value) {
+    if (output_type_ == IO_TYPES::TEXT_FILE && num_codebooks_ == 1) {
+        // Formats straight into the line.
+        std::string line = key;
+        line.push_back(' ');
+        discretepiece::string_util::AppendInts(value, " ", &line);
+        file_writer_->WriteLine(line);
+    } else if (output_type_ == IO_TYPES::TEXT_FILE) {
+        WriteText(key, FormatTokens(value, num_codebooks_));
+    } else if (output_type_ == IO_TYPES::KALDI_OUTPUT &&
+               kaldi_value_type_ == KaldiValueType::INT32_VECTOR) {
+        int32_values_.assign(value.begin(), value.end());
+        kaldi_int32_writer_->Write(key, int32_values_);
+    } else if (output_type_ == IO_TYPES::KALDI_OUTPUT) {
+        const int rows = value.size() / num_codebooks_;
+        if (matrix_.NumRows() != rows || matrix_.NumCols() != num_codebooks_)
+            matrix_.Resize(rows, num_codebooks_, kaldiio::kUndefined);
+        for (int i=0; i<rows; i++)
+            for (int j=0; j<num_codebooks_; j++)
+                matrix_(i, j) = static_cast<float>(value[i * num_codebooks_ + j]);
+        kaldi_writer_->Write(key, matrix_);
+    } else if (output_type_ == IO_TYPES::TOKEN_CORPUS) {
+        CHECK_OK(corpus_writer_->Add(key, value));
+    } else {
+        // pass
+    }
+}
+
+std::string io_utils::GeneralIndexWriter::FormatTokens(absl::Span<const char32> value, int num_codebooks) {
+    if (num_codebooks > 1)
+        return discretepiece::string_util::TuplesToString(value, num_codebooks, " ");
+    std::string text;
+    discretepiece::string_util::AppendInts(value, " ", &text);
+    return text;
+}
+
+void io_utils::GeneralIndexWriter::WriteText(const std::string &key, absl::string_view text) {
+    CHECK(output_type_ == IO_TYPES::TEXT_FILE) << "WriteText() is only valid for text output";
+    std::string line;
+    line.reserve(key.size() + 1 + text.size());
+    line.append(key);
+    line.push_back(' ');
+    line.append(text.data(), text.size());
+    file_writer_->WriteLine(line);
+}
+
+void io_utils::GeneralIndexWriter::WriteIds(const std::string &key, const std::vector<int> &ids) {
     if (output_type_ == IO_TYPES::TEXT_FILE) {
-        auto value_string = discretepiece::string_util::VectorChar32ToString(value, " ");
-        value_string.insert(0, key + " ");
-        file_writer_->WriteLine(value_string);
+        std::string line = key;
+        line.push_back(' ');
+        discretepiece::string_util::AppendInts(ids, " ", &line);
+        file_writer_->WriteLine(line);
+    } else if (output_type_ == IO_TYPES::KALDI_OUTPUT &&
+               kaldi_value_type_ == KaldiValueType::INT32_VECTOR) {
+        int32_values_.assign(ids.begin(), ids.end());
+        kaldi_int32_writer_->Write(key, int32_values_);
     } else if (output_type_ == IO_TYPES::KALDI_OUTPUT) {
-        FloatMatrix matrix(value.size(), 1);
-        for (int i=0; i<value.size(); i++)
-            matrix(i, 0) = static_cast<float>(value[i]);
-        kaldi_writer_->Write(key, matrix);
+        if (matrix_.NumRows() != static_cast<int>(ids.size()) || matrix_.NumCols() != 1)
+            matrix_.Resize(ids.size(), 1, kaldiio::kUndefined);
+        for (int i=0; i<ids.size(); i++)
+            matrix_(i, 0) = static_cast<float>(ids[i]);
+        kaldi_writer_->Write(key, matrix_);
+    } else if (output_type_ == IO_TYPES::TOKEN_CORPUS) {
+        const std::vector<char32> tokens(ids.begin(), ids.end());
+        CHECK_OK(corpus_writer_->Add(key, tokens));
     } else {
         // pass
     }
 }
 
-void io_utils::GeneralIndexWriter::WritePieces(const std::string &key, const std::vector<std::string> &pieces) {
+void io_utils::GeneralIndexWriter::WritePieces(const std::string &key, const std::vector<absl::string_view> &pieces) {
     if (output_type_ == IO_TYPES::TEXT_FILE) {
         std::string value_string = absl::StrJoin(pieces, " ");
         value_string.insert(0, key + " ");
         file_writer_->WriteLine(value_string);
+    } else if (output_type_ == IO_TYPES::TOKEN_CORPUS) {
+        LOG(FATAL) << "pieces cannot be written to a token corpus, use ids";
     } else {
         // pass
         // TODO error check
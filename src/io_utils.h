@@ -5,6 +5,8 @@
 #include <vector>
 #include "util.h"
 #include "filesystem.h"
+#include "token_corpus.h"
+#include "kaldiio/kaldiio/kaldi-ark-index.h"
 #include "kaldiio/kaldiio/kaldi-table.h"
 
 namespace io_utils {
@@ -13,19 +15,55 @@ bool is_valid_kaldi_rspec(const std::string &rspec);
 
 bool is_valid_kaldi_wspec(const std::string &wspec);
 
+// Returns true if `filename` names a packed token corpus (.dptok) to write.
+bool is_token_corpus_output(const std::string &filename);
+
 using FloatMatrix = kaldiio::Matrix<float>;
 using SequentialFloatMatrixReader = kaldiio::SequentialTableReader<kaldiio::KaldiObjectHolder<FloatMatrix>>;
 using FloatMatrixWriter = kaldiio::TableWriter<kaldiio::KaldiObjectHolder<FloatMatrix>>;
+using Int32Vector = std::vector<int32_t>;
+using SequentialInt32VectorReader = kaldiio::SequentialTableReader<kaldiio::BasicVectorHolder<int32_t>>;
+using Int32VectorWriter = kaldiio::TableWriter<kaldiio::BasicVectorHolder<int32_t>>;
+// Random access by key into archives indexed with the "idx" wspecifier
+// option or spm_ark_indexer, see kaldiio/kaldiio/kaldi-ark-index.h.
+using RandomAccessFloatMatrixArkReader = kaldiio::RandomAccessArkReader<kaldiio::KaldiObjectHolder<FloatMatrix>>;
+using RandomAccessInt32VectorArkReader = kaldiio::RandomAccessArkReader<kaldiio::BasicVectorHolder<int32_t>>;
+
+// Values of a kaldi table: float matrices of shape (t, num_codebooks), or
+// int32 vectors of the flattened tuples, which hold ids exactly and take
+// no conversion.
+enum class KaldiValueType {
+    FLOAT_MATRIX,
+    INT32_VECTOR,
+};
+
+// Parses "float_matrix" or "int32_vector".
+bool ParseKaldiValueType(const std::string &name, KaldiValueType *type);
+
+// Returns the type of the values of the kaldi archive or script `rspec`,
+// read from the header of its first value. Pipes and stdin cannot be
+// peeked at and are read as float matrices.
+KaldiValueType DetectKaldiValueType(const std::string &rspec);
 
 enum class IO_TYPES {
     TEXT_FILE,
     KALDI_INPUT,
     KALDI_OUTPUT,
+    TOKEN_CORPUS,
 };
 
 class GeneralIndexReader {
 public:
-  GeneralIndexReader(const std::string &filename);
+  // `special_mapping` maps single-character tokens of the text input,
+  // e.g. deliminators, to char32 values. With `num_codebooks` > 1 every
+  // position is a tuple, "a:b:c" in text or a row of a Kaldi matrix with
+  // `num_codebooks` columns, and Value() holds the flattened tuples.
+  // Kaldi tables of int32 vectors are detected by DetectKaldiValueType().
+  // Token corpora (.dptok) are detected by their magic and hold the
+  // flattened tuples already; sequences without keys get their index.
+  GeneralIndexReader(const std::string &filename,
+                     const absl::flat_hash_map<char, char32> &special_mapping = {},
+                     int num_codebooks = 1);
 
   ~GeneralIndexReader();
 
@@ -35,15 +73,36 @@ public:
 
   std::string Key();
 
-  std::vector<char32> Value();
+  const std::vector<char32> &Value() const;
 
 private:
+// Reads the key and value of the current kaldi entry.
+void ReadKaldiValue();
+
+// Reads the key and value of sequence corpus_index_ of the token corpus.
+void ReadCorpusValue();
+
 IO_TYPES input_type_;
 
+KaldiValueType kaldi_value_type_ = KaldiValueType::FLOAT_MATRIX;
+
 std::unique_ptr<discretepiece::filesystem::ReadableFile> file_reader_;
 
 std::unique_ptr<SequentialFloatMatrixReader> kaldi_reader_;
 
+std::unique_ptr<SequentialInt32VectorReader> kaldi_int32_reader_;
+
+std::unique_ptr<discretepiece::TokenCorpus> corpus_;
+
+size_t corpus_index_ = 0;
+
+absl::flat_hash_map<char, char32> special_mapping_;
+
+// Parses text values with special_mapping_.
+discretepiece::string_util::TokenParser parser_;
+
+int num_codebooks_;
+
 std::vector<char32> value_;
 
 std::string key_;
@@ -55,20 +114,51 @@ bool done_;
 
 class GeneralIndexWriter {
 public:
-  GeneralIndexWriter(const std::string &filename);
+  // With `num_codebooks` > 1, Write() takes flattened tuples and writes
+  // them as "a:b:c" in text or as Kaldi matrices with `num_codebooks` columns.
+  // Kaldi values are written as `kaldi_value_type`.
+  // Filenames ending with ".dptok" are written as a packed token corpus,
+  // which holds ids and tokens but not pieces.
+  GeneralIndexWriter(const std::string &filename, int num_codebooks = 1,
+                     KaldiValueType kaldi_value_type = KaldiValueType::FLOAT_MATRIX);
 
   ~GeneralIndexWriter();
 
   void Write(const std::string &key, const std::vector<char32> &value);
 
-  void WritePieces(const std::string &key, const std::vector<std::string> &pieces);
+  // Returns the text form of `value` written by Write() to text output.
+  // Thread-safe, so that callers can format in parallel and WriteText().
+  static std::string FormatTokens(absl::Span<const char32> value, int num_codebooks);
+
+  // Writes a value formatted with FormatTokens(). Only valid for text output.
+  void WriteText(const std::string &key, absl::string_view text);
+
+  bool IsText() const { return output_type_ == IO_TYPES::TEXT_FILE; }
+
+  // Writes piece ids, the same as Write() with the ids cast to char32.
+  void WriteIds(const std::string &key, const std::vector<int> &ids);
+
+  void WritePieces(const std::string &key, const std::vector<absl::string_view> &pieces);
 
 private:
   IO_TYPES output_type_;
 
+  KaldiValueType kaldi_value_type_;
+
   std::unique_ptr<discretepiece::filesystem::WritableFile> file_writer_;
 
   std::unique_ptr<FloatMatrixWriter> kaldi_writer_;
+
+  std::unique_ptr<Int32VectorWriter> kaldi_int32_writer_;
+
+  std::unique_ptr<discretepiece::TokenCorpusWriter> corpus_writer_;
+
+  // Reused by every kaldi value written.
+  FloatMatrix matrix_;
+
+  Int32Vector int32_values_;
+
+  int num_codebooks_;
 };
 
 }   // namespace io_utils
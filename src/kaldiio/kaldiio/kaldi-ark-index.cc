@@ -0,0 +1,311 @@
+// kaldi-ark-index.cc
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#include "kaldi-ark-index.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+namespace kaldiio {
+
+namespace {
+
+const char kMagic[4] = {'K', 'A', 'I', 'X'};
+const uint32_t kVersion = 1;
+const size_t kHeaderSize = 64;
+const size_t kEntrySize = 32;
+
+template <typename T>
+T ReadValue(const char *p) {
+  T value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+template <typename T>
+void AppendValue(T value, std::string *out) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+}  // namespace
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string &filename, bool /*random*/) {
+  Close();
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) ||
+      static_cast<uint64_t>(size.QuadPart) > static_cast<size_t>(-1)) {
+    CloseHandle(file);
+    return false;
+  }
+  if (size.QuadPart == 0) {
+    // Empty files cannot be mapped; an empty archive has no objects anyway.
+    CloseHandle(file);
+    data_ = "";
+    size_ = 0;
+    return true;
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL) return false;
+  // The view keeps the mapping alive.
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (data == NULL) return false;
+  data_ = static_cast<const char *>(data);
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != NULL && size_ > 0) UnmapViewOfFile(data_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+#else  // _WIN32
+
+bool MappedFile::Open(const std::string &filename, bool random) {
+  Close();
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    // mmap() rejects empty files; an empty archive has no objects anyway.
+    close(fd);
+    data_ = "";
+    size_ = 0;
+    return true;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+  if (random) madvise(data, st.st_size, MADV_RANDOM);
+  data_ = static_cast<const char *>(data);
+  size_ = st.st_size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ != NULL && size_ > 0) munmap(const_cast<char *>(data_), size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+#endif  // _WIN32
+
+void ArkIndexWriter::Add(const std::string &key, uint64_t offset,
+                         uint64_t size) {
+  Entry entry;
+  entry.key_offset = keys_.size();
+  entry.key_size = key.size();
+  entry.value_offset = offset;
+  entry.value_size = size;
+  keys_.append(key);
+  offsets_.push_back(entry);
+}
+
+bool ArkIndexWriter::Write(const std::string &filename,
+                           uint64_t archive_size) const {
+  // Sorts positions rather than entries, and keeps the first of equal keys.
+  std::vector<uint64_t> order(offsets_.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  const char *keys = keys_.data();
+  const std::vector<Entry> &entries = offsets_;
+  std::stable_sort(order.begin(), order.end(),
+                   [keys, &entries](uint64_t a, uint64_t b) {
+                     const Entry &x = entries[a], &y = entries[b];
+                     const int c = memcmp(keys + x.key_offset,
+                                          keys + y.key_offset,
+                                          std::min(x.key_size, y.key_size));
+                     return c != 0 ? c < 0 : x.key_size < y.key_size;
+                   });
+
+  std::string header(kMagic, sizeof(kMagic));
+  AppendValue(kVersion, &header);
+  AppendValue(static_cast<uint64_t>(order.size()), &header);
+  AppendValue(archive_size, &header);
+  AppendValue(static_cast<uint64_t>(kHeaderSize), &header);
+  AppendValue(static_cast<uint64_t>(kHeaderSize + order.size() * kEntrySize),
+              &header);
+  AppendValue(static_cast<uint64_t>(keys_.size()), &header);
+  header.resize(kHeaderSize, '\0');
+
+  std::ofstream os(filename.c_str(), std::ios::out | std::ios::binary);
+  if (!os.is_open()) {
+    KALDIIO_WARN << "Failed to open index " << filename << ": "
+                 << strerror(errno);
+    return false;
+  }
+  os.write(header.data(), header.size());
+  // The keys are written in sorted order, so key_offset is recomputed.
+  std::string entry;
+  uint64_t key_offset = 0;
+  for (size_t i = 0; i < order.size(); ++i) {
+    const Entry &e = offsets_[order[i]];
+    entry.clear();
+    AppendValue(key_offset, &entry);
+    AppendValue(e.key_size, &entry);
+    AppendValue(static_cast<uint32_t>(0), &entry);
+    AppendValue(e.value_offset, &entry);
+    AppendValue(e.value_size, &entry);
+    os.write(entry.data(), entry.size());
+    key_offset += e.key_size;
+  }
+  for (size_t i = 0; i < order.size(); ++i) {
+    const Entry &e = offsets_[order[i]];
+    os.write(keys + e.key_offset, e.key_size);
+  }
+  os.close();
+  if (os.fail()) {
+    KALDIIO_WARN << "Failed to write index " << filename;
+    return false;
+  }
+  return true;
+}
+
+bool ArkIndex::Open(const std::string &filename) {
+  Close();
+  if (!file_.Open(filename, true)) {
+    KALDIIO_WARN << "Failed to map index " << filename << ": "
+                 << strerror(errno);
+    return false;
+  }
+  const char *data = file_.Data();
+  const size_t size = file_.Size();
+  if (size < kHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) != 0 ||
+      ReadValue<uint32_t>(data + 4) != kVersion) {
+    KALDIIO_WARN << filename << " is not an archive index.";
+    Close();
+    return false;
+  }
+  num_entries_ = ReadValue<uint64_t>(data + 8);
+  archive_size_ = ReadValue<uint64_t>(data + 16);
+  const uint64_t entries_offset = ReadValue<uint64_t>(data + 24);
+  const uint64_t keys_offset = ReadValue<uint64_t>(data + 32);
+  keys_size_ = ReadValue<uint64_t>(data + 40);
+  if (entries_offset > size || num_entries_ > (size - entries_offset) / kEntrySize ||
+      keys_offset > size || keys_size_ > size - keys_offset) {
+    KALDIIO_WARN << "Broken archive index " << filename;
+    Close();
+    return false;
+  }
+  entries_ = data + entries_offset;
+  keys_ = data + keys_offset;
+  return true;
+}
+
+void ArkIndex::Close() {
+  file_.Close();
+  num_entries_ = 0;
+  archive_size_ = 0;
+  entries_ = NULL;
+  keys_ = NULL;
+  keys_size_ = 0;
+}
+
+const char *ArkIndex::Entry(size_t i) const {
+  KALDIIO_ASSERT(i < num_entries_);
+  return entries_ + i * kEntrySize;
+}
+
+std::string ArkIndex::Key(size_t i) const {
+  const char *entry = Entry(i);
+  const uint64_t offset = ReadValue<uint64_t>(entry);
+  const uint32_t size = ReadValue<uint32_t>(entry + 8);
+  if (offset > keys_size_ || size > keys_size_ - offset)
+    KALDIIO_ERR << "Broken archive index entry " << i;
+  return std::string(keys_ + offset, size);
+}
+
+void ArkIndex::Range(size_t i, uint64_t *offset, uint64_t *size) const {
+  const char *entry = Entry(i);
+  *offset = ReadValue<uint64_t>(entry + 16);
+  *size = ReadValue<uint64_t>(entry + 24);
+}
+
+int64_t ArkIndex::Find(const std::string &key) const {
+  // Lower bound of `key`, comparing the mapped keys in place.
+  size_t lo = 0, hi = num_entries_;
+  while (lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    const char *entry = Entry(mid);
+    const uint64_t offset = ReadValue<uint64_t>(entry);
+    const uint32_t size = ReadValue<uint32_t>(entry + 8);
+    if (offset > keys_size_ || size > keys_size_ - offset)
+      KALDIIO_ERR << "Broken archive index entry " << mid;
+    const int c = memcmp(keys_ + offset, key.data(),
+                         std::min<size_t>(size, key.size()));
+    if (c < 0 || (c == 0 && size < key.size())) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < num_entries_ && Key(lo) == key) return lo;
+  return -1;
+}
+
+MemoryStreambuf::MemoryStreambuf(const char *data, size_t size) {
+  char *begin = const_cast<char *>(data);
+  setg(begin, begin, begin + size);
+}
+
+MemoryStreambuf::pos_type MemoryStreambuf::seekoff(
+    off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+  off_type pos;
+  if (dir == std::ios_base::beg) {
+    pos = off;
+  } else if (dir == std::ios_base::cur) {
+    pos = gptr() - eback() + off;
+  } else {
+    pos = egptr() - eback() + off;
+  }
+  if (pos < 0 || pos > egptr() - eback()) return pos_type(off_type(-1));
+  setg(eback(), eback() + pos, egptr());
+  return pos_type(pos);
+}
+
+MemoryStreambuf::pos_type MemoryStreambuf::seekpos(
+    pos_type pos, std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+}  // namespace kaldiio
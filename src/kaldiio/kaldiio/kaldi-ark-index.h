@@ -0,0 +1,282 @@
+// kaldi-ark-index.h
+
+// See ../../COPYING for clarification regarding multiple authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+// THIS CODE IS PROVIDED *AS IS* BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION ANY IMPLIED
+// WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR A PARTICULAR PURPOSE,
+// MERCHANTABLITY OR NON-INFRINGEMENT.
+// See the Apache 2 License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef KALDI_NATIVE_IO_CSRC_KALDI_ARK_INDEX_H_
+#define KALDI_NATIVE_IO_CSRC_KALDI_ARK_INDEX_H_
+
+#include <stdint.h>
+
+#include <fstream>
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "log.h"
+#include "text-utils.h"
+
+namespace kaldiio {
+
+// An archive index is a sidecar file, by convention the archive filename
+// plus ".idx", which maps every key of an archive to the byte range of its
+// object.  The entries are sorted by key, so the index is used in place
+// after mapping it: a lookup is a binary search over the mapped entries and
+// reading the object touches only its own bytes of the mapped archive.
+// Memory does not grow with the size of the archive.
+//
+// Layout, little-endian:
+//   "KAIX", uint32 version, uint64 num_entries, uint64 archive_size,
+//   uint64 entries_offset, uint64 keys_offset, uint64 keys_size,
+//   uint64 reserved (64 bytes in total),
+//   entries: num_entries * {uint64 key_offset, uint32 key_size,
+//            uint32 reserved, uint64 value_offset, uint64 value_size},
+//   keys: the characters of all keys.
+// value_offset is the position of the object in the archive, just after
+// "key ", so that the object, including its binary header, is the range
+// [value_offset, value_offset + value_size).  archive_size detects an
+// index which is older than its archive.
+//
+// Indexes are written by TableWriter with the "idx" wspecifier option, or
+// by BuildArkIndex() for an existing archive.
+
+// Read-only memory map of a whole file.
+class MappedFile {
+ public:
+  MappedFile() : data_(NULL), size_(0) {}
+  ~MappedFile() { Close(); }
+
+  // Maps `filename`.  `random` advises the kernel that the pages are read
+  // in random order, so that it does not read ahead; it is ignored on
+  // Windows.
+  bool Open(const std::string &filename, bool random);
+  void Close();
+  bool IsOpen() const { return data_ != NULL; }
+
+  const char *Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+ private:
+  const char *data_;
+  size_t size_;
+  KALDIIO_DISALLOW_COPY_AND_ASSIGN(MappedFile)
+};
+
+// Collects the entries of an archive and writes its index.
+class ArkIndexWriter {
+ public:
+  ArkIndexWriter() {}
+
+  // Adds the object of `key` at [offset, offset + size) of the archive.
+  void Add(const std::string &key, uint64_t offset, uint64_t size);
+
+  // Sorts the entries and writes the index.  If a key is repeated, the
+  // index points to its first object.
+  bool Write(const std::string &filename, uint64_t archive_size) const;
+
+  size_t NumEntries() const { return offsets_.size(); }
+
+ private:
+  struct Entry {
+    uint64_t key_offset;
+    uint32_t key_size;
+    uint64_t value_offset;
+    uint64_t value_size;
+  };
+  std::string keys_;
+  std::vector<Entry> offsets_;
+  KALDIIO_DISALLOW_COPY_AND_ASSIGN(ArkIndexWriter)
+};
+
+// A mapped archive index.
+class ArkIndex {
+ public:
+  ArkIndex()
+      : num_entries_(0), archive_size_(0), entries_(NULL), keys_(NULL),
+        keys_size_(0) {}
+
+  // Maps `filename`, and checks the layout.
+  bool Open(const std::string &filename);
+  void Close();
+  bool IsOpen() const { return file_.IsOpen(); }
+
+  size_t NumEntries() const { return num_entries_; }
+
+  // Size of the archive when the index was written.
+  uint64_t ArchiveSize() const { return archive_size_; }
+
+  // The key of entry i; entries are in sorted order of keys.
+  std::string Key(size_t i) const;
+
+  // Returns the byte range of the object of entry i.
+  void Range(size_t i, uint64_t *offset, uint64_t *size) const;
+
+  // Returns the entry of `key`, or -1 if there is none.
+  int64_t Find(const std::string &key) const;
+
+ private:
+  const char *Entry(size_t i) const;
+
+  MappedFile file_;
+  uint64_t num_entries_;
+  uint64_t archive_size_;
+  const char *entries_;
+  const char *keys_;
+  uint64_t keys_size_;
+  KALDIIO_DISALLOW_COPY_AND_ASSIGN(ArkIndex)
+};
+
+// A read-only streambuf over memory, used to deserialize objects from the
+// mapped archive without copying them.
+class MemoryStreambuf : public std::streambuf {
+ public:
+  MemoryStreambuf(const char *data, size_t size);
+
+ protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which);
+  virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+};
+
+// Reads the objects of an indexed archive by key.  The archive and its index
+// are mapped, so memory stays flat however large the archive is, and
+// Value() deserializes the one object it returns.  Unlike
+// RandomAccessTableReader it only supports actual files ("foo.ark", not
+// rspecifiers) and keys may be looked up in any order any number of times.
+//
+// The mapped pages are shared by all readers of the archive, but one reader
+// must not be used from several threads at once.
+template <class Holder>
+class RandomAccessArkReader {
+ public:
+  typedef typename Holder::T T;
+
+  RandomAccessArkReader() {}
+
+  // Maps the archive and its index, `archive_filename` + ".idx" if
+  // `index_filename` is empty.
+  bool Open(const std::string &archive_filename,
+            const std::string &index_filename = "") {
+    Close();
+    const std::string index_name =
+        index_filename.empty() ? archive_filename + ".idx" : index_filename;
+    if (!index_.Open(index_name)) return false;
+    if (!archive_.Open(archive_filename, true)) {
+      KALDIIO_WARN << "Failed to map archive " << archive_filename;
+      index_.Close();
+      return false;
+    }
+    if (archive_.Size() != index_.ArchiveSize()) {
+      KALDIIO_WARN << "Index " << index_name << " is for an archive of "
+                   << index_.ArchiveSize() << " bytes, but " << archive_filename
+                   << " has " << archive_.Size() << " bytes; rebuild the index.";
+      Close();
+      return false;
+    }
+    archive_filename_ = archive_filename;
+    return true;
+  }
+
+  void Close() {
+    archive_.Close();
+    index_.Close();
+    holder_.Clear();
+  }
+
+  bool IsOpen() const { return archive_.IsOpen(); }
+
+  // Keys in sorted order, e.g. to draw a shuffled order of the archive.
+  size_t NumKeys() const { return index_.NumEntries(); }
+  std::string Key(size_t i) const { return index_.Key(i); }
+
+  bool HasKey(const std::string &key) const { return index_.Find(key) >= 0; }
+
+  // Returns the object of `key`; throws if there is none or it cannot be
+  // read.  The reference is valid until the next call of Value().
+  const T &Value(const std::string &key) {
+    const int64_t i = index_.Find(key);
+    if (i < 0)
+      KALDIIO_ERR << "No key " << key << " in archive " << archive_filename_;
+    return ValueAt(i);
+  }
+
+  // Returns the object of Key(i).
+  const T &ValueAt(size_t i) {
+    uint64_t offset, size;
+    index_.Range(i, &offset, &size);
+    if (offset > archive_.Size() || size > archive_.Size() - offset)
+      KALDIIO_ERR << "Index entry " << i << " is outside of archive "
+                  << archive_filename_;
+    MemoryStreambuf buf(archive_.Data() + offset, size);
+    std::istream is(&buf);
+    if (!holder_.Read(is))
+      KALDIIO_ERR << "Failed to read object " << index_.Key(i)
+                  << " from archive " << archive_filename_;
+    return holder_.Value();
+  }
+
+ private:
+  std::string archive_filename_;
+  MappedFile archive_;
+  ArkIndex index_;
+  Holder holder_;
+  KALDIIO_DISALLOW_COPY_AND_ASSIGN(RandomAccessArkReader)
+};
+
+// Writes the index of an existing archive, which must be an actual file.
+// Every object is read once with Holder, in order, to find its size.
+template <class Holder>
+bool BuildArkIndex(const std::string &archive_filename,
+                   const std::string &index_filename) {
+  std::ifstream is(archive_filename.c_str(), std::ios::in | std::ios::binary);
+  if (!is.is_open()) {
+    KALDIIO_WARN << "Failed to open archive " << archive_filename;
+    return false;
+  }
+  ArkIndexWriter writer;
+  Holder holder;
+  std::string key;
+  while (is >> key) {
+    // Same checks as the archive reader: "key " precedes every object.
+    if (is.get() != ' ' || !IsToken(key)) {
+      KALDIIO_WARN << "Invalid archive " << archive_filename << " at key "
+                   << key;
+      return false;
+    }
+    const std::streamoff offset = is.tellg();
+    if (!holder.Read(is)) {
+      KALDIIO_WARN << "Failed to read object " << key << " from archive "
+                   << archive_filename;
+      return false;
+    }
+    holder.Clear();
+    // Text objects may end at the end of the file without a newline.
+    std::streamoff end = is.tellg();
+    if (end < 0) {
+      is.clear();
+      is.seekg(0, std::ios::end);
+      end = is.tellg();
+    }
+    writer.Add(key, offset, end - offset);
+  }
+  is.clear();
+  is.seekg(0, std::ios::end);
+  return writer.Write(index_filename, is.tellg());
+}
+
+}  // namespace kaldiio
+
+#endif  // KALDI_NATIVE_IO_CSRC_KALDI_ARK_INDEX_H_
@@ -26,12 +26,16 @@
 #include <string.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "kaldi-ark-index.h"
 #include "kaldi-io.h"
 #include "kaldi-utils.h"
 #include "log.h"
@@ -1016,6 +1020,32 @@ class TableWriterImplBase {
   KALDIIO_DISALLOW_COPY_AND_ASSIGN(TableWriterImplBase)
 };
 
+// With the "idx" option, creates the index writer of an archive which is an
+// actual file; offsets into pipes or stdout are meaningless.
+inline void OpenIndex(const WspecifierOptions &opts,
+                      const std::string &archive_wxfilename,
+                      std::unique_ptr<ArkIndexWriter> *index_writer) {
+  index_writer->reset();
+  if (!opts.index) return;
+  if (ClassifyWxfilename(archive_wxfilename) != kFileOutput) {
+    KALDIIO_WARN << "Not writing an index: the archive is not an actual file: "
+                 << PrintableWxfilename(archive_wxfilename);
+    return;
+  }
+  index_writer->reset(new ArkIndexWriter());
+}
+
+// Writes the index, if any, of the closed archive to its filename + ".idx".
+inline bool CloseIndex(const std::string &archive_wxfilename,
+                       std::streamoff archive_size,
+                       std::unique_ptr<ArkIndexWriter> *index_writer) {
+  if (!*index_writer) return true;
+  const bool ans =
+      (*index_writer)->Write(archive_wxfilename + ".idx", archive_size);
+  index_writer->reset();
+  return ans;
+}
+
 // The implementation of TableWriter we use when writing directly
 // to an archive with no associated scp.
 template <class Holder>
@@ -1045,6 +1075,7 @@ class TableWriterArchiveImpl : public TableWriterImplBase<Holder> {
     if (output_.Open(archive_wxfilename_, opts_.binary, false)) {  // false
       // means no binary header.
       state_ = kOpen;
+      OpenIndex(opts_, archive_wxfilename_, &index_writer_);
       return true;
     } else {
       // stream will not be open.  User will report this error
@@ -1086,12 +1117,18 @@ class TableWriterArchiveImpl : public TableWriterImplBase<Holder> {
     if (!IsToken(key))  // e.g. empty string or has spaces...
       KALDIIO_ERR << "Using invalid key " << key;
     output_.Stream() << key << ' ';
+    std::streamoff value_pos = 0;
+    if (index_writer_) value_pos = output_.Stream().tellp();
     if (!Holder::Write(output_.Stream(), opts_.binary, value)) {
       KALDIIO_WARN << "Write failure to "
                    << PrintableWxfilename(archive_wxfilename_);
       state_ = kWriteError;
       return false;
     }
+    if (index_writer_) {
+      archive_size_ = output_.Stream().tellp();
+      index_writer_->Add(key, value_pos, archive_size_ - value_pos);
+    }
     if (state_ == kWriteError) return false;  // Even if this Write seems to
     // have succeeded, we fail because a previous Write failed and the archive
     // may be corrupted and unreadable.
@@ -1130,10 +1167,10 @@ class TableWriterArchiveImpl : public TableWriterImplBase<Holder> {
       return false;
     }
     state_ = kUninitialized;
-    return true;
+    return CloseIndex(archive_wxfilename_, archive_size_, &index_writer_);
   }
 
-  TableWriterArchiveImpl() : state_(kUninitialized) {}
+  TableWriterArchiveImpl() : archive_size_(0), state_(kUninitialized) {}
 
   // May throw on write error if Close was not called.
   virtual ~TableWriterArchiveImpl() {
@@ -1149,6 +1186,8 @@ class TableWriterArchiveImpl : public TableWriterImplBase<Holder> {
   WspecifierOptions opts_;
   std::string wspecifier_;
   std::string archive_wxfilename_;
+  std::unique_ptr<ArkIndexWriter> index_writer_;  // with the "idx" option.
+  std::streamoff archive_size_;  // end of the last object, for the index.
   enum {             // is stream open?
     kUninitialized,  // no
     kOpen,           // yes
@@ -1357,6 +1396,7 @@ class TableWriterBothImpl : public TableWriterImplBase<Holder> {
       return false;
     }
     state_ = kOpen;
+    OpenIndex(opts_, archive_wxfilename_, &index_writer_);
     return true;
   }
 
@@ -1425,6 +1465,11 @@ class TableWriterBothImpl : public TableWriterImplBase<Holder> {
       state_ = kWriteError;
       return false;
     }
+    if (index_writer_) {
+      archive_size_ = archive_os.tellp();
+      index_writer_->Add(key, std::streamoff(archive_os_pos),
+                         archive_size_ - std::streamoff(archive_os_pos));
+    }
 
     if (script_os.fail()) {
       KALDIIO_WARN << "Write failure to script file detected: "
@@ -1472,10 +1517,14 @@ class TableWriterBothImpl : public TableWriterImplBase<Holder> {
       if (!script_output_.Close()) close_success = false;
     bool ans = close_success && (state_ != kWriteError);
     state_ = kUninitialized;
-    return ans;
+    if (!ans) {
+      index_writer_.reset();
+      return false;
+    }
+    return CloseIndex(archive_wxfilename_, archive_size_, &index_writer_);
   }
 
-  TableWriterBothImpl() : state_(kUninitialized) {}
+  TableWriterBothImpl() : archive_size_(0), state_(kUninitialized) {}
 
   // May throw on write error if Close() was not called.
   // User can get the error status by calling Close().
@@ -1493,6 +1542,8 @@ class TableWriterBothImpl : public TableWriterImplBase<Holder> {
   std::string archive_wxfilename_;
   std::string script_wxfilename_;
   std::string wspecifier_;
+  std::unique_ptr<ArkIndexWriter> index_writer_;  // with the "idx" option.
+  std::streamoff archive_size_;  // end of the last object, for the index.
   enum {             // is stream open?
     kUninitialized,  // no
     kOpen,           // yes
@@ -1500,6 +1551,167 @@ class TableWriterBothImpl : public TableWriterImplBase<Holder> {
   } state_;
 };
 
+// TableWriterBackgroundImpl is used when the "bg" option is given in the
+// wspecifier.  Write() copies the object into a bounded queue and returns;
+// a background thread serializes and writes the queued objects through the
+// base writer, so that the caller overlaps computing the next object with
+// the output.  Objects are written in order.  Write failures in the
+// background are reported by the next Write(), Flush() does not return
+// status, and Close() reports any failure.  If `flush` is set (the "f"
+// option), every object is written and flushed as soon as it is queued
+// rather than in batches.
+template <class Holder>
+class TableWriterBackgroundImpl : public TableWriterImplBase<Holder> {
+ public:
+  typedef typename Holder::T T;
+
+  TableWriterBackgroundImpl(TableWriterImplBase<Holder> *base_writer,
+                            bool flush)
+      : base_writer_(base_writer), queue_(kQueueSize), head_(0), size_(0),
+        flush_(flush), draining_(false), closing_(false),
+        write_error_(false) {}
+
+  // This function ignores the wspecifier argument, like the background
+  // reader.
+  virtual bool Open(const std::string & /*wspecifier*/) {
+    KALDIIO_ASSERT(base_writer_ != NULL &&
+                   base_writer_->IsOpen());  // or code error.
+    thread_ = std::thread(TableWriterBackgroundImpl<Holder>::run, this);
+    return true;
+  }
+
+  virtual bool IsOpen() const { return base_writer_ != NULL; }
+
+  virtual bool Write(const std::string &key, const T &value) {
+    // Checked here so that the error is thrown in the calling thread.
+    if (!IsToken(key)) KALDIIO_ERR << "Using invalid key " << key;
+    size_t slot;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_full_.wait(lock, [this] { return size_ < queue_.size(); });
+      if (write_error_) {
+        KALDIIO_WARN << "Attempting to write to invalid stream.";
+        return false;
+      }
+      slot = (head_ + size_) % queue_.size();
+    }
+    // The slot is not visible to the background thread until size_ grows,
+    // so the copy is done without the lock.  Not all object types can be
+    // assigned, e.g. Matrix, so the copy is constructed.
+    queue_[slot].first = key;
+    queue_[slot].second.reset(new T(value));
+    bool wake;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wake = ++size_ == kWakeSize || flush_;
+    }
+    if (wake) not_empty_.notify_one();
+    return true;
+  }
+
+  // Waits until the queue is written, then flushes the base writer.
+  virtual void Flush() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      draining_ = true;
+      not_empty_.notify_one();
+      not_full_.wait(lock, [this] { return size_ == 0; });
+      draining_ = false;
+    }
+    base_writer_->Flush();
+  }
+
+  virtual bool Close() {
+    KALDIIO_ASSERT(base_writer_ != NULL && thread_.joinable());
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closing_ = true;
+    }
+    not_empty_.notify_one();
+    thread_.join();
+    bool ans = true;
+    try {
+      ans = base_writer_->Close();
+    } catch (...) {
+      ans = false;
+    }
+    delete base_writer_;
+    base_writer_ = NULL;
+    return ans && !write_error_;
+  }
+
+  ~TableWriterBackgroundImpl() {
+    if (base_writer_) {
+      if (!Close()) {
+        KALDIIO_ERR << "Error detected closing background writer "
+                    << "(relates to ',bg' modifier)";
+      }
+    }
+  }
+
+ private:
+  // Number of objects which may be queued before Write() blocks.
+  static const size_t kQueueSize = 16;
+  // The idle background thread is woken once this many objects are queued
+  // rather than for every object, which would cost more than writing small
+  // objects.  Once awake, it writes until the queue is empty.
+  static const size_t kWakeSize = kQueueSize / 2;
+
+  void RunInBackground() {
+    while (true) {
+      // Takes every queued object at once, so that the lock is taken once
+      // per batch rather than per object.
+      size_t begin, count;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (size_ == 0) {
+          not_empty_.wait(lock, [this] {
+            return size_ >= kWakeSize || (size_ > 0 && (draining_ || flush_)) ||
+                   closing_;
+          });
+          if (size_ == 0) return;  // closing_ and everything is written.
+        }
+        begin = head_;
+        count = size_;
+      }
+      bool ok = true;
+      for (size_t i = 0; i < count; ++i) {
+        auto &entry = queue_[(begin + i) % queue_.size()];
+        try {
+          ok = base_writer_->Write(entry.first, *entry.second) && ok;
+        } catch (...) {
+          ok = false;
+        }
+        entry.second.reset();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ok) write_error_ = true;
+        head_ = (head_ + count) % queue_.size();
+        size_ -= count;
+      }
+      not_full_.notify_all();
+    }
+  }
+  static void run(TableWriterBackgroundImpl<Holder> *object) {
+    object->RunInBackground();
+  }
+
+  TableWriterImplBase<Holder> *base_writer_;
+  // Ring of queue_.size() slots; the size_ objects from head_ are queued.
+  std::vector<std::pair<std::string, std::unique_ptr<T> > > queue_;
+  size_t head_;
+  size_t size_;
+  bool flush_;     // Writes every object as soon as it is queued.
+  bool draining_;  // Flush() waits for the queue to be written.
+  bool closing_;
+  bool write_error_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;  // waited on by the background thread.
+  std::condition_variable not_full_;   // waited on by Write() and Flush().
+  std::thread thread_;
+};
+
 template <class Holder>
 TableWriter<Holder>::TableWriter(const std::string &wspecifier) : impl_(NULL) {
   if (wspecifier != "" && !Open(wspecifier))
@@ -1520,7 +1732,8 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDIIO_ERR << "Failed to close previously open writer.";
   }
   KALDIIO_ASSERT(impl_ == NULL);
-  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, NULL);
+  WspecifierOptions opts;
+  WspecifierType wtype = ClassifyWspecifier(wspecifier, NULL, NULL, &opts);
   switch (wtype) {
     case kBothWspecifier:
       impl_ = new TableWriterBothImpl<Holder>();
@@ -1536,13 +1749,21 @@ bool TableWriter<Holder>::Open(const std::string &wspecifier) {
       KALDIIO_WARN << "ClassifyWspecifier: invalid wspecifier " << wspecifier;
       return false;
   }
-  if (impl_->Open(wspecifier)) {
-    return true;
-  } else {  // The class will have printed a more specific warning.
+  if (!impl_->Open(wspecifier)) {
+    // The class will have printed a more specific warning.
     delete impl_;
     impl_ = NULL;
     return false;
   }
+  if (opts.background) {
+    impl_ = new TableWriterBackgroundImpl<Holder>(impl_, opts.flush);
+    if (!impl_->Open("")) {
+      // the wspecifier is ignored in that Open() call.
+      // It should only return false on code error.
+      return false;
+    }
+  }
+  return true;
 }
 
 template <class Holder>
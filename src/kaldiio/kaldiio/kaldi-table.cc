@@ -126,6 +126,8 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
   //  ark,scp,f:filename, wxfilename ->  kBothWspecifier
   // or:
   //  scp,t,nf:rxfilename -> kScriptWspecifier
+  // and the background option (bg):
+  //  ark,scp,bg:filename, wxfilename -> kBothWspecifier
 
   if (archive_wxfilename) archive_wxfilename->clear();
   if (script_wxfilename) script_wxfilename->clear();
@@ -162,6 +164,10 @@ WspecifierType ClassifyWspecifier(const std::string &wspecifier,
       if (opts) opts->binary = false;
     } else if (!strcmp(c, "p")) {
       if (opts) opts->permissive = true;
+    } else if (!strcmp(c, "bg")) {
+      if (opts) opts->background = true;
+    } else if (!strcmp(c, "idx")) {
+      if (opts) opts->index = true;
     } else if (!strcmp(c, "ark")) {
       if (ws == kNoWspecifier)
         ws = kArchiveWspecifier;
@@ -120,9 +120,20 @@ RspecifierType ClassifyRspecifier(const std::string &rspecifier,
 //  p means permissive mode, when writing to an "scp" file only: will ignore
 //     missing scp entries, i.e. won't write anything for those files but will
 //     return success status).
+//  idx means "index": when the archive is an actual file, writes the index
+//     of the archive to the archive filename plus ".idx" on Close(), for
+//     RandomAccessArkReader (see kaldi-ark-index.h).
+//  bg means "background": Write() queues a copy of the object and returns,
+//     and a background thread writes the queued objects in order, so that
+//     the caller overlaps computing the next object with the output.
+//     Objects are written in batches unless f is also given.  Errors of
+//     the background writes are raised by a later Write() or reported by
+//     Close().
 //
 //  So the following are valid wspecifiers:
 //  ark,b,f:foo
+//  ark,scp,bg:foo.ark,foo.scp
+//  ark,idx:foo.ark
 //  "ark,b,b:| gzip -c > foo"
 //  "ark,scp,t,nf:foo.ark,|gzip -c > foo.scp.gz"
 //  ark,b:-
@@ -163,7 +174,14 @@ struct WspecifierOptions {
   bool binary;
   bool flush;
   bool permissive;  // will ignore absent scp entries.
-  WspecifierOptions() : binary(true), flush(false), permissive(false) {}
+  bool background;  // objects are written in a background thread.
+  bool index;       // the archive index is written on Close().
+  WspecifierOptions()
+      : binary(true),
+        flush(false),
+        permissive(false),
+        background(false),
+        index(false) {}
 };
 
 // ClassifyWspecifier returns the type of the wspecifier string,
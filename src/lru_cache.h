@@ -0,0 +1,134 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef LRU_CACHE_H_
+#define LRU_CACHE_H_
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <utility>
+
+#include "common.h"
+#include "third_party/absl/container/flat_hash_map.h"
+
+namespace discretepiece {
+namespace model {
+
+// Hit/miss counters of LRUCache.
+struct LRUCacheStats {
+  uint64 hits = 0;
+  uint64 misses = 0;
+  uint64 evictions = 0;
+  size_t size = 0;
+  size_t capacity = 0;
+
+  double hit_rate() const {
+    const uint64 total = hits + misses;
+    return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+  }
+};
+
+// Bounded, thread-safe cache which evicts the least recently used entry.
+// A cache with zero capacity stores nothing and every lookup is a miss.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class LRUCache {
+ public:
+  LRUCache() = delete;
+  explicit LRUCache(size_t capacity) : capacity_(capacity) {}
+  virtual ~LRUCache() {}
+
+  // Copies the cached value of `key` to `value` and marks it as the most
+  // recently used. Returns false if `key` is not cached.
+  bool Lookup(const K &key, V *value) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = index_.find(key);
+      if (it != index_.end()) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+        *value = it->second->second;
+        ++hits_;
+        return true;
+      }
+    }
+    ++misses_;
+    return false;
+  }
+
+  // Inserts `value` for `key`, evicting the least recently used entries when
+  // the cache is full. An existing entry for `key` is overwritten.
+  void Insert(const K &key, const V &value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0) return;
+    const auto it = index_.find(key);
+    if (it != index_.end()) {
+      it->second->second = value;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+    entries_.emplace_front(key, value);
+    index_.emplace(key, entries_.begin());
+    EvictLocked();
+  }
+
+  // Changes the capacity. Shrinking evicts the oldest entries.
+  void SetCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    EvictLocked();
+  }
+
+  // Drops all entries. Counters are kept.
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+  }
+
+  LRUCacheStats stats() const {
+    LRUCacheStats stats;
+    stats.hits = hits_.load();
+    stats.misses = misses_.load();
+    stats.evictions = evictions_.load();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.size = entries_.size();
+    stats.capacity = capacity_;
+    return stats;
+  }
+
+ private:
+  using Entries = std::list<std::pair<K, V>>;
+
+  void EvictLocked() {
+    while (entries_.size() > capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+      ++evictions_;
+    }
+  }
+
+  mutable std::mutex mutex_;
+  size_t capacity_ = 0;
+
+  // Most recently used entry comes first.
+  Entries entries_;
+  absl::flat_hash_map<K, typename Entries::iterator, Hash> index_;
+
+  std::atomic<uint64> hits_{0};
+  std::atomic<uint64> misses_{0};
+  std::atomic<uint64> evictions_{0};
+};
+}  // namespace model
+}  // namespace discretepiece
+#endif  // LRU_CACHE_H_
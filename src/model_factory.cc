@@ -15,17 +15,21 @@
 #include "bpe_model.h"
 #include "model_factory.h"
 #include "third_party/absl/memory/memory.h"
+#include "unigram_model.h"
 
 namespace discretepiece {
 
 // Instantiate Model instance from |model_proto|
 std::unique_ptr<ModelInterface> ModelFactory::Create(
-    const ModelProto& model_proto) {
+    const ModelProto& model_proto, const ModelImage* image) {
   const auto& trainer_spec = model_proto.trainer_spec();
 
   switch (trainer_spec.model_type()) {
     case TrainerSpec::BPE:
-      return absl::make_unique<bpe::Model>(model_proto);
+      return absl::make_unique<bpe::Model>(model_proto, image);
+      break;
+    case TrainerSpec::UNIGRAM:
+      return absl::make_unique<unigram::Model>(model_proto, image);
       break;
     default:
       LOG(ERROR) << "Unknown model_type: " << trainer_spec.model_type();
@@ -18,13 +18,16 @@
 #include <memory>
 
 #include "discretepiece_model.pb.h"
+#include "model_interface.h"
 
 namespace discretepiece {
 
 class ModelFactory {
  public:
-  // Creates Model instance from |model_proto|.
-  static std::unique_ptr<ModelInterface> Create(const ModelProto &model_proto);
+  // Creates Model instance from |model_proto|. The tables are taken from
+  // |image| if not null, which must outlive the model.
+  static std::unique_ptr<ModelInterface> Create(const ModelProto &model_proto,
+                                                const ModelImage *image = nullptr);
 };
 }  // namespace discretepiece
 #endif  // MODEL_FACTORY_H_
@@ -0,0 +1,158 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include "model_image.h"
+
+#include <string.h>
+
+#include "filesystem.h"
+
+namespace discretepiece {
+namespace {
+
+constexpr char kMagic[4] = {'D', 'P', 'M', 'F'};
+constexpr uint32 kVersion = 1;
+constexpr size_t kHeaderSize = sizeof(kMagic) + 3 * sizeof(uint32) + sizeof(uint64);
+constexpr size_t kEntrySize = 2 * sizeof(uint32) + 2 * sizeof(uint64);
+constexpr size_t kTagSize = 4;
+
+template <typename T>
+T ReadValue(const char *p) {
+  T value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+template <typename T>
+void AppendValue(T value, std::string *out) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+}  // namespace
+
+ModelImage::~ModelImage() { Close(); }
+
+void ModelImage::Close() {
+  file_.Close();
+  data_ = nullptr;
+  size_ = 0;
+  sections_.clear();
+}
+
+util::Status ModelImage::Open(absl::string_view filename) {
+  Close();
+#ifdef IS_BIG_ENDIAN
+  return util::UnimplementedError(
+      "model images are little-endian and not supported on this host.");
+#endif
+
+  const std::string name(filename);
+  RETURN_IF_ERROR(file_.Open(filename));
+  data_ = file_.data();
+  size_ = file_.size();
+  CHECK_OR_RETURN(size_ >= kHeaderSize) << name << " is not a model image.";
+
+  CHECK_OR_RETURN(memcmp(data_, kMagic, sizeof(kMagic)) == 0)
+      << name << " is not a model image.";
+  const uint32 version = ReadValue<uint32>(data_ + 4);
+  CHECK_OR_RETURN(version == kVersion)
+      << name << ": unsupported model image version " << version << ".";
+  const uint32 num_sections = ReadValue<uint32>(data_ + 8);
+  fingerprint_ = ReadValue<uint64>(data_ + 16);
+  CHECK_OR_RETURN(num_sections <= (size_ - kHeaderSize) / kEntrySize)
+      << name << ": broken model image.";
+
+  for (uint32 i = 0; i < num_sections; ++i) {
+    const char *entry = data_ + kHeaderSize + i * kEntrySize;
+    const uint64 offset = ReadValue<uint64>(entry + 8);
+    const uint64 size = ReadValue<uint64>(entry + 16);
+    CHECK_OR_RETURN(offset % kAlignment == 0 && offset <= size_ &&
+                    size <= size_ - offset)
+        << name << ": broken model image.";
+    sections_.emplace_back(std::string(entry, kTagSize),
+                           absl::string_view(data_ + offset, size));
+  }
+
+  return util::OkStatus();
+}
+
+bool ModelImage::IsImageFile(absl::string_view filename) {
+  return filesystem::StartsWithMagic(
+      filename, absl::string_view(kMagic, sizeof(kMagic)));
+}
+
+util::Status ModelImage::section(absl::string_view tag,
+                                 absl::string_view *data) const {
+  for (const auto &s : sections_) {
+    if (s.first == tag) {
+      *data = s.second;
+      return util::OkStatus();
+    }
+  }
+  return util::InternalError(
+      std::string("model image has no section ") + std::string(tag) + ".");
+}
+
+bool ModelImage::has_section(absl::string_view tag) const {
+  for (const auto &s : sections_) {
+    if (s.first == tag) return true;
+  }
+  return false;
+}
+
+void ModelImageBuilder::Add(absl::string_view tag, std::string data) {
+  CHECK_EQ(tag.size(), kTagSize) << "section tags are 4 characters";
+  for (const auto &s : sections_) CHECK_NE(s.first, tag) << "duplicated section";
+  sections_.emplace_back(std::string(tag), std::move(data));
+}
+
+util::Status ModelImageBuilder::Write(absl::string_view filename,
+                                      uint64 fingerprint) const {
+#ifdef IS_BIG_ENDIAN
+  return util::UnimplementedError(
+      "model images are little-endian and not supported on this host.");
+#endif
+  std::string header(kMagic, sizeof(kMagic));
+  AppendValue(kVersion, &header);
+  AppendValue(static_cast<uint32>(sections_.size()), &header);
+  AppendValue(static_cast<uint32>(0), &header);
+  AppendValue(fingerprint, &header);
+
+  auto Align = [](uint64 offset) {
+    return (offset + ModelImage::kAlignment - 1) / ModelImage::kAlignment *
+           ModelImage::kAlignment;
+  };
+
+  uint64 offset = Align(kHeaderSize + sections_.size() * kEntrySize);
+  for (const auto &s : sections_) {
+    header.append(s.first);
+    AppendValue(static_cast<uint32>(0), &header);
+    AppendValue(offset, &header);
+    AppendValue(static_cast<uint64>(s.second.size()), &header);
+    offset = Align(offset + s.second.size());
+  }
+
+  std::string image = std::move(header);
+  for (const auto &s : sections_) {
+    image.resize(Align(image.size()), '\0');
+    image.append(s.second);
+  }
+
+  auto output = filesystem::NewWritableFile(filename, true);
+  RETURN_IF_ERROR(output->status());
+  CHECK_OR_RETURN(output->Write(image));
+  return output->Close();
+}
+
+}  // namespace discretepiece
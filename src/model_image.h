@@ -0,0 +1,93 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef MODEL_IMAGE_H_
+#define MODEL_IMAGE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "filesystem.h"
+#include "third_party/absl/strings/string_view.h"
+#include "util.h"
+
+namespace discretepiece {
+
+// Binary model file (.dpm) holding the tables built at load time, so that
+// loading maps the file and points the tables into it instead of parsing
+// the ModelProto and rebuilding them.
+//
+// The tables are used in place, so they are in the byte order of the
+// host. Images are little-endian, and big-endian hosts refuse to open or
+// write them.
+//
+// Layout, little-endian:
+//   "DPMF", uint32 version, uint32 num_sections, uint32 reserved,
+//   uint64 fingerprint of the original serialized ModelProto,
+//   num_sections * {char tag[4], uint32 reserved, uint64 offset, uint64 size},
+//   sections, each aligned to kAlignment bytes from the file start.
+//
+// The file is trusted in the same way as a .model file: the layout is
+// validated, but not that the tables agree with each other.
+class ModelImage {
+ public:
+  static constexpr size_t kAlignment = 64;
+
+  ModelImage() {}
+  ~ModelImage();
+
+  ModelImage(const ModelImage &) = delete;
+  ModelImage &operator=(const ModelImage &) = delete;
+
+  // Maps `filename` read-only, or reads it on Windows.
+  util::Status Open(absl::string_view filename);
+
+  // Returns true if `filename` starts with the magic of a model image.
+  static bool IsImageFile(absl::string_view filename);
+
+  // Returns the section `tag`, or an error if it is missing.
+  util::Status section(absl::string_view tag, absl::string_view *data) const;
+
+  // Returns true if the section `tag` exists.
+  bool has_section(absl::string_view tag) const;
+
+  // Fingerprint of the ModelProto the image was built from.
+  uint64 fingerprint() const { return fingerprint_; }
+
+ private:
+  void Close();
+
+  filesystem::MappedFile file_;
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  uint64 fingerprint_ = 0;
+  std::vector<std::pair<std::string, absl::string_view>> sections_;
+};
+
+// Collects the sections of a model image and writes the file.
+class ModelImageBuilder {
+ public:
+  // Adds a section. Tags are four characters and unique.
+  void Add(absl::string_view tag, std::string data);
+
+  util::Status Write(absl::string_view filename, uint64 fingerprint) const;
+
+ private:
+  std::vector<std::pair<std::string, std::string>> sections_;
+};
+
+}  // namespace discretepiece
+#endif  // MODEL_IMAGE_H_
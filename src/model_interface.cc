@@ -13,6 +13,8 @@
 // limitations under the License.!
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 
 #include "model_interface.h"
 #include "discretepiece_model.pb.h"
@@ -24,45 +26,347 @@
 
 namespace discretepiece {
 
+TokenSeq PieceTokens(const ModelProto::DiscretePiece &piece) {
+  if (piece.tokens_size() > 0) {
+    return TokenSeq(piece.tokens().begin(), piece.tokens().end());
+  }
+  return TokenSeq(string_util::StringToVectorChar32(piece.piece(), {}, '_'));
+}
+
+std::string PieceToString(const ModelProto::DiscretePiece &piece) {
+  if (piece.tokens_size() == 0) return piece.piece();
+  return string_util::VectorChar32ToString(
+      absl::MakeConstSpan(piece.tokens().data(), piece.tokens_size()), "_");
+}
+
 ModelInterface::ModelInterface(const ModelProto &model_proto): model_proto_(&model_proto), status_(util::OkStatus()) {}
 
 ModelInterface::~ModelInterface() {}
 
-int ModelInterface::PieceToId(const std::vector<char32> &piece) const {
-  auto it = pieces_.find(piece);
-  CHECK(it != pieces_.end()) << string_util::VectorChar32ToString(piece, "_") << " cannot found";
-  return it->second;  
+int ModelInterface::PieceToId(const TokenSeq &piece) const {
+  const int id = piece_table_.Find(absl::MakeConstSpan(piece.data(), piece.size()));
+  CHECK(id != PieceTable::kNotFound) << string_util::VectorChar32ToString(piece, "_") << " cannot found";
+  return id;
 }
 
-std::vector<char32> ModelInterface::IdToPiece(int id) const {
-  return string_util::StringToVectorChar32(model_proto_->pieces(id).piece(), {}, '_');
+TokenSeq ModelInterface::IdToPiece(int id) const {
+  const auto piece = GetPieceTokens(id);
+  return TokenSeq(piece.begin(), piece.end());
 }
 
 int ModelInterface::GetPieceSize() const {
-  if (!model_proto_) return 0;
-  return model_proto_->pieces_size();
+  return piece_table_.size();
 }
 
 float ModelInterface::GetScore(int id) const {
-  return model_proto_->pieces(id).score();
+  return scores_[id];
+}
+
+bool ModelInterface::IsSafeCut(absl::Span<const char32> input, size_t pos) const {
+  if (pos == 0) return true;
+  if (pos >= input.size()) return false;
+
+  const char32 left = input[pos - 1];
+  const char32 right = input[pos];
+  if (left == deliminator_char32_value_ || right == deliminator_char32_value_)
+    return true;
+
+  if (inner_bigrams_.Lookup(left, right) == PairTable::kNotFound) return true;
+
+  // Checks every substring of length <= max_piece_length_ spanning `pos`.
+  const size_t begin = pos >= static_cast<size_t>(max_piece_length_) - 1
+                           ? pos - max_piece_length_ + 1
+                           : 0;
+  for (size_t start = pos; start-- > begin;) {
+    if (input[start] == deliminator_char32_value_) break;
+    for (size_t end = pos; end - start < static_cast<size_t>(max_piece_length_);
+         ++end) {
+      // Not decidable until more tokens arrive.
+      if (end == input.size()) return false;
+      if (input[end] == deliminator_char32_value_) break;
+      if (piece_table_.Find(input.subspan(start, end + 1 - start)) !=
+          PieceTable::kNotFound) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+std::vector<size_t> ModelInterface::SplitAtSafeCuts(absl::Span<const char32> input,
+                                                    size_t window_size) const {
+  std::vector<size_t> cuts = {0};
+  size_t pos = std::max<size_t>(window_size, 1);
+  while (pos < input.size()) {
+    if (IsSafeCut(input, pos)) {
+      cuts.push_back(pos);
+      pos += std::max<size_t>(window_size, 1);
+    } else {
+      ++pos;
+    }
+  }
+  cuts.push_back(input.size());
+  return cuts;
+}
+
+namespace {
+
+// Calls `encode_window(w)` for every w in [0, num_windows) with
+// `num_threads` threads. Workers pick windows in order, so only one window
+// per thread is being encoded at a time.
+void ForEachWindowParallel(size_t num_windows, int num_threads,
+                           const std::function<void(size_t)> &encode_window) {
+  std::atomic<size_t> next_window(0);
+  ThreadPool pool(num_threads);
+  const int num_workers = std::min<size_t>(num_threads, num_windows);
+  for (int n = 0; n < num_workers; ++n) {
+    pool.Schedule([&encode_window, &next_window, num_windows]() {
+      for (size_t w = next_window++; w < num_windows; w = next_window++) {
+        encode_window(w);
+      }
+    });
+  }
+}
+
+}  // namespace
+
+void ModelInterface::EncodeIds(absl::Span<const char32> normalized,
+                               std::vector<int> *ids) const {
+  for (const auto &p : Encode(normalized)) {
+    ids->push_back(p.second);
+  }
+}
+
+void ModelInterface::EncodeIdsBatch(
+    const std::vector<absl::Span<const char32>> &inputs,
+    std::vector<std::vector<int>> *ids) const {
+  ids->resize(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    (*ids)[i].clear();
+    EncodeIds(inputs[i], &(*ids)[i]);
+  }
+}
+
+util::Status ModelInterface::EncodeIdsTruncated(absl::Span<const char32> /*normalized*/,
+                                                int /*max_piece_id*/,
+                                                std::vector<int> * /*ids*/) const {
+  return util::UnimplementedError(
+      "vocabulary truncation is not supported by this model.");
+}
+
+util::Status ModelInterface::TruncatedIdsToIds(absl::Span<const int> /*ids*/,
+                                               int /*max_piece_id*/,
+                                               std::vector<int> * /*full_ids*/) const {
+  return util::UnimplementedError(
+      "vocabulary truncation is not supported by this model.");
+}
+
+EncodeResult ModelInterface::EncodeLongestMatch(absl::Span<const char32> normalized) const {
+  std::vector<int> ids;
+  EncodeIdsLongestMatch(normalized, &ids);
+  return PiecesFromIds(normalized, ids);
+}
+
+void ModelInterface::EncodeIdsLongestMatch(absl::Span<const char32> normalized,
+                                           std::vector<int> *ids) const {
+  if (!status().ok() || normalized.empty()) {
+    return;
+  }
+
+  size_t begin = 0;
+  while (begin < normalized.size()) {
+    if (normalized[begin] == deliminator_char32_value_) {
+      ++begin;
+      continue;
+    }
+    // Pieces are reported shortest first, so the last one is the longest.
+    int best_id = -1;
+    size_t best_length = 0;
+    trie_.PrefixSearch(normalized.subspan(begin, max_piece_length_),
+                       [&best_id, &best_length](size_t length, int id) {
+                         best_id = id;
+                         best_length = length;
+                       });
+    CHECK_GE(best_id, 0) << normalized[begin] << " cannot found";
+    ids->push_back(best_id);
+    begin += best_length;
+  }
 }
 
-void ModelInterface::InitializePieces() {
-  pieces_.clear();
+EncodeResult ModelInterface::EncodeWithMode(absl::Span<const char32> normalized,
+                                            EncodeMode mode) const {
+  return mode == EncodeMode::kLongestMatch ? EncodeLongestMatch(normalized)
+                                           : Encode(normalized);
+}
+
+void ModelInterface::EncodeIdsWithMode(absl::Span<const char32> normalized,
+                                       EncodeMode mode,
+                                       std::vector<int> *ids) const {
+  if (mode == EncodeMode::kLongestMatch) {
+    EncodeIdsLongestMatch(normalized, ids);
+  } else {
+    EncodeIds(normalized, ids);
+  }
+}
+
+EncodeResult ModelInterface::EncodeParallel(absl::Span<const char32> normalized,
+                                            EncodeMode mode, int num_threads,
+                                            size_t window_size) const {
+  if (num_threads <= 1 || normalized.size() < 2 * window_size) {
+    return EncodeWithMode(normalized, mode);
+  }
+
+  const std::vector<size_t> cuts = SplitAtSafeCuts(normalized, window_size);
+  const size_t num_windows = cuts.size() - 1;
+  std::vector<EncodeResult> results(num_windows);
+  ForEachWindowParallel(num_windows, num_threads, [&](size_t w) {
+    results[w] = EncodeWithMode(normalized.subspan(cuts[w], cuts[w + 1] - cuts[w]), mode);
+  });
+
+  size_t output_size = 0;
+  for (const auto &result : results) output_size += result.size();
+  EncodeResult output;
+  output.reserve(output_size);
+  for (auto &result : results) {
+    std::move(result.begin(), result.end(), std::back_inserter(output));
+    EncodeResult().swap(result);
+  }
+  return output;
+}
+
+void ModelInterface::EncodeIdsParallel(absl::Span<const char32> normalized,
+                                       EncodeMode mode, int num_threads,
+                                       size_t window_size,
+                                       std::vector<int> *ids) const {
+  if (num_threads <= 1 || normalized.size() < 2 * window_size) {
+    EncodeIdsWithMode(normalized, mode, ids);
+    return;
+  }
+
+  const std::vector<size_t> cuts = SplitAtSafeCuts(normalized, window_size);
+  const size_t num_windows = cuts.size() - 1;
+  std::vector<std::vector<int>> results(num_windows);
+  ForEachWindowParallel(num_windows, num_threads, [&](size_t w) {
+    EncodeIdsWithMode(normalized.subspan(cuts[w], cuts[w + 1] - cuts[w]), mode,
+                      &results[w]);
+  });
+
+  size_t output_size = ids->size();
+  for (const auto &result : results) output_size += result.size();
+  ids->reserve(output_size);
+  for (const auto &result : results) {
+    ids->insert(ids->end(), result.begin(), result.end());
+  }
+}
+
+EncodeResult ModelInterface::PiecesFromIds(absl::Span<const char32> normalized,
+                                           const std::vector<int> &ids) const {
+  EncodeResult output;
+  output.reserve(ids.size());
+  size_t pos = 0;
+  for (const int id : ids) {
+    while (normalized[pos] == deliminator_char32_value_) ++pos;
+    const size_t size = GetPieceLength(id);
+    output.emplace_back(TokenSeq(normalized.data() + pos, size), id);
+    pos += size;
+  }
+  return output;
+}
+
+void ModelInterface::InitializePieces(const ModelImage *image) {
+  max_piece_length_ = 0;
+  deliminator_map_.clear();
+
+  for (char c: model_proto_->trainer_spec().deliminator()) {
+    deliminator_map_.emplace(c, deliminator_char32_value_);
+  }
+
+  status_ = image == nullptr ? BuildTables() : LoadTables(*image);
+  if (!status_.ok()) return;
+
+  for (int id = 0; id < GetPieceSize(); ++id) {
+    max_piece_length_ = std::max(max_piece_length_, GetPieceLength(id));
+  }
+
+  tuple_vocab_ = TupleVocab();
+  if (num_codebooks() > 1) {
+    absl::string_view data = model_proto_->tuple_vocab();
+    if (image != nullptr) {
+      status_ = image->section("TUPV", &data);
+      if (!status_.ok()) return;
+    }
+    status_ = tuple_vocab_.Init(data);
+    if (status_.ok() && tuple_vocab_.num_codebooks() != num_codebooks()) {
+      status_ = util::InternalError("tuple vocab does not match num_codebooks.");
+    }
+  }
+}
+
+util::Status ModelInterface::BuildTables() {
+  std::vector<TokenSeq> pieces;
+  std::vector<float> scores;
+  std::vector<std::pair<std::pair<int, int>, int>> bigrams;
+  absl::flat_hash_set<uint64> seen_bigrams;
+  pieces.reserve(model_proto_->pieces_size());
+  scores.reserve(model_proto_->pieces_size());
 
   for (int i = 0; i < model_proto_->pieces_size(); ++i) {
     const auto &sp = model_proto_->pieces(i);
-    if (sp.piece().empty()) {
-      status_ = util::InternalError("piece must not be empty.");
-      return;
+    pieces.push_back(PieceTokens(sp));
+    CHECK_OR_RETURN(!pieces.back().empty()) << "piece must not be empty.";
+    scores.push_back(sp.score());
+    const TokenSeq &piece = pieces.back();
+    for (size_t j = 1; j < piece.size(); ++j) {
+      if (seen_bigrams.insert((static_cast<uint64>(piece[j - 1]) << 32) | piece[j]).second) {
+        bigrams.push_back(std::make_pair(std::make_pair(piece[j - 1], piece[j]), 0));
+      }
     }
+  }
 
-    if (!port::InsertIfNotPresent(&pieces_, IdToPiece(i), i)) {
-        status_ = util::InternalError(sp.piece() + " is already defined.");
-      return;
-    }
+  // Lookups return the first of equal pieces, so duplicates are found here.
+  piece_table_.Build(pieces);
+  for (int i = 0; i < model_proto_->pieces_size(); ++i) {
+    CHECK_OR_RETURN(piece_table_.Find(pieces[i]) == i)
+        << PieceToString(model_proto_->pieces(i)) << " is already defined.";
+  }
+  scores_.assign(std::move(scores));
+  inner_bigrams_.Build(bigrams);
+
+  std::vector<std::pair<TokenSeq, int>> trie_pieces;
+  trie_pieces.reserve(pieces.size());
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    trie_pieces.emplace_back(std::move(pieces[i]), i);
   }
+  RETURN_IF_ERROR(trie_.Build(trie_pieces));
+
+  return word_dictionary_.Init(model_proto_->word_dictionary(),
+                               piece_table_.size());
 }
 
+util::Status ModelInterface::LoadTables(const ModelImage &image) {
+  absl::string_view data;
+  RETURN_IF_ERROR(image.section("PIEC", &data));
+  RETURN_IF_ERROR(piece_table_.Init(data));
+  RETURN_IF_ERROR(image.section("SCOR", &data));
+  CHECK_OR_RETURN(scores_.InitFromBytes(data) &&
+                  scores_.size() == static_cast<size_t>(piece_table_.size()))
+      << "broken scores.";
+  RETURN_IF_ERROR(image.section("TRIE", &data));
+  RETURN_IF_ERROR(trie_.Init(data));
+  RETURN_IF_ERROR(image.section("BIGR", &data));
+  RETURN_IF_ERROR(inner_bigrams_.Init(data));
+  RETURN_IF_ERROR(image.section("WDIC", &data));
+  return word_dictionary_.Init(data, piece_table_.size());
+}
+
+void ModelInterface::SaveImage(ModelImageBuilder *builder) const {
+  builder->Add("PIEC", piece_table_.Serialize());
+  builder->Add("SCOR", std::string(scores_.bytes()));
+  builder->Add("TRIE", trie_.Serialize());
+  builder->Add("BIGR", inner_bigrams_.Serialize());
+  builder->Add("WDIC", word_dictionary_.Serialize());
+  builder->Add("TUPV", num_codebooks() > 1 ? tuple_vocab_.Serialize() : "");
+}
 
 }  // namespace discretepiece
@@ -24,25 +24,44 @@
 
 #include "common.h"
 #include "discretepiece_model.pb.h"
+#include "flat_array.h"
+#include "lru_cache.h"
+#include "model_image.h"
+#include "pair_table.h"
+#include "piece_table.h"
+#include "piece_trie.h"
+#include "token_seq.h"
+#include "tuple_vocab.h"
 #include "third_party/absl/container/flat_hash_map.h"
 #include "third_party/absl/strings/string_view.h"
-#include "third_party/darts_clone/darts.h"
+#include "third_party/absl/types/span.h"
 #include "util.h"
+#include "word_dictionary.h"
 
 namespace discretepiece {
 
-using EncodeResult = std::vector<std::pair<std::vector<char32>, int>>;
+using EncodeResult = std::vector<std::pair<TokenSeq, int>>;
+
+// Segmentation algorithm used in encoding.
+enum class EncodeMode {
+  kModel,         // the algorithm of the model, e.g. BPE merges.
+  kLongestMatch,  // left-to-right greedy longest match over all pieces.
+};
 
 // declared in discretepiece_model.proto
 class ModelProto;
 
+// Returns the tokens of `piece`, parsed from its string in models written
+// before pieces were stored as packed tokens.
+TokenSeq PieceTokens(const ModelProto::DiscretePiece &piece);
+
+// Returns the text form of `piece`, its tokens joined by "_".
+std::string PieceToString(const ModelProto::DiscretePiece &piece);
+
 // Underlying model interface.
 // Given a index string, returns a sequence of pieces with ids.
 class ModelInterface {
  public:
-  
-  using PieceToIdMap = absl::flat_hash_map<std::vector<char32>, int, port::VectorChar32Hash>;
-
   // `model_proto` should not be deleted until ModelInterface is destroyed.
   explicit ModelInterface(const ModelProto &model_proto);
 
@@ -57,16 +76,133 @@ class ModelInterface {
   virtual const ModelProto &model_proto() const { return *model_proto_; }
 
   // Given a normalized string, returns a sequence of sentence pieces with ids.
-  // The concatenation of pieces must be the same as `normalized`.
-  virtual EncodeResult Encode(const std::vector<char32> &normalized) const = 0;
+  // The concatenation of pieces must be the same as `normalized` with
+  // deliminators removed.
+  virtual EncodeResult Encode(absl::Span<const char32> normalized) const = 0;
+
+  // Same as Encode(), but only appends the ids to `ids`. Models override it
+  // to skip building the pieces.
+  virtual void EncodeIds(absl::Span<const char32> normalized,
+                         std::vector<int> *ids) const;
+
+  // Encodes every span of `inputs` and stores the ids in (*ids)[i]. The
+  // result is the same as EncodeIds() on each input; models override it to
+  // share work across many short inputs.
+  virtual void EncodeIdsBatch(const std::vector<absl::Span<const char32>> &inputs,
+                              std::vector<std::vector<int>> *ids) const;
+
+  // Segments `normalized` by walking the piece trie from left to right and
+  // taking the longest piece at every position. Costs O(n * L) with the
+  // longest piece length L, but may differ from Encode().
+  EncodeResult EncodeLongestMatch(absl::Span<const char32> normalized) const;
+
+  // EncodeIds() version of EncodeLongestMatch().
+  void EncodeIdsLongestMatch(absl::Span<const char32> normalized,
+                             std::vector<int> *ids) const;
+
+  // Dispatches to Encode() or EncodeLongestMatch().
+  EncodeResult EncodeWithMode(absl::Span<const char32> normalized,
+                              EncodeMode mode) const;
+
+  // Dispatches to EncodeIds() or EncodeIdsLongestMatch().
+  void EncodeIdsWithMode(absl::Span<const char32> normalized, EncodeMode mode,
+                         std::vector<int> *ids) const;
+
+  // Encodes a long `normalized` sequence with `num_threads` threads.
+  // The input is split into windows of at least `window_size` tokens, each
+  // extended to the next cut accepted by IsSafeCut(), and the windows are
+  // encoded in parallel. The result is the same as
+  // EncodeWithMode(normalized, mode).
+  EncodeResult EncodeParallel(absl::Span<const char32> normalized,
+                              EncodeMode mode, int num_threads,
+                              size_t window_size) const;
+
+  // EncodeIds() version of EncodeParallel().
+  void EncodeIdsParallel(absl::Span<const char32> normalized, EncodeMode mode,
+                         int num_threads, size_t window_size,
+                         std::vector<int> *ids) const;
+
+  // Returns cut positions [0, c_1, ..., input.size()] such that every window
+  // [c_i, c_i+1) has at least `window_size` tokens, except the last one,
+  // and no piece spans any c_i.
+  std::vector<size_t> SplitAtSafeCuts(absl::Span<const char32> input,
+                                      size_t window_size) const;
+
+  // Encodes `normalized` as the same model trained with a vocabulary of
+  // `max_piece_id + 1` pieces would, and appends the ids of that smaller
+  // model to `ids`. Not supported by default.
+  virtual util::Status EncodeIdsTruncated(absl::Span<const char32> normalized,
+                                          int max_piece_id,
+                                          std::vector<int> *ids) const;
+
+  // Maps `ids` returned by EncodeIdsTruncated() with `max_piece_id` to the
+  // ids of this model. Fails if `max_piece_id` or an id is out of range.
+  // Not supported by default.
+  virtual util::Status TruncatedIdsToIds(absl::Span<const int> ids,
+                                         int max_piece_id,
+                                         std::vector<int> *full_ids) const;
+
+  // Returns hit/miss statistics of the chunk encoding cache.
+  virtual model::LRUCacheStats GetEncodeCacheStats() const { return {}; }
+
+  // Sets the number of chunks kept in the encoding cache. 0 disables it.
+  // The cache is the only mutable state of a model and is shared by every
+  // user of the model, so this is const and thread-safe.
+  virtual void SetEncodeCacheSize(size_t /*size*/) const {}
+
+  // Returns true if no piece can span the boundary between input[pos - 1]
+  // and input[pos], so encoding input[0, pos) and input[pos, size)
+  // independently is the same as encoding `input` at once. Besides the two
+  // neighbors, at most GetMaxPieceLength() - 1 tokens on each side of `pos`
+  // are inspected and only if the bigram at `pos` occurs inside some piece.
+  // Tokens beyond the end of `input` are treated as unknown: returns false
+  // when a piece might span `pos` once more tokens are appended.
+  bool IsSafeCut(absl::Span<const char32> input, size_t pos) const;
+
+  // Returns the length of the longest piece.
+  int GetMaxPieceLength() const { return max_piece_length_; }
+
+  // Returns the mapping from deliminator characters in the text input to
+  // the char32 value used in Encode().
+  const absl::flat_hash_map<char, char32> &deliminator_map() const {
+    return deliminator_map_;
+  }
+
+  // Returns the char32 value of deliminators in Encode().
+  char32 deliminator_char32_value() const { return deliminator_char32_value_; }
+
+  // Returns true if runs of the same token are collapsed before encoding.
+  bool collapse_repeats() const {
+    return model_proto_ != nullptr &&
+           model_proto_->trainer_spec().collapse_repeats();
+  }
+
+  // Returns the number of codebooks of an input position. Inputs of models
+  // with more than one are flattened tuples, see TupleVocab.
+  int num_codebooks() const {
+    return model_proto_ == nullptr ? 1
+                                   : model_proto_->trainer_spec().num_codebooks();
+  }
+
+  // Returns the dense ids of the tuples. Pieces and the input of Encode()
+  // are sequences of these ids when num_codebooks() > 1.
+  const TupleVocab &tuple_vocab() const { return tuple_vocab_; }
 
   // Returns the vocab id of `piece`.
   // piece are vector of char32(uint32_t)
-  virtual int PieceToId(const std::vector<char32> &piece) const;
+  virtual int PieceToId(const TokenSeq &piece) const;
 
   // Returns the representation of vocab with `id`.
   // id must be 0 <= id < GetPieceSize().
-  virtual std::vector<char32> IdToPiece(int id) const;
+  virtual TokenSeq IdToPiece(int id) const;
+
+  // Same as IdToPiece(), without a copy. The span lives as long as the model.
+  absl::Span<const char32> GetPieceTokens(int id) const {
+    return piece_table_.GetPiece(id);
+  }
+
+  // Returns the number of tokens in the piece of `id`.
+  int GetPieceLength(int id) const { return piece_table_.GetLength(id); }
 
   // Returns the size of sentence pieces, which is the same
   // as the size of vocabulary for NMT.
@@ -77,18 +213,57 @@ class ModelInterface {
   // We can roughly estimate the unigram frequency of the piece.
   virtual float GetScore(int id) const;
 
+  // Adds the tables built at load time to `builder`, so that a model
+  // created from the image skips building them. See ModelImage.
+  virtual void SaveImage(ModelImageBuilder *builder) const;
+
 protected:
-  void InitializePieces();
+  // Builds the tables from the pieces of model_proto_, or points them into
+  // `image` if not null. `image` must outlive the model.
+  void InitializePieces(const ModelImage *image = nullptr);
+
+  // Builds piece_table_, scores_, inner_bigrams_, trie_ and
+  // word_dictionary_ from model_proto_.
+  util::Status BuildTables();
+
+  // Points the same tables into the sections of `image`.
+  util::Status LoadTables(const ModelImage &image);
+
+  // Slices `normalized` into the pieces of `ids`, which must be the encoding
+  // of `normalized`. Deliminators are skipped.
+  EncodeResult PiecesFromIds(absl::Span<const char32> normalized,
+                             const std::vector<int> &ids) const;
 
   // Non-virtual (inlined) implementation for faster execution.
-  inline float GetScoreInlined(int id) const {
-    return model_proto_->pieces(id).score();
-  }
+  inline float GetScoreInlined(int id) const { return scores_[id]; }
 
   const ModelProto *model_proto_ = nullptr;
 
-  // piece -> id map for normal pieces
-  PieceToIdMap pieces_;
+  // Tokens of all pieces, parsed once at load, and tokens -> id.
+  PieceTable piece_table_;
+
+  // id -> score, copied out of the proto for faster access.
+  FlatArray<float> scores_;
+
+  // Trie over all pieces, returning piece ids.
+  PieceTrie trie_;
+
+  // Precomputed encodings of frequent chunks, checked before segmenting.
+  WordDictionary word_dictionary_;
+
+  // Tuple -> dense id, used when num_codebooks() > 1.
+  TupleVocab tuple_vocab_;
+
+  // Bigrams appearing inside any piece, mapped to 0. A boundary whose
+  // bigram is not here can never be spanned by a piece.
+  PairTable inner_bigrams_;
+
+  // Length of the longest piece.
+  int max_piece_length_ = 0;
+
+  // Mapping deliminator to a special char32 value, the same as the trainer.
+  absl::flat_hash_map<char, char32> deliminator_map_;
+  const char32 deliminator_char32_value_ = std::numeric_limits<char32>::max();
 
   // status.
   util::Status status_;
@@ -0,0 +1,191 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef PAIR_TABLE_H_
+#define PAIR_TABLE_H_
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "flat_array.h"
+#include "third_party/absl/strings/string_view.h"
+#include "util.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SPM_PAIR_TABLE_AVX2 1
+#endif
+
+namespace discretepiece {
+
+// Open addressing hash from a pair of piece ids (left, right) to the id of
+// the piece they merge into. Keys and values are stored in separate arrays
+// so that LookupBatch() can probe eight pairs at once with AVX2 gathers.
+// The arrays are one flat block, so a serialized table is used in place.
+class PairTable {
+ public:
+  // Returned by the lookups when the pair does not merge.
+  static constexpr int kNotFound = -1;
+
+  PairTable() {}
+
+  // Builds the table from ((left, right), merged) entries. Ids must be
+  // non-negative and pairs unique.
+  void Build(const std::vector<std::pair<std::pair<int, int>, int>> &entries) {
+    uint32 capacity = 16;
+    while (capacity < 2 * entries.size()) capacity *= 2;
+
+    // capacity, left[capacity], right[capacity], value[capacity]
+    std::vector<uint32> words(1 + 3 * capacity, kEmpty);
+    words[0] = capacity;
+    uint32 *left = words.data() + 1;
+    uint32 *right = left + capacity;
+    uint32 *value = right + capacity;
+    SetCapacity(capacity);
+    for (const auto &e : entries) {
+      uint32 slot = Slot(e.first.first, e.first.second);
+      while (left[slot] != kEmpty) slot = (slot + 1) & (capacity - 1);
+      left[slot] = e.first.first;
+      right[slot] = e.first.second;
+      value[slot] = e.second;
+    }
+    words_.assign(std::move(words));
+  }
+
+  // Serialized as little-endian uint32: capacity, then the left, right and
+  // value arrays of `capacity` entries each.
+  std::string Serialize() const { return std::string(words_.bytes()); }
+
+  // Loads a table serialized by Serialize(). `data` must outlive the table.
+  util::Status Init(absl::string_view data) {
+    CHECK_OR_RETURN(words_.InitFromBytes(data) && !words_.empty())
+        << "broken pair table.";
+    const uint32 capacity = words_[0];
+    CHECK_OR_RETURN(capacity > 0 && (capacity & (capacity - 1)) == 0 &&
+                    words_.size() == 1 + 3 * static_cast<uint64>(capacity))
+        << "broken pair table.";
+    SetCapacity(capacity);
+    CHECK_OR_RETURN(std::find(left_keys(), left_keys() + capacity, kEmpty) !=
+                    left_keys() + capacity)
+        << "broken pair table.";
+    return util::OkStatus();
+  }
+
+  // Returns the merged id of (left, right), or kNotFound.
+  int Lookup(uint32 left, uint32 right) const {
+    if (capacity_ == 0) return kNotFound;
+    return Probe(left, right, Slot(left, right));
+  }
+
+  // Looks up the pairs (left[i], right[i]) for i in [0, n) into out[i].
+  void LookupBatch(const uint32 *left, const uint32 *right, size_t n,
+                   int *out) const {
+    size_t i = 0;
+#ifdef SPM_PAIR_TABLE_AVX2
+    if (use_avx2_) i = LookupBatchAVX2(left, right, n, out);
+#endif
+    for (; i < n; ++i) out[i] = Lookup(left[i], right[i]);
+  }
+
+ private:
+  static constexpr uint32 kEmpty = 0xFFFFFFFF;
+  static constexpr uint32 kLeftMul = 0x9E3779B1;
+  static constexpr uint32 kRightMul = 0x85EBCA77;
+
+  uint32 Slot(uint32 left, uint32 right) const {
+    return (left * kLeftMul ^ right * kRightMul) >> shift_;
+  }
+
+  void SetCapacity(uint32 capacity) {
+    capacity_ = capacity;
+    shift_ = 32;
+    for (uint32 c = capacity_; c > 1; c /= 2) --shift_;
+  }
+
+  const uint32 *left_keys() const { return words_.data() + 1; }
+  const uint32 *right_keys() const { return left_keys() + capacity_; }
+  const int *values() const {
+    return reinterpret_cast<const int *>(right_keys() + capacity_);
+  }
+
+  int Probe(uint32 left, uint32 right, uint32 slot) const {
+    const uint32 *lefts = left_keys();
+    const uint32 *rights = right_keys();
+    for (;; slot = (slot + 1) & (capacity_ - 1)) {
+      if (lefts[slot] == kEmpty) return kNotFound;
+      if (lefts[slot] == left && rights[slot] == right) return values()[slot];
+    }
+  }
+
+#ifdef SPM_PAIR_TABLE_AVX2
+  // Resolves the first probe of eight pairs at a time and falls back to
+  // Probe() for the lanes which collide. Returns the number of pairs done.
+  __attribute__((target("avx2"))) size_t LookupBatchAVX2(
+      const uint32 *left, const uint32 *right, size_t n, int *out) const {
+    if (capacity_ == 0) return 0;
+    const __m256i left_mul = _mm256_set1_epi32(kLeftMul);
+    const __m256i right_mul = _mm256_set1_epi32(kRightMul);
+    const __m128i shift = _mm_cvtsi32_si128(shift_);
+    const __m256i empty = _mm256_set1_epi32(kEmpty);
+    const int *left_base = reinterpret_cast<const int *>(left_keys());
+    const int *right_base = reinterpret_cast<const int *>(right_keys());
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m256i l =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(left + i));
+      const __m256i r =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(right + i));
+      const __m256i slot = _mm256_srl_epi32(
+          _mm256_xor_si256(_mm256_mullo_epi32(l, left_mul),
+                           _mm256_mullo_epi32(r, right_mul)),
+          shift);
+      const __m256i sl = _mm256_i32gather_epi32(left_base, slot, 4);
+      const __m256i sr = _mm256_i32gather_epi32(right_base, slot, 4);
+      const __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi32(sl, l),
+                                           _mm256_cmpeq_epi32(sr, r));
+      const __m256i miss = _mm256_cmpeq_epi32(sl, empty);
+      const __m256i value = _mm256_mask_i32gather_epi32(
+          _mm256_set1_epi32(kNotFound), values(), slot, hit, 4);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), value);
+
+      // Lanes which are neither a hit nor an empty slot keep probing.
+      const int done = _mm256_movemask_ps(
+          _mm256_castsi256_ps(_mm256_or_si256(hit, miss)));
+      if (done != 0xFF) {
+        alignas(32) uint32 slots[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(slots), slot);
+        for (int k = 0; k < 8; ++k) {
+          if (!(done & (1 << k))) {
+            out[i + k] = Probe(left[i + k], right[i + k],
+                               (slots[k] + 1) & (capacity_ - 1));
+          }
+        }
+      }
+    }
+    return i;
+  }
+
+  bool use_avx2_ = __builtin_cpu_supports("avx2");
+#endif
+
+  uint32 capacity_ = 0;
+  uint32 shift_ = 32;
+  FlatArray<uint32> words_;
+};
+
+}  // namespace discretepiece
+#endif  // PAIR_TABLE_H_
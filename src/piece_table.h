@@ -0,0 +1,150 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef PIECE_TABLE_H_
+#define PIECE_TABLE_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "flat_array.h"
+#include "third_party/absl/strings/string_view.h"
+#include "third_party/absl/types/span.h"
+#include "token_seq.h"
+#include "util.h"
+
+namespace discretepiece {
+
+// Tokens of all pieces in one flat array, indexed by id, with an open
+// addressing hash from the tokens back to the id. Lookups take a span, so
+// a range of the input is looked up without copying it.
+//
+// The serialized form is an array of little-endian uint32:
+//   num_pieces, num_buckets (a power of 2),
+//   offsets[num_pieces + 1]: piece i is tokens[offsets[i], offsets[i + 1]),
+//   buckets[num_buckets]: 1 + id of the piece, or 0,
+//   tokens.
+class PieceTable {
+ public:
+  // Returned by Find() for unknown pieces.
+  static constexpr int kNotFound = -1;
+
+  PieceTable() {}
+
+  // Builds the table. Pieces must be unique; the index of a piece is its id.
+  void Build(const std::vector<TokenSeq> &pieces) {
+    uint32 num_buckets = 1;
+    while (num_buckets < 2 * pieces.size()) num_buckets *= 2;
+
+    std::vector<uint32> words = {static_cast<uint32>(pieces.size()), num_buckets};
+    uint32 offset = 0;
+    words.push_back(offset);
+    for (const auto &piece : pieces) words.push_back(offset += piece.size());
+
+    std::vector<uint32> buckets(num_buckets, 0);
+    for (size_t id = 0; id < pieces.size(); ++id) {
+      uint32 b = HashTokens(pieces[id].data(), pieces[id].size()) &
+                 (num_buckets - 1);
+      while (buckets[b] != 0) b = (b + 1) & (num_buckets - 1);
+      buckets[b] = id + 1;
+    }
+    words.insert(words.end(), buckets.begin(), buckets.end());
+    for (const auto &piece : pieces) {
+      words.insert(words.end(), piece.begin(), piece.end());
+    }
+    words_.assign(std::move(words));
+    Index();
+  }
+
+  std::string Serialize() const { return std::string(words_.bytes()); }
+
+  // Loads a table serialized by Serialize(). `data` must outlive the table.
+  util::Status Init(absl::string_view data) {
+    CHECK_OR_RETURN(words_.InitFromBytes(data) && words_.size() >= 3)
+        << "broken piece table.";
+    const uint64 num_pieces = words_[0];
+    const uint64 num_buckets = words_[1];
+    CHECK_OR_RETURN(num_buckets > 0 && (num_buckets & (num_buckets - 1)) == 0 &&
+                    words_.size() >= 2 + num_pieces + 1 + num_buckets)
+        << "broken piece table.";
+    Index();
+    const uint32 *offsets = offsets_begin();
+    const uint32 *buckets = buckets_begin();
+    CHECK_OR_RETURN(offsets[0] == 0 &&
+                    offsets[num_pieces] == words_.size() - tokens_pos_)
+        << "broken piece table.";
+    for (uint64 i = 0; i < num_pieces; ++i) {
+      CHECK_OR_RETURN(offsets[i] <= offsets[i + 1]) << "broken piece table.";
+    }
+    bool has_empty = false;
+    for (uint64 b = 0; b < num_buckets; ++b) {
+      CHECK_OR_RETURN(buckets[b] <= num_pieces) << "broken piece table.";
+      has_empty |= buckets[b] == 0;
+    }
+    CHECK_OR_RETURN(has_empty) << "broken piece table.";
+    return util::OkStatus();
+  }
+
+  // Returns the id of `piece`, or kNotFound.
+  int Find(absl::Span<const char32> piece) const {
+    if (num_buckets_ == 0) return kNotFound;
+    const uint32 *buckets = buckets_begin();
+    for (uint32 b = HashTokens(piece.data(), piece.size()) &
+                    (num_buckets_ - 1);;
+         b = (b + 1) & (num_buckets_ - 1)) {
+      const uint32 entry = buckets[b];
+      if (entry == 0) return kNotFound;
+      const auto candidate = GetPiece(entry - 1);
+      if (candidate.size() == piece.size() &&
+          std::equal(piece.begin(), piece.end(), candidate.begin())) {
+        return entry - 1;
+      }
+    }
+  }
+
+  absl::Span<const char32> GetPiece(int id) const {
+    const uint32 *offsets = offsets_begin();
+    return absl::MakeConstSpan(words_.data() + tokens_pos_ + offsets[id],
+                               offsets[id + 1] - offsets[id]);
+  }
+
+  int GetLength(int id) const {
+    const uint32 *offsets = offsets_begin();
+    return offsets[id + 1] - offsets[id];
+  }
+
+  // Returns the number of pieces.
+  int size() const { return num_pieces_; }
+
+ private:
+  const uint32 *offsets_begin() const { return words_.data() + 2; }
+  const uint32 *buckets_begin() const { return offsets_begin() + num_pieces_ + 1; }
+
+  // Reads the header of words_.
+  void Index() {
+    num_pieces_ = words_[0];
+    num_buckets_ = words_[1];
+    tokens_pos_ = 2 + num_pieces_ + 1 + num_buckets_;
+  }
+
+  FlatArray<uint32> words_;
+  int num_pieces_ = 0;
+  uint32 num_buckets_ = 0;
+  size_t tokens_pos_ = 0;
+};
+
+}  // namespace discretepiece
+#endif  // PIECE_TABLE_H_
@@ -0,0 +1,128 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef PIECE_TRIE_H_
+#define PIECE_TRIE_H_
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "flat_array.h"
+#include "third_party/absl/strings/string_view.h"
+#include "third_party/absl/types/span.h"
+#include "third_party/darts_clone/darts.h"
+#include "token_seq.h"
+#include "util.h"
+
+namespace discretepiece {
+
+// Double-array trie over pieces, mapping each piece to its id.
+// Darts keys are byte strings without NUL, so every token is spelled in
+// base 127, most significant digit first. The last byte is in [1, 127]
+// and the others in [128, 255]: no byte is zero and the spelling of a
+// token is never a prefix of another one.
+class PieceTrie {
+ public:
+  // Maximum number of bytes of a token.
+  static constexpr size_t kMaxLabelSize = 5;
+
+  PieceTrie() {}
+
+  // Builds the trie from (piece, id) pairs. Ids must be non-negative.
+  util::Status Build(const std::vector<std::pair<TokenSeq, int>> &pieces) {
+    std::vector<std::pair<std::string, int>> keys;
+    keys.reserve(pieces.size());
+    char label[kMaxLabelSize];
+    for (const auto &p : pieces) {
+      std::string key;
+      for (const char32 c : p.first) {
+        key.append(label, SpellToken(c, label));
+      }
+      keys.emplace_back(std::move(key), p.second);
+    }
+
+    // Darts requires the keys sorted by bytes.
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<const char *> key_ptrs(keys.size());
+    std::vector<size_t> lengths(keys.size());
+    std::vector<int> values(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      key_ptrs[i] = keys[i].first.data();
+      lengths[i] = keys[i].first.size();
+      values[i] = keys[i].second;
+    }
+
+    array_.clear();
+    units_.clear();
+    if (array_.build(key_ptrs.size(), key_ptrs.data(), lengths.data(),
+                     values.data()) != 0) {
+      return util::InternalError("cannot build double-array.");
+    }
+    return util::OkStatus();
+  }
+
+  // Serialized as the units of the double array.
+  std::string Serialize() const {
+    return std::string(static_cast<const char *>(array_.array()),
+                       array_.total_size());
+  }
+
+  // Loads a trie serialized by Serialize(). `data` must outlive the trie.
+  util::Status Init(absl::string_view data) {
+    CHECK_OR_RETURN(units_.InitFromBytes(data) && !units_.empty())
+        << "broken piece trie.";
+    array_.set_array(units_.data(), units_.size());
+    return util::OkStatus();
+  }
+
+  // Calls `fn(length, id)` for every piece which is a prefix of `input`,
+  // shortest first.
+  template <typename Fn>
+  void PrefixSearch(absl::Span<const char32> input, Fn fn) const {
+    char label[kMaxLabelSize];
+    size_t node_pos = 0;
+    for (size_t i = 0; i < input.size(); ++i) {
+      size_t key_pos = 0;
+      const int id =
+          array_.traverse(label, node_pos, key_pos, SpellToken(input[i], label));
+      if (id == -2) return;
+      if (id >= 0) fn(i + 1, id);
+    }
+  }
+
+ private:
+  // Writes the spelling of `c` to `label` and returns its length.
+  static size_t SpellToken(char32 c, char *label) {
+    char digits[kMaxLabelSize];
+    size_t n = 0;
+    digits[n++] = static_cast<char>(c % 127 + 1);
+    for (c /= 127; c > 0; c /= 127) {
+      digits[n++] = static_cast<char>(0x80 | (c % 127));
+    }
+    std::reverse_copy(digits, digits + n, label);
+    return n;
+  }
+
+  Darts::DoubleArray array_;
+
+  // Units of array_ when loaded by Init().
+  FlatArray<uint32> units_;
+};
+
+}  // namespace discretepiece
+#endif  // PIECE_TRIE_H_
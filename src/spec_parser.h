@@ -122,6 +122,7 @@ inline std::string PrintProto(const TrainerSpec &message,
 
   static const std::map<TrainerSpec::ModelType, std::string> kModelType_Map = {
       {TrainerSpec::BPE, "BPE"},
+      {TrainerSpec::UNIGRAM, "UNIGRAM"},
       // for future extension
   };
 
@@ -132,6 +133,9 @@ inline std::string PrintProto(const TrainerSpec &message,
   PRINT_PARAM(num_threads);
   PRINT_PARAM(num_sub_iterations);
   PRINT_PARAM(max_discretepiece_length);
+  PRINT_PARAM(collapse_repeats);
+  PRINT_PARAM(word_dictionary_size);
+  PRINT_PARAM(num_codebooks);
   PRINT_PARAM(vocabulary_output_piece_score);
 
   os << "}\n";
@@ -0,0 +1,45 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include <string>
+
+#include "common.h"
+#include "init.h"
+#include "io_utils.h"
+#include "third_party/absl/flags/flag.h"
+
+ABSL_FLAG(std::string, input, "", "kaldi archive to index, an actual file such as foo.ark");
+ABSL_FLAG(std::string, output, "", "index to write, the archive filename plus .idx if empty");
+
+int main(int argc, char *argv[]) {
+  discretepiece::ScopedResourceDestructor cleaner;
+  discretepiece::ParseCommandLineFlags(argv[0], &argc, &argv, true);
+
+  const std::string input = absl::GetFlag(FLAGS_input);
+  CHECK(!input.empty()) << "--input should not be empty";
+  const std::string output =
+      absl::GetFlag(FLAGS_output).empty() ? input + ".idx" : absl::GetFlag(FLAGS_output);
+
+  bool ok = false;
+  if (io_utils::DetectKaldiValueType("ark:" + input) == io_utils::KaldiValueType::INT32_VECTOR) {
+    ok = kaldiio::BuildArkIndex<kaldiio::BasicVectorHolder<int32_t>>(input, output);
+  } else {
+    ok = kaldiio::BuildArkIndex<kaldiio::KaldiObjectHolder<io_utils::FloatMatrix>>(input, output);
+  }
+  CHECK(ok) << "failed to index " << input;
+
+  LOG(INFO) << "Saved " << output;
+
+  return 0;
+}
@@ -11,6 +11,9 @@
 
 ABSL_FLAG(std::string, input_model, "", "model file to convert");
 ABSL_FLAG(std::string, output_model_prefix, "", "model file after convert");
+ABSL_FLAG(bool, write_legacy_piece, true,
+          "also store every piece as a string, so that older readers can load "
+          "the model");
 
 int main(int argc, char *argv[]) {
   discretepiece::ScopedResourceDestructor cleaner;
@@ -49,7 +52,9 @@ int main(int argc, char *argv[]) {
     
     auto *sp = new_model_proto.add_pieces();
     sp->set_type(discretepiece::ModelProto::DiscretePiece::NORMAL);
-    sp->set_piece(discretepiece::string_util::VectorChar32ToString(old_piece_ids, "_"));
+    sp->mutable_tokens()->Add(old_piece_ids.begin(), old_piece_ids.end());
+    if (absl::GetFlag(FLAGS_write_legacy_piece))
+      sp->set_piece(discretepiece::string_util::VectorChar32ToString(old_piece_ids, "_"));
     sp->set_score(old_piece_score);
   }
 
@@ -57,7 +62,8 @@ int main(int argc, char *argv[]) {
   {
     auto output = discretepiece::filesystem::NewWritableFile(absl::GetFlag(FLAGS_output_model_prefix) + ".model", true);
     CHECK(output->status().ok()) << "error opening output model file: " << absl::GetFlag(FLAGS_output_model_prefix) + ".model";
-    output->Write(new_model_proto.SerializeAsString());    
+    CHECK(output->Write(new_model_proto.SerializeAsString())) << "error writing model";
+    CHECK_OK(output->Close());
   }
   {
     auto output = discretepiece::filesystem::NewWritableFile(absl::GetFlag(FLAGS_output_model_prefix) + ".vocab", true);
@@ -65,9 +71,11 @@ int main(int argc, char *argv[]) {
 
     for (const auto &piece: new_model_proto.pieces()) {
       std::ostringstream os;
-      os << piece.piece() << "\t" << piece.score();
+      const std::vector<char32> tokens(piece.tokens().begin(), piece.tokens().end());
+      os << discretepiece::string_util::VectorChar32ToString(tokens, "_") << "\t" << piece.score();
       CHECK(output->WriteLine(os.str())) << "error writing piece: " << os.str();
     }
+    CHECK_OK(output->Close());
   }
 
   return 0;
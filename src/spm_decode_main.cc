@@ -0,0 +1,154 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "filesystem.h"
+#include "init.h"
+#include "util.h"
+#include "io_utils.h"
+#include "discretepiece_processor.h"
+#include "third_party/absl/flags/flag.h"
+#include "third_party/absl/memory/memory.h"
+
+ABSL_FLAG(std::string, model, "", "model file name");
+ABSL_FLAG(std::string, input, "", "input filename of piece ids, text or kaldi rspecifier");
+ABSL_FLAG(std::string, output, "", "output filename, text or kaldi wspecifier");
+ABSL_FLAG(std::string, kaldi_value_type, "float_matrix",
+          "type of the values of kaldi output: float_matrix of shape (t, num_codebooks) or "
+          "int32_vector of the flattened tuples. Kaldi input of either type is detected");
+ABSL_FLAG(std::string, durations_input, "",
+          "if not empty, the durations written by spm_encode --durations_output, in the "
+          "same order as --input. Every token is repeated by its duration");
+ABSL_FLAG(int32, max_piece_id, -1,
+          "if not negative, the input ids were encoded with spm_encode --max_piece_id");
+ABSL_FLAG(int32, num_threads, 1, "number of threads decoding utterances of a batch");
+ABSL_FLAG(int32, batch_size, 1024,
+          "number of utterances read and decoded together. The output keeps the input order");
+
+namespace {
+
+// Calls `fn(i)` for every i in [0, size) with `num_threads` threads.
+void ParallelFor(size_t size, int num_threads, const std::function<void(size_t)> &fn) {
+  if (num_threads <= 1 || size <= 1) {
+    for (size_t i = 0; i < size; ++i) fn(i);
+    return;
+  }
+  std::atomic<size_t> next(0);
+  discretepiece::ThreadPool pool(num_threads);
+  const int num_workers = std::min<size_t>(num_threads, size);
+  for (int n = 0; n < num_workers; ++n) {
+    pool.Schedule([&fn, &next, size]() {
+      for (size_t i = next++; i < size; i = next++) fn(i);
+    });
+  }
+}
+
+std::vector<int> ToIds(const std::vector<char32> &value) {
+  return std::vector<int>(value.begin(), value.end());
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  discretepiece::ScopedResourceDestructor cleaner;
+  discretepiece::ParseCommandLineFlags(argv[0], &argc, &argv, true);
+
+  CHECK(!absl::GetFlag(FLAGS_model).empty()) << "empty --model";
+  const int max_piece_id = absl::GetFlag(FLAGS_max_piece_id);
+  const bool has_durations = !absl::GetFlag(FLAGS_durations_input).empty();
+  if (max_piece_id >= 0) {
+    CHECK(!has_durations) << "--durations_input is not supported with --max_piece_id";
+  }
+  const int num_threads = absl::GetFlag(FLAGS_num_threads);
+  CHECK_GT(num_threads, 0) << "--num_threads should be positive";
+  const int batch_size = absl::GetFlag(FLAGS_batch_size);
+  CHECK_GT(batch_size, 0) << "--batch_size should be positive";
+
+  discretepiece::DiscretePieceProcessor sp;
+  CHECK_OK(sp.Load(absl::GetFlag(FLAGS_model)));
+
+  auto index_reader = io_utils::GeneralIndexReader(absl::GetFlag(FLAGS_input));
+  std::unique_ptr<io_utils::GeneralIndexReader> durations_reader;
+  if (has_durations) {
+    durations_reader = absl::make_unique<io_utils::GeneralIndexReader>(
+        absl::GetFlag(FLAGS_durations_input));
+  }
+  io_utils::KaldiValueType kaldi_value_type;
+  CHECK(io_utils::ParseKaldiValueType(absl::GetFlag(FLAGS_kaldi_value_type), &kaldi_value_type))
+      << "unknown --kaldi_value_type " << absl::GetFlag(FLAGS_kaldi_value_type);
+  auto index_writer = io_utils::GeneralIndexWriter(absl::GetFlag(FLAGS_output),
+                                                   sp.num_codebooks(), kaldi_value_type);
+
+  std::vector<std::string> keys;
+  std::vector<std::vector<int>> ids, durations;
+  std::vector<std::vector<char32>> decoded;
+  std::vector<std::string> texts;
+  auto FlushBatch = [&]() {
+    if (keys.empty()) return;
+    decoded.assign(keys.size(), std::vector<char32>());
+    texts.resize(keys.size());
+    ParallelFor(keys.size(), num_threads, [&](size_t i) {
+      discretepiece::util::Status status;
+      if (has_durations) {
+        status = sp.Decode(ids[i], durations[i], &decoded[i]);
+      } else if (max_piece_id >= 0) {
+        status = sp.Decode(ids[i], max_piece_id, &decoded[i]);
+      } else {
+        status = sp.Decode(ids[i], &decoded[i]);
+      }
+      CHECK(status.ok()) << keys[i] << ": " << status.ToString();
+      // Text is formatted by the workers as well, only writing is serial.
+      if (index_writer.IsText()) {
+        texts[i] = io_utils::GeneralIndexWriter::FormatTokens(decoded[i], sp.num_codebooks());
+      }
+    });
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (index_writer.IsText()) {
+        index_writer.WriteText(keys[i], texts[i]);
+      } else {
+        index_writer.Write(keys[i], decoded[i]);
+      }
+    }
+    keys.clear();
+    ids.clear();
+    durations.clear();
+  };
+
+  size_t num_utterances = 0;
+  for (; !index_reader.Done(); index_reader.Next()) {
+    keys.push_back(index_reader.Key());
+    ids.push_back(ToIds(index_reader.Value()));
+    if (durations_reader) {
+      CHECK(!durations_reader->Done()) << "no durations for " << keys.back();
+      CHECK_EQ(durations_reader->Key(), keys.back()) << "keys of --durations_input do not match";
+      durations.push_back(ToIds(durations_reader->Value()));
+      durations_reader->Next();
+    }
+    ++num_utterances;
+    if (keys.size() == static_cast<size_t>(batch_size)) FlushBatch();
+  }
+  CHECK(!durations_reader || durations_reader->Done())
+      << "keys of --durations_input do not match";
+  FlushBatch();
+
+  LOG(INFO) << "Decoded " << num_utterances << " utterances";
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include <string>
+
+#include "common.h"
+#include "discretepiece_processor.h"
+#include "init.h"
+#include "util.h"
+#include "third_party/absl/flags/flag.h"
+
+ABSL_FLAG(std::string, input_model, "", "model file to convert, .model or .dpm");
+ABSL_FLAG(std::string, output_model, "", "model image (.dpm) to write");
+
+int main(int argc, char *argv[]) {
+  discretepiece::ScopedResourceDestructor cleaner;
+  discretepiece::ParseCommandLineFlags(argv[0], &argc, &argv, true);
+
+  CHECK(!absl::GetFlag(FLAGS_input_model).empty()) << "--input_model should not be empty";
+  CHECK(!absl::GetFlag(FLAGS_output_model).empty()) << "--output_model should not be empty";
+
+  discretepiece::DiscretePieceProcessor sp;
+  CHECK_OK(sp.Load(absl::GetFlag(FLAGS_input_model)));
+  CHECK_OK(sp.SaveImage(absl::GetFlag(FLAGS_output_model)));
+
+  LOG(INFO) << "Saved " << absl::GetFlag(FLAGS_output_model);
+
+  return 0;
+}
@@ -0,0 +1,144 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+// Reports how often the greedy longest-match segmentation differs from the
+// model's own segmentation on a sample corpus.
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "discretepiece_processor.h"
+#include "init.h"
+#include "io_utils.h"
+#include "third_party/absl/flags/flag.h"
+#include "util.h"
+
+ABSL_FLAG(std::string, model, "", "model file name");
+ABSL_FLAG(std::string, input, "", "input filename, text or kaldi rspecifier");
+ABSL_FLAG(std::uint64_t, max_sentences, 0,
+          "maximum number of sentences to compare, 0 for all");
+
+namespace {
+
+// Returns the end positions of the pieces of `ids` in the input tokens,
+// skipping deliminators.
+std::vector<size_t> PieceEnds(const discretepiece::DiscretePieceProcessor &sp,
+                              const std::vector<int> &ids) {
+  std::vector<size_t> ends;
+  ends.reserve(ids.size());
+  size_t pos = 0;
+  for (const int id : ids) {
+    pos += sp.IdToPiece(id).size();
+    ends.push_back(pos);
+  }
+  return ends;
+}
+
+// Returns the number of elements in exactly one of the sorted `a` and `b`.
+size_t SymmetricDifferenceSize(const std::vector<size_t> &a,
+                               const std::vector<size_t> &b) {
+  size_t i = 0, j = 0, n = 0;
+  while (i < a.size() && j < b.size()) {
+    if (a[i] == b[j]) {
+      ++i;
+      ++j;
+    } else if (a[i] < b[j]) {
+      ++i;
+      ++n;
+    } else {
+      ++j;
+      ++n;
+    }
+  }
+  return n + (a.size() - i) + (b.size() - j);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  discretepiece::ScopedResourceDestructor cleaner;
+  discretepiece::ParseCommandLineFlags(argv[0], &argc, &argv, true);
+
+  CHECK(!absl::GetFlag(FLAGS_model).empty()) << "empty --model";
+  CHECK(!absl::GetFlag(FLAGS_input).empty()) << "empty --input";
+
+  discretepiece::DiscretePieceProcessor sp;
+  CHECK_OK(sp.Load(absl::GetFlag(FLAGS_model)));
+  sp.SetEncodeCacheSize(0);
+
+  using Clock = std::chrono::steady_clock;
+  Clock::duration model_time{0}, longest_match_time{0};
+
+  uint64 num_sentences = 0, num_diff_sentences = 0;
+  uint64 num_tokens = 0, num_model_pieces = 0, num_longest_match_pieces = 0;
+  uint64 num_diff_boundaries = 0;
+
+  const uint64 max_sentences = absl::GetFlag(FLAGS_max_sentences);
+  auto index_reader = io_utils::GeneralIndexReader(absl::GetFlag(FLAGS_input),
+                                                   sp.deliminator_map(),
+                                                   sp.num_codebooks());
+  for (; !index_reader.Done(); index_reader.Next()) {
+    if (max_sentences > 0 && num_sentences >= max_sentences) break;
+    const std::vector<char32> &value = index_reader.Value();
+
+    std::vector<int> model_ids, longest_match_ids;
+    auto start = Clock::now();
+    sp.SetEncodeMode(discretepiece::EncodeMode::kModel);
+    CHECK_OK(sp.Encode(value, &model_ids));
+    model_time += Clock::now() - start;
+
+    start = Clock::now();
+    sp.SetEncodeMode(discretepiece::EncodeMode::kLongestMatch);
+    CHECK_OK(sp.Encode(value, &longest_match_ids));
+    longest_match_time += Clock::now() - start;
+
+    ++num_sentences;
+    num_model_pieces += model_ids.size();
+    num_longest_match_pieces += longest_match_ids.size();
+    const auto model_ends = PieceEnds(sp, model_ids);
+    if (!model_ends.empty()) num_tokens += model_ends.back();
+    if (model_ids != longest_match_ids) {
+      ++num_diff_sentences;
+      num_diff_boundaries +=
+          SymmetricDifferenceSize(model_ends, PieceEnds(sp, longest_match_ids));
+    }
+  }
+
+  auto Ratio = [](uint64 a, uint64 b) {
+    return b == 0 ? 0.0 : static_cast<double>(a) / b;
+  };
+  auto Seconds = [](Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  };
+
+  std::cout << std::fixed << std::setprecision(4)
+            << "sentences: " << num_sentences << "\n"
+            << "tokens: " << num_tokens << "\n"
+            << "sentences_differ: " << num_diff_sentences << " ("
+            << Ratio(num_diff_sentences, num_sentences) << ")\n"
+            << "pieces_model: " << num_model_pieces << " ("
+            << Ratio(num_tokens, num_model_pieces) << " tokens/piece)\n"
+            << "pieces_longest_match: " << num_longest_match_pieces << " ("
+            << Ratio(num_tokens, num_longest_match_pieces) << " tokens/piece)\n"
+            << "boundaries_differ: " << num_diff_boundaries << " ("
+            << Ratio(num_diff_boundaries, num_model_pieces) << " of model boundaries)\n"
+            << "time_model_sec: " << Seconds(model_time) << "\n"
+            << "time_longest_match_sec: " << Seconds(longest_match_time) << std::endl;
+
+  return 0;
+}
@@ -22,67 +22,262 @@
 #include "util.h"
 #include "io_utils.h"
 #include "discretepiece_processor.h"
+#include "encode_cache.h"
 #include "third_party/absl/container/flat_hash_map.h"
 #include "third_party/absl/flags/flag.h"
+#include "third_party/absl/memory/memory.h"
 #include "third_party/absl/strings/str_cat.h"
 #include "third_party/absl/strings/str_join.h"
 
 ABSL_FLAG(std::string, model, "", "model file name");
 ABSL_FLAG(std::string, output_format, "piece", "choose from piece or id");
+ABSL_FLAG(std::string, encode_mode, "model",
+          "choose from model or longest_match. longest_match segments with a greedy longest "
+          "match over all pieces, which is faster but may differ from the model's segmentation");
+ABSL_FLAG(int32, max_piece_id, -1,
+          "if not negative, outputs the ids of the same BPE model trained with a vocabulary of "
+          "max_piece_id + 1 pieces. Only valid with --output_format id");
 ABSL_FLAG(std::string, input, "", "input filename");
 ABSL_FLAG(std::string, output, "", "output filename");
+ABSL_FLAG(std::string, kaldi_value_type, "float_matrix",
+          "type of the values of kaldi output: float_matrix of shape (t, 1) or int32_vector, "
+          "which stores ids exactly. Kaldi input of either type is detected");
+ABSL_FLAG(std::string, durations_output, "",
+          "if not empty, writes the duration of every token of the output, i.e. the length "
+          "of the run it was collapsed from when the model collapses repeats, to this file "
+          "in the same format as --output");
+ABSL_FLAG(bool, streaming, false,
+          "streaming mode: each input line carries the next tokens of the current stream "
+          "(no key), and one line with the pieces that became stable is written and flushed "
+          "per input line. An empty line ends the stream.");
+ABSL_FLAG(int32, num_threads, 1,
+          "number of threads to encode a long sequence in parallel windows");
+ABSL_FLAG(int32, parallel_window_size, 16384,
+          "minimum number of tokens per window in parallel encoding");
+ABSL_FLAG(int32, batch_size, 1,
+          "number of utterances encoded together in lockstep, which is faster for many "
+          "short utterances. Only valid with --output_format id");
+ABSL_FLAG(std::string, encode_cache_dir, "",
+          "if not empty, encoded utterances are stored in an append log in this existing "
+          "directory, keyed by model, utterance key and input, and reused by later runs");
+ABSL_FLAG(int32, encode_cache_size, 65536, "number of deliminator-separated chunks kept in the encoding cache, 0 to disable");
 
+namespace {
+
+// The views live as long as `model`.
+std::vector<absl::string_view> IdsToPieces(const discretepiece::CompiledModel &model,
+                                           const std::vector<int> &ids) {
+  std::vector<absl::string_view> str_pieces;
+  str_pieces.reserve(ids.size());
+  for (const int id : ids) str_pieces.push_back(model.IdToPieceString(id));
+  return str_pieces;
+}
+
+std::string FormatIds(const discretepiece::CompiledModel &model,
+                      const std::vector<int> &ids) {
+  if (absl::GetFlag(FLAGS_output_format) == "id") {
+    return absl::StrJoin(ids, " ");
+  }
+  std::string output;
+  for (const int id : ids) {
+    if (!output.empty()) output.push_back(' ');
+    output.append(model.IdToPieceString(id));
+  }
+  return output;
+}
+
+// Encodes line-delimited token chunks of a stream and flushes the stable
+// pieces after every line.
+void EncodeStreaming(const discretepiece::DiscretePieceProcessor &sp,
+                     const discretepiece::CompiledModel &model) {
+  auto input = discretepiece::filesystem::NewReadableFile(absl::GetFlag(FLAGS_input));
+  CHECK_OK(input->status());
+  auto output = discretepiece::filesystem::NewWritableFile(absl::GetFlag(FLAGS_output));
+  CHECK_OK(output->status());
+
+  auto encoder = sp.NewStreamingEncoder();
+  const discretepiece::string_util::TokenParser parser(sp.deliminator_map());
+  absl::string_view line;
+  bool has_pending = false;
+  while (input->ReadLine(&line)) {
+    if (line.empty()) {
+      CHECK_OK(encoder->Finish());
+      has_pending = false;
+    } else {
+      std::vector<char32> tokens;
+      if (sp.num_codebooks() > 1) {
+        CHECK(discretepiece::string_util::StringToTuples(line, sp.deliminator_map(),
+                                                         sp.num_codebooks(), &tokens))
+            << "each token should be a tuple of " << sp.num_codebooks()
+            << " integer tokens: " << line;
+      } else {
+        CHECK(parser.Parse(line, &tokens)) << "tokens should be integers: " << line;
+      }
+      CHECK_OK(encoder->AcceptTokens(tokens));
+      has_pending = true;
+    }
+    CHECK(output->WriteLine(FormatIds(model, encoder->PopStableIds())));
+    CHECK(output->Flush());
+  }
+
+  if (has_pending) {
+    CHECK_OK(encoder->Finish());
+    CHECK(output->WriteLine(FormatIds(model, encoder->PopStableIds())));
+  }
+  CHECK_OK(output->Close());
+}
+
+}  // namespace
 
 int main(int argc, char *argv[]) {
   discretepiece::ScopedResourceDestructor cleaner;
   discretepiece::ParseCommandLineFlags(argv[0], &argc, &argv, true);
   
   CHECK(!absl::GetFlag(FLAGS_model).empty()) << "empty --model";
+  CHECK(
+    absl::GetFlag(FLAGS_encode_mode) == "model" ||
+    absl::GetFlag(FLAGS_encode_mode) == "longest_match"
+  ) << "--encode_mode should be model or longest_match";
   CHECK(
     absl::GetFlag(FLAGS_output_format) == "piece" || 
     absl::GetFlag(FLAGS_output_format) == "id"
   ) << "--output_format should be piece or id, piece is only allowed in text output format";
 
+  const int max_piece_id = absl::GetFlag(FLAGS_max_piece_id);
+  if (max_piece_id >= 0) {
+    CHECK(absl::GetFlag(FLAGS_output_format) == "id") << "--max_piece_id is only valid with --output_format id";
+    CHECK(absl::GetFlag(FLAGS_encode_mode) == "model") << "--max_piece_id is only valid with --encode_mode model";
+    CHECK(!absl::GetFlag(FLAGS_streaming)) << "--max_piece_id is not supported with --streaming";
+  }
+
   // check whether kaldi output
+  const int batch_size = absl::GetFlag(FLAGS_batch_size);
+  CHECK_GT(batch_size, 0) << "--batch_size should be positive";
+  if (batch_size > 1) {
+    CHECK(absl::GetFlag(FLAGS_output_format) == "id") << "--batch_size is only valid with --output_format id";
+    CHECK_LT(max_piece_id, 0) << "--batch_size is not supported with --max_piece_id";
+    CHECK(!absl::GetFlag(FLAGS_streaming)) << "--batch_size is not supported with --streaming";
+  }
+
   if (io_utils::is_valid_kaldi_wspec(absl::GetFlag(FLAGS_output)))
     CHECK(absl::GetFlag(FLAGS_output_format) != "piece") << "--output_format piece is not valid in kaldi output";
+  io_utils::KaldiValueType kaldi_value_type;
+  CHECK(io_utils::ParseKaldiValueType(absl::GetFlag(FLAGS_kaldi_value_type), &kaldi_value_type))
+      << "unknown --kaldi_value_type " << absl::GetFlag(FLAGS_kaldi_value_type);
 
   discretepiece::DiscretePieceProcessor sp;
   CHECK_OK(sp.Load(absl::GetFlag(FLAGS_model)));
+  CHECK_GE(absl::GetFlag(FLAGS_encode_cache_size), 0) << "--encode_cache_size should not be negative";
+  sp.SetEncodeCacheSize(absl::GetFlag(FLAGS_encode_cache_size));
+  CHECK_GT(absl::GetFlag(FLAGS_parallel_window_size), 0) << "--parallel_window_size should be positive";
+  sp.SetEncodeThreads(absl::GetFlag(FLAGS_num_threads), absl::GetFlag(FLAGS_parallel_window_size));
+  if (absl::GetFlag(FLAGS_encode_mode) == "longest_match")
+    sp.SetEncodeMode(discretepiece::EncodeMode::kLongestMatch);
+  // Pieces are formatted from this snapshot without copies.
+  const auto model = sp.compiled_model();
 
-  auto index_reader = io_utils::GeneralIndexReader(absl::GetFlag(FLAGS_input));
-  auto index_writer = io_utils::GeneralIndexWriter(absl::GetFlag(FLAGS_output));
+  if (absl::GetFlag(FLAGS_streaming)) {
+    CHECK(!io_utils::is_valid_kaldi_rspec(absl::GetFlag(FLAGS_input)) &&
+          !io_utils::is_valid_kaldi_wspec(absl::GetFlag(FLAGS_output)))
+        << "--streaming only supports text input and output";
+    CHECK(absl::GetFlag(FLAGS_durations_output).empty())
+        << "--durations_output is not supported with --streaming";
+    CHECK(absl::GetFlag(FLAGS_encode_cache_dir).empty())
+        << "--encode_cache_dir is not supported with --streaming";
+    EncodeStreaming(sp, *model);
+    return 0;
+  }
 
-  for (; !index_reader.Done(); index_reader.Next()) {
-    std::string key = index_reader.Key();
-    std::vector<char32> value = index_reader.Value();
+  auto index_reader = io_utils::GeneralIndexReader(absl::GetFlag(FLAGS_input), sp.deliminator_map(),
+                                                   sp.num_codebooks());
+  auto index_writer = io_utils::GeneralIndexWriter(absl::GetFlag(FLAGS_output), 1,
+                                                   kaldi_value_type);
+  std::unique_ptr<io_utils::GeneralIndexWriter> durations_writer;
+  if (!absl::GetFlag(FLAGS_durations_output).empty()) {
+    durations_writer = absl::make_unique<io_utils::GeneralIndexWriter>(
+        absl::GetFlag(FLAGS_durations_output), 1, kaldi_value_type);
+  }
 
-    if (absl::GetFlag(FLAGS_output_format) == "piece") {
-      std::vector<std::vector<char32>> pieces;
-      CHECK_OK(sp.Encode(value, &pieces));
-      std::vector<std::string> str_pieces(pieces.size());
-      std::transform(
-        pieces.begin(), pieces.end(),
-        str_pieces.begin(),
-        [] (const std::vector<char32> &s) {
-          return discretepiece::string_util::VectorChar32ToString(s, "_");
-        }
-      );
-      index_writer.WritePieces(key, str_pieces);
+  // The cache of one model also depends on the flags changing the ids.
+  std::unique_ptr<discretepiece::EncodeCache> encode_cache;
+  if (!absl::GetFlag(FLAGS_encode_cache_dir).empty()) {
+    uint64 fingerprint = discretepiece::port::FingerprintCat(
+        sp.model_fingerprint(), static_cast<uint64>(sp.encode_mode()));
+    fingerprint = discretepiece::port::FingerprintCat(
+        fingerprint, static_cast<uint64>(max_piece_id));
+    encode_cache = absl::make_unique<discretepiece::EncodeCache>();
+    CHECK_OK(encode_cache->Open(absl::GetFlag(FLAGS_encode_cache_dir), fingerprint));
+    LOG(INFO) << "Loaded " << encode_cache->size() << " cached utterances";
+  }
+  const bool need_durations = durations_writer || encode_cache;
+  size_t num_cached = 0;
 
+  auto WriteResult = [&](const std::string &key, const std::vector<int> &ids,
+                         const std::vector<int> &durations) {
+    if (absl::GetFlag(FLAGS_output_format) == "piece") {
+      index_writer.WritePieces(key, IdsToPieces(*model, ids));
     } else {
-      std::vector<int> encoded_value;
-      CHECK_OK(sp.Encode(value, &encoded_value));
-      std::vector<char32> encoded_value_char32(encoded_value.size());
-      std::transform(
-        encoded_value.begin(), encoded_value.end(),
-        encoded_value_char32.begin(), 
-        [] (int v) { return static_cast<char32>(v); }
-      );
-      index_writer.Write(key, encoded_value_char32);
+      index_writer.WriteIds(key, ids);
+    }
+    if (durations_writer) durations_writer->WriteIds(key, durations);
+  };
 
+  // Utterances waiting to be encoded with EncodeBatch().
+  std::vector<std::string> batch_keys;
+  std::vector<std::vector<char32>> batch_values;
+  auto FlushBatch = [&]() {
+    if (batch_keys.empty()) return;
+    std::vector<absl::Span<const char32>> inputs(batch_values.begin(), batch_values.end());
+    std::vector<std::vector<int>> encoded_values, durations;
+    CHECK_OK(sp.EncodeBatch(inputs, &encoded_values, need_durations ? &durations : nullptr));
+    durations.resize(batch_keys.size());
+    for (size_t i = 0; i < batch_keys.size(); ++i) {
+      if (encode_cache) {
+        CHECK_OK(encode_cache->Insert(batch_keys[i], inputs[i], encoded_values[i], durations[i]));
+      }
+      WriteResult(batch_keys[i], encoded_values[i], durations[i]);
     }
+    batch_keys.clear();
+    batch_values.clear();
+  };
+
+  for (; !index_reader.Done(); index_reader.Next()) {
+    const std::string key = index_reader.Key();
+    const std::vector<char32> &value = index_reader.Value();
+
+    std::vector<int> ids, durations;
+    if (encode_cache && encode_cache->Lookup(key, value, &ids, &durations)) {
+      FlushBatch();
+      WriteResult(key, ids, durations);
+      ++num_cached;
+      continue;
+    }
+
+    if (batch_size > 1) {
+      batch_keys.push_back(key);
+      batch_values.push_back(value);
+      if (batch_keys.size() == static_cast<size_t>(batch_size)) FlushBatch();
+      continue;
+    }
+
+    if (max_piece_id >= 0) {
+      CHECK_OK(sp.Encode(value, max_piece_id, &ids, need_durations ? &durations : nullptr));
+    } else {
+      CHECK_OK(sp.Encode(value, &ids, need_durations ? &durations : nullptr));
+    }
+    if (encode_cache) CHECK_OK(encode_cache->Insert(key, value, ids, durations));
+    WriteResult(key, ids, durations);
   }
+  FlushBatch();
+  if (encode_cache) {
+    CHECK_OK(encode_cache->Close());
+    LOG(INFO) << "Reused " << num_cached << " utterances from --encode_cache_dir";
+  }
+
+  const auto cache_stats = sp.GetEncodeCacheStats();
+  LOG(INFO) << "Encoding cache: hits=" << cache_stats.hits
+            << " misses=" << cache_stats.misses
+            << " hit_rate=" << cache_stats.hit_rate();
 
   return 0;
 }
@@ -32,10 +32,10 @@ static discretepiece::TrainerSpec kDefaultTrainerSpec;
 
 ABSL_FLAG(std::string, input, "", "comma separated list of input sentences");
 ABSL_FLAG(std::string, input_format, kDefaultTrainerSpec.input_format(),
-          "Input format. Supported format is `text`.");
+          "Input format, `text` or `dptok` (packed token corpus, keys are ignored).");
 ABSL_FLAG(std::string, model_prefix, "", "output model prefix");
 ABSL_FLAG(std::string, model_type, "bpe",
-          "model algorithm: bpe");
+          "model algorithm: bpe or unigram");
 ABSL_FLAG(int32, vocab_size, kDefaultTrainerSpec.vocab_size(),
           "vocabulary size");
 ABSL_FLAG(std::uint64_t, input_sentence_size,
@@ -52,6 +52,18 @@ ABSL_FLAG(int32, num_sub_iterations, kDefaultTrainerSpec.num_sub_iterations(),
 ABSL_FLAG(int32, max_discretepiece_length,
           kDefaultTrainerSpec.max_discretepiece_length(),
           "maximum length of sentence piece");
+ABSL_FLAG(bool, collapse_repeats, kDefaultTrainerSpec.collapse_repeats(),
+          "collapse runs of the same token into one token before training. "
+          "The model collapses its input the same way when encoding");
+ABSL_FLAG(int32, word_dictionary_size, kDefaultTrainerSpec.word_dictionary_size(),
+          "number of the most frequent deliminator-separated chunks whose encodings are "
+          "stored in the model and looked up before segmenting, 0 to disable");
+ABSL_FLAG(int32, num_codebooks, kDefaultTrainerSpec.num_codebooks(),
+          "number of tokens per position. When > 1, each token of the input is a "
+          "tuple such as 3:17:5 and the tuples are the symbols of the model");
+ABSL_FLAG(bool, write_legacy_piece, kDefaultTrainerSpec.write_legacy_piece(),
+          "also store every piece as a string, so that older readers can load "
+          "the model");
 ABSL_FLAG(bool, vocabulary_output_piece_score,
           kDefaultTrainerSpec.vocabulary_output_piece_score(),
           "Define score in vocab file");
@@ -106,6 +118,10 @@ int main(int argc, char *argv[]) {
   SetTrainerSpecFromFlag(num_threads);
   SetTrainerSpecFromFlag(num_sub_iterations);
   SetTrainerSpecFromFlag(max_discretepiece_length);
+  SetTrainerSpecFromFlag(collapse_repeats);
+  SetTrainerSpecFromFlag(word_dictionary_size);
+  SetTrainerSpecFromFlag(num_codebooks);
+  SetTrainerSpecFromFlag(write_legacy_piece);
   SetTrainerSpecFromFlag(vocabulary_output_piece_score);
 
   CHECK_OK(discretepiece::DiscretePieceTrainer::PopulateModelTypeFromString(
@@ -0,0 +1,351 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include "token_corpus.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+namespace discretepiece {
+namespace {
+
+constexpr char kMagic[4] = {'D', 'P', 'T', 'K'};
+constexpr uint32 kVersion = 1;
+constexpr size_t kHeaderSize = 64;
+constexpr uint64 kAlignment = 64;
+
+// Stands for the deliminator in uint16 tokens.
+constexpr uint16 kPackedDeliminator = 0xFFFF;
+constexpr uint32 kDeliminator = 0xFFFFFFFF;
+
+template <typename T>
+T ReadValue(const char *p) {
+  T value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+template <typename T>
+void AppendValue(T value, std::string *out) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+uint64 Align(uint64 offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+util::Status ErrnoError(absl::string_view filename) {
+  return util::StatusBuilder(util::StatusCode::kInternal, GTL_LOC)
+         << "\"" << filename << "\": " << util::StrError(errno);
+}
+
+#ifdef _WIN32
+// Windows has no pread() and pwrite(); the writer is used by one thread,
+// so the file position is moved instead.
+int OpenFile(const std::string &name) {
+  return _open(name.c_str(), _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY,
+               _S_IREAD | _S_IWRITE);
+}
+int CloseFile(int fd) { return _close(fd); }
+int TruncateFile(int fd, uint64 size) { return _chsize_s(fd, size) == 0 ? 0 : -1; }
+int64 PWrite(int fd, const void *data, size_t size, uint64 offset) {
+  if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+  return _write(fd, data, static_cast<unsigned int>(std::min<size_t>(size, 1 << 30)));
+}
+int64 PRead(int fd, void *data, size_t size, uint64 offset) {
+  if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+  return _read(fd, data, static_cast<unsigned int>(std::min<size_t>(size, 1 << 30)));
+}
+#else
+int OpenFile(const std::string &name) {
+  return open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+int CloseFile(int fd) { return close(fd); }
+int TruncateFile(int fd, uint64 size) { return ftruncate(fd, size); }
+int64 PWrite(int fd, const void *data, size_t size, uint64 offset) {
+  return pwrite(fd, data, size, offset);
+}
+int64 PRead(int fd, void *data, size_t size, uint64 offset) {
+  return pread(fd, data, size, offset);
+}
+#endif
+
+// Writes all of data[0, size) at `offset` of `fd`.
+bool WriteAt(int fd, const void *data, size_t size, uint64 offset) {
+  const char *p = static_cast<const char *>(data);
+  while (size > 0) {
+    const int64 n = PWrite(fd, p, size, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Reads all of data[0, size) at `offset` of `fd`.
+bool ReadAt(int fd, void *data, size_t size, uint64 offset) {
+  char *p = static_cast<char *>(data);
+  while (size > 0) {
+    const int64 n = PRead(fd, p, size, offset);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Returns true if offsets[0, n + 1) start at 0, never decrease and end at
+// `last`.
+bool IsValidOffsets(const uint64 *offsets, uint64 n, uint64 last) {
+  if (offsets[0] != 0 || offsets[n] != last) return false;
+  for (uint64 i = 0; i < n; ++i) {
+    if (offsets[i] > offsets[i + 1]) return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+TokenCorpus::~TokenCorpus() { Close(); }
+
+void TokenCorpus::Close() {
+  file_.Close();
+  data_ = nullptr;
+  size_ = 0;
+  num_sequences_ = 0;
+  tokens_ = nullptr;
+  offsets_ = nullptr;
+  keys_ = nullptr;
+  key_offsets_ = nullptr;
+}
+
+util::Status TokenCorpus::Open(absl::string_view filename) {
+  Close();
+#ifdef IS_BIG_ENDIAN
+  return util::UnimplementedError(
+      "token corpora are little-endian and not supported on this host.");
+#endif
+
+  const std::string name(filename);
+  RETURN_IF_ERROR(file_.Open(filename, true));
+  data_ = file_.data();
+  size_ = file_.size();
+  CHECK_OR_RETURN(size_ >= kHeaderSize &&
+                  memcmp(data_, kMagic, sizeof(kMagic)) == 0)
+      << name << " is not a token corpus.";
+  const uint32 version = ReadValue<uint32>(data_ + 4);
+  CHECK_OR_RETURN(version == kVersion)
+      << name << ": unsupported token corpus version " << version << ".";
+  token_size_ = ReadValue<uint32>(data_ + 8);
+  const uint64 num_sequences = ReadValue<uint64>(data_ + 16);
+  const uint64 num_tokens = ReadValue<uint64>(data_ + 24);
+  const uint64 tokens_offset = ReadValue<uint64>(data_ + 32);
+  const uint64 offsets_offset = ReadValue<uint64>(data_ + 40);
+  const uint64 keys_offset = ReadValue<uint64>(data_ + 48);
+  const uint64 key_offsets_offset = ReadValue<uint64>(data_ + 56);
+
+  // Every array fits in the file, and the sizes do not overflow.
+  auto Fits = [this](uint64 offset, uint64 count, uint64 size) {
+    return offset <= size_ && count <= (size_ - offset) / size;
+  };
+  CHECK_OR_RETURN((token_size_ == 2 || token_size_ == 4) &&
+                  tokens_offset % token_size_ == 0 &&
+                  Fits(tokens_offset, num_tokens, token_size_) &&
+                  offsets_offset % sizeof(uint64) == 0 &&
+                  num_sequences < size_ &&
+                  Fits(offsets_offset, num_sequences + 1, sizeof(uint64)))
+      << name << ": broken token corpus.";
+  const uint64 *offsets = reinterpret_cast<const uint64 *>(data_ + offsets_offset);
+  CHECK_OR_RETURN(IsValidOffsets(offsets, num_sequences, num_tokens))
+      << name << ": broken token corpus.";
+
+  const uint64 *key_offsets = nullptr;
+  if (keys_offset != 0 || key_offsets_offset != 0) {
+    CHECK_OR_RETURN(key_offsets_offset % sizeof(uint64) == 0 &&
+                    Fits(key_offsets_offset, num_sequences + 1, sizeof(uint64)) &&
+                    keys_offset <= size_)
+        << name << ": broken token corpus.";
+    key_offsets = reinterpret_cast<const uint64 *>(data_ + key_offsets_offset);
+    CHECK_OR_RETURN(IsValidOffsets(key_offsets, num_sequences,
+                                   key_offsets[num_sequences]) &&
+                    key_offsets[num_sequences] <= size_ - keys_offset)
+        << name << ": broken token corpus.";
+  }
+
+  num_sequences_ = num_sequences;
+  tokens_ = data_ + tokens_offset;
+  offsets_ = offsets;
+  if (key_offsets != nullptr) {
+    keys_ = data_ + keys_offset;
+    key_offsets_ = key_offsets;
+  }
+  return util::OkStatus();
+}
+
+bool TokenCorpus::IsTokenCorpusFile(absl::string_view filename) {
+  // Reading the magic from a pipe, e.g. /dev/stdin or <(zcat ...), would
+  // consume it or block, so only regular files are probed.
+  return filesystem::StartsWithMagic(
+      filename, absl::string_view(kMagic, sizeof(kMagic)));
+}
+
+absl::string_view TokenCorpus::key(size_t i) const {
+  if (keys_ == nullptr) return absl::string_view();
+  return absl::string_view(keys_ + key_offsets_[i],
+                           key_offsets_[i + 1] - key_offsets_[i]);
+}
+
+void TokenCorpus::Append(size_t i, std::vector<char32> *output) const {
+  const uint64 begin = offsets_[i];
+  const uint64 end = offsets_[i + 1];
+  if (token_size_ == 4) {
+    const uint32 *tokens = reinterpret_cast<const uint32 *>(tokens_);
+    output->insert(output->end(), tokens + begin, tokens + end);
+    return;
+  }
+  const uint16 *tokens = reinterpret_cast<const uint16 *>(tokens_);
+  for (uint64 k = begin; k < end; ++k) {
+    output->push_back(tokens[k] == kPackedDeliminator ? kDeliminator : tokens[k]);
+  }
+}
+
+TokenCorpusWriter::~TokenCorpusWriter() {
+  if (fd_ >= 0) {
+    const util::Status status = Close();
+    if (!status.ok()) LOG(ERROR) << status.ToString();
+  }
+}
+
+util::Status TokenCorpusWriter::Open(absl::string_view filename) {
+  CHECK_OR_RETURN(fd_ < 0) << "token corpus is already open.";
+#ifdef IS_BIG_ENDIAN
+  return util::UnimplementedError(
+      "token corpora are little-endian and not supported on this host.");
+#endif
+  filename_ = std::string(filename);
+  fd_ = OpenFile(filename_);
+  if (fd_ < 0) return ErrnoError(filename);
+  // The header is written by Close().
+  const std::string header(kHeaderSize, '\0');
+  if (!WriteAt(fd_, header.data(), header.size(), 0)) return ErrnoError(filename_);
+  return util::OkStatus();
+}
+
+util::Status TokenCorpusWriter::Add(absl::string_view key,
+                                    absl::Span<const char32> tokens) {
+  CHECK_OR_RETURN(fd_ >= 0) << "token corpus is not open.";
+  for (const char32 c : tokens) {
+    fits_uint16_ &= c < kPackedDeliminator || c == kDeliminator;
+  }
+  buffer_.insert(buffer_.end(), tokens.begin(), tokens.end());
+  offsets_.push_back(offsets_.back() + tokens.size());
+  keys_.append(key.data(), key.size());
+  key_offsets_.push_back(keys_.size());
+  if (buffer_.size() >= (1 << 18)) RETURN_IF_ERROR(FlushTokens());
+  return util::OkStatus();
+}
+
+util::Status TokenCorpusWriter::FlushTokens() {
+  if (!WriteAt(fd_, buffer_.data(), buffer_.size() * sizeof(uint32),
+               kHeaderSize + num_tokens_ * sizeof(uint32))) {
+    return ErrnoError(filename_);
+  }
+  num_tokens_ += buffer_.size();
+  buffer_.clear();
+  return util::OkStatus();
+}
+
+util::Status TokenCorpusWriter::PackTokens() {
+  // Writes never pass reads, so the tokens are packed in place.
+  constexpr uint64 kChunkSize = 1 << 16;
+  std::vector<uint32> wide(kChunkSize);
+  std::vector<uint16> packed(kChunkSize);
+  for (uint64 begin = 0; begin < num_tokens_; begin += kChunkSize) {
+    const uint64 n = std::min(kChunkSize, num_tokens_ - begin);
+    if (!ReadAt(fd_, wide.data(), n * sizeof(uint32),
+                kHeaderSize + begin * sizeof(uint32))) {
+      return ErrnoError(filename_);
+    }
+    for (uint64 k = 0; k < n; ++k) {
+      packed[k] = wide[k] == kDeliminator ? kPackedDeliminator : wide[k];
+    }
+    if (!WriteAt(fd_, packed.data(), n * sizeof(uint16),
+                 kHeaderSize + begin * sizeof(uint16))) {
+      return ErrnoError(filename_);
+    }
+  }
+  return util::OkStatus();
+}
+
+util::Status TokenCorpusWriter::Close() {
+  CHECK_OR_RETURN(fd_ >= 0) << "token corpus is not open.";
+  util::Status status = FlushTokens();
+  const uint32 token_size = fits_uint16_ ? sizeof(uint16) : sizeof(uint32);
+  if (status.ok() && fits_uint16_) status = PackTokens();
+
+  const uint64 num_sequences = offsets_.size() - 1;
+  const uint64 offsets_offset = Align(kHeaderSize + num_tokens_ * token_size);
+  uint64 end = offsets_offset + offsets_.size() * sizeof(uint64);
+  uint64 keys_offset = 0;
+  uint64 key_offsets_offset = 0;
+  if (!keys_.empty()) {
+    keys_offset = Align(end);
+    key_offsets_offset = Align(keys_offset + keys_.size());
+    end = key_offsets_offset + key_offsets_.size() * sizeof(uint64);
+  }
+
+  std::string header(kMagic, sizeof(kMagic));
+  AppendValue(kVersion, &header);
+  AppendValue(token_size, &header);
+  AppendValue(static_cast<uint32>(0), &header);
+  AppendValue(num_sequences, &header);
+  AppendValue(num_tokens_, &header);
+  AppendValue(static_cast<uint64>(kHeaderSize), &header);
+  AppendValue(offsets_offset, &header);
+  AppendValue(keys_offset, &header);
+  AppendValue(key_offsets_offset, &header);
+
+  // Packing leaves the uint32 tokens behind the new end, so the file is
+  // truncated first and the gaps between the arrays read as zeros.
+  if (status.ok() &&
+      (TruncateFile(fd_, offsets_offset) != 0 ||
+       !WriteAt(fd_, offsets_.data(), offsets_.size() * sizeof(uint64),
+                offsets_offset) ||
+       (!keys_.empty() &&
+        (!WriteAt(fd_, keys_.data(), keys_.size(), keys_offset) ||
+         !WriteAt(fd_, key_offsets_.data(),
+                  key_offsets_.size() * sizeof(uint64), key_offsets_offset))) ||
+       TruncateFile(fd_, end) != 0 ||
+       !WriteAt(fd_, header.data(), header.size(), 0))) {
+    status = ErrnoError(filename_);
+  }
+  if (CloseFile(fd_) != 0 && status.ok()) status = ErrnoError(filename_);
+  fd_ = -1;
+  return status;
+}
+
+}  // namespace discretepiece
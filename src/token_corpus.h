@@ -0,0 +1,127 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef TOKEN_CORPUS_H_
+#define TOKEN_CORPUS_H_
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "filesystem.h"
+#include "third_party/absl/strings/string_view.h"
+#include "third_party/absl/types/span.h"
+#include "util.h"
+
+namespace discretepiece {
+
+// Packed binary token corpus (.dptok): sequences of tokens, each with an
+// optional key, stored as flat arrays which are used in place after
+// mapping the file, or reading it on Windows. The arrays are plain
+// little-endian integers at 64-byte aligned offsets, so they can be read
+// with numpy.memmap without parsing.
+// Big-endian hosts refuse to read or write them.
+//
+// Layout:
+//   "DPTK", uint32 version, uint32 token_size (2 or 4), uint32 reserved,
+//   uint64 num_sequences, uint64 num_tokens,
+//   uint64 tokens_offset, uint64 offsets_offset,
+//   uint64 keys_offset, uint64 key_offsets_offset (both 0 without keys),
+//   tokens: uint16 or uint32[num_tokens],
+//   offsets: uint64[num_sequences + 1], sequence i is
+//            tokens[offsets[i], offsets[i + 1]),
+//   keys: the characters of all keys, key i is
+//         keys[key_offsets[i], key_offsets[i + 1]),
+//   key_offsets: uint64[num_sequences + 1].
+//
+// Tokens are uint16 if every token is below 0xFFFF or is the deliminator
+// 0xFFFFFFFF, which is stored as 0xFFFF.
+class TokenCorpus {
+ public:
+  TokenCorpus() {}
+  ~TokenCorpus();
+
+  TokenCorpus(const TokenCorpus &) = delete;
+  TokenCorpus &operator=(const TokenCorpus &) = delete;
+
+  // Maps `filename` read-only.
+  util::Status Open(absl::string_view filename);
+
+  // Returns true if `filename` is a regular file starting with the magic
+  // of a token corpus. Pipes and devices are never read.
+  static bool IsTokenCorpusFile(absl::string_view filename);
+
+  // Returns the number of sequences.
+  size_t size() const { return num_sequences_; }
+
+  bool has_keys() const { return keys_ != nullptr; }
+
+  // Returns the key of sequence `i`, or an empty key without keys.
+  absl::string_view key(size_t i) const;
+
+  // Appends the tokens of sequence `i` to `output`.
+  void Append(size_t i, std::vector<char32> *output) const;
+
+ private:
+  void Close();
+
+  filesystem::MappedFile file_;
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  uint32 token_size_ = 4;
+  uint64 num_sequences_ = 0;
+  const char *tokens_ = nullptr;
+  const uint64 *offsets_ = nullptr;
+  const char *keys_ = nullptr;
+  const uint64 *key_offsets_ = nullptr;
+};
+
+// Writes a token corpus. Tokens are streamed to the file as uint32 and
+// packed to uint16 in place by Close() if they all fit; offsets and keys
+// are kept in memory until then.
+class TokenCorpusWriter {
+ public:
+  TokenCorpusWriter() {}
+  ~TokenCorpusWriter();
+
+  TokenCorpusWriter(const TokenCorpusWriter &) = delete;
+  TokenCorpusWriter &operator=(const TokenCorpusWriter &) = delete;
+
+  util::Status Open(absl::string_view filename);
+
+  // Appends a sequence. Keys are written if any key is not empty.
+  util::Status Add(absl::string_view key, absl::Span<const char32> tokens);
+
+  // Writes the offsets, the keys and the header and closes the file.
+  util::Status Close();
+
+ private:
+  // Writes buffer_ at the end of the tokens.
+  util::Status FlushTokens();
+
+  // Rewrites the uint32 tokens as uint16.
+  util::Status PackTokens();
+
+  std::string filename_;
+  int fd_ = -1;
+  uint64 num_tokens_ = 0;
+  bool fits_uint16_ = true;
+  std::vector<uint32> buffer_;
+  std::vector<uint64> offsets_ = {0};
+  std::string keys_;
+  std::vector<uint64> key_offsets_ = {0};
+};
+
+}  // namespace discretepiece
+#endif  // TOKEN_CORPUS_H_
@@ -0,0 +1,213 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef TOKEN_SEQ_H_
+#define TOKEN_SEQ_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <ostream>
+#include <vector>
+
+#include "common.h"
+
+namespace discretepiece {
+
+// Hash of `size` tokens. It is computed in 64 bits on every platform, so
+// the hash tables serialized in models (PieceTable, WordDictionary) have
+// the same layout everywhere.
+inline uint64 HashTokens(const char32 *tokens, size_t size) {
+  uint64 h = 0x9e3779b97f4a7c15ULL ^ size;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ tokens[i]) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  return h;
+}
+
+// Sequence of char32 tokens with inline storage for short sequences.
+// Pieces are at most max_discretepiece_length (16 by default) tokens long,
+// so they usually never allocate. The hash value is computed once and
+// cached until the sequence is modified.
+class TokenSeq {
+ public:
+  using value_type = char32;
+  using iterator = char32 *;
+  using const_iterator = const char32 *;
+  using size_type = size_t;
+
+  // Number of tokens stored without heap allocation.
+  static constexpr size_t kInlineSize = 16;
+
+  TokenSeq() {}
+
+  TokenSeq(const char32 *data, size_t size) { assign(data, data + size); }
+
+  template <typename It>
+  TokenSeq(It begin, It end) {
+    assign(begin, end);
+  }
+
+  TokenSeq(std::initializer_list<char32> list) {
+    assign(list.begin(), list.end());
+  }
+
+  explicit TokenSeq(const std::vector<char32> &vec) {
+    assign(vec.begin(), vec.end());
+  }
+
+  TokenSeq(const TokenSeq &other) { *this = other; }
+
+  TokenSeq(TokenSeq &&other) noexcept { *this = std::move(other); }
+
+  ~TokenSeq() {
+    if (!is_inline()) delete[] heap_;
+  }
+
+  TokenSeq &operator=(const TokenSeq &other) {
+    if (this == &other) return *this;
+    assign(other.begin(), other.end());
+    hash_ = other.hash_;
+    return *this;
+  }
+
+  TokenSeq &operator=(TokenSeq &&other) noexcept {
+    if (this == &other) return *this;
+    if (other.is_inline()) {
+      assign(other.begin(), other.end());
+    } else {
+      if (!is_inline()) delete[] heap_;
+      heap_ = other.heap_;
+      capacity_ = other.capacity_;
+      size_ = other.size_;
+      other.capacity_ = kInlineSize;
+      other.size_ = 0;
+    }
+    hash_ = other.hash_;
+    other.hash_ = 0;
+    return *this;
+  }
+
+  const char32 *data() const { return is_inline() ? inline_ : heap_; }
+  char32 *data() { return is_inline() ? inline_ : heap_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const_iterator begin() const { return data(); }
+  const_iterator end() const { return data() + size_; }
+  iterator begin() { return data(); }
+  iterator end() { return data() + size_; }
+
+  char32 operator[](size_t i) const { return data()[i]; }
+  char32 front() const { return data()[0]; }
+  char32 back() const { return data()[size_ - 1]; }
+
+  void clear() {
+    size_ = 0;
+    hash_ = 0;
+  }
+
+  void reserve(size_t n) {
+    if (n <= capacity_) return;
+    char32 *heap = new char32[n];
+    memcpy(heap, data(), size_ * sizeof(char32));
+    if (!is_inline()) delete[] heap_;
+    heap_ = heap;
+    capacity_ = static_cast<uint32>(n);
+  }
+
+  void push_back(char32 c) {
+    if (size_ == capacity_) reserve(2 * capacity_);
+    data()[size_++] = c;
+    hash_ = 0;
+  }
+
+  template <typename It>
+  void append(It begin, It end) {
+    const size_t n = std::distance(begin, end);
+    if (size_ + n > capacity_) reserve(std::max<size_t>(2 * capacity_, size_ + n));
+    std::copy(begin, end, data() + size_);
+    size_ += n;
+    hash_ = 0;
+  }
+
+  void append(const TokenSeq &other) { append(other.begin(), other.end()); }
+
+  template <typename It>
+  void assign(It begin, It end) {
+    size_ = 0;
+    append(begin, end);
+  }
+
+  std::vector<char32> ToVector() const {
+    return std::vector<char32>(begin(), end());
+  }
+
+  // Returns the hash value, computed on the first call after modification.
+  size_t hash() const {
+    if (hash_ == 0) {
+      // 0 means "not computed".
+      hash_ = static_cast<size_t>(HashTokens(data(), size_)) | 1;
+    }
+    return hash_;
+  }
+
+  friend bool operator==(const TokenSeq &a, const TokenSeq &b) {
+    if (a.size_ != b.size_) return false;
+    if (a.hash_ != 0 && b.hash_ != 0 && a.hash_ != b.hash_) return false;
+    return memcmp(a.data(), b.data(), a.size_ * sizeof(char32)) == 0;
+  }
+
+  friend bool operator!=(const TokenSeq &a, const TokenSeq &b) {
+    return !(a == b);
+  }
+
+  // Lexicographical order of the token values. A prefix comes first.
+  friend bool operator<(const TokenSeq &a, const TokenSeq &b) {
+    const size_t n = std::min(a.size_, b.size_);
+    const char32 *p = a.data();
+    const char32 *q = b.data();
+    for (size_t i = 0; i < n; ++i) {
+      if (p[i] != q[i]) return p[i] < q[i];
+    }
+    return a.size_ < b.size_;
+  }
+
+ private:
+  bool is_inline() const { return capacity_ == kInlineSize; }
+
+  uint32 size_ = 0;
+  uint32 capacity_ = kInlineSize;
+  mutable size_t hash_ = 0;
+  union {
+    char32 inline_[kInlineSize];
+    char32 *heap_;
+  };
+};
+
+struct TokenSeqHash {
+  size_t operator()(const TokenSeq &seq) const { return seq.hash(); }
+};
+
+inline std::ostream &operator<<(std::ostream &out, const TokenSeq &seq) {
+  for (const char32 c : seq) {
+    out << " " << c;
+  }
+  return out;
+}
+
+}  // namespace discretepiece
+#endif  // TOKEN_SEQ_H_
@@ -15,6 +15,7 @@
 #include "bpe_model_trainer.h"
 #include "third_party/absl/memory/memory.h"
 #include "trainer_factory.h"
+#include "unigram_model_trainer.h"
 
 namespace discretepiece {
 
@@ -24,6 +25,9 @@ std::unique_ptr<TrainerInterface> TrainerFactory::Create(const TrainerSpec &trai
     case TrainerSpec::BPE:
       return absl::make_unique<bpe::Trainer>(trainer_spec);
       break;
+    case TrainerSpec::UNIGRAM:
+      return absl::make_unique<unigram::Trainer>(trainer_spec);
+      break;
     default:
       LOG(FATAL) << "Unknown model_type: " << trainer_spec.model_type();
       break;
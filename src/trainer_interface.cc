@@ -25,6 +25,7 @@
 
 #include "filesystem.h"
 #include "discretepiece_trainer.h"
+#include "model_factory.h"
 #include "third_party/absl/container/flat_hash_map.h"
 #include "third_party/absl/container/flat_hash_set.h"
 #include "third_party/absl/memory/memory.h"
@@ -35,7 +36,9 @@
 #include "third_party/absl/strings/str_format.h"
 #include "third_party/absl/strings/str_join.h"
 #include "third_party/absl/strings/str_split.h"
+#include "token_corpus.h"
 #include "util.h"
+#include "word_dictionary.h"
 
 namespace discretepiece {
 
@@ -49,6 +52,7 @@ util::Status VerifySpec(const TrainerSpec &trainer_spec) {
 
   CHECK_RANGE(trainer_spec.num_sub_iterations(), 1, 10);
   CHECK_RANGE(trainer_spec.num_threads(), 1, 1024);
+  CHECK_RANGE(trainer_spec.num_codebooks(), 1, 64);
 #undef CHECK_RANGE
 
   CHECK_OR_RETURN(trainer_spec.input_sentence_size() <= 0 ||
@@ -163,11 +167,13 @@ TrainerInterface::TrainerInterface(const TrainerSpec &trainer_spec)
   status_ = VerifySpec(trainer_spec_);
   if (status_.ok()) 
     status_ = InitDeliminatorPieces();
+  if (status_.ok())
+    tuple_vocab_ = TupleVocab(trainer_spec_.num_codebooks());
 }
 
 TrainerInterface::~TrainerInterface() {}
 
-bool TrainerInterface::IsValidDiscretePiece(const std::vector<char32> &piece) const {
+bool TrainerInterface::IsValidDiscretePiece(absl::Span<const char32> piece) const {
   // Returns false if the length of piece is invalid.
   if (piece.empty() || piece.size() > static_cast<size_t>(trainer_spec_.max_discretepiece_length()))
     return false;
@@ -195,9 +201,10 @@ util::Status TrainerInterface::InitDeliminatorPieces() {
 util::Status TrainerInterface::LoadSentences() {
   RETURN_IF_ERROR(status());
   CHECK_OR_RETURN(sentences_.empty());
+  const bool is_token_corpus = trainer_spec_.input_format() == "dptok";
   CHECK_OR_RETURN(trainer_spec_.input_format().empty() ||
-                  trainer_spec_.input_format() == "text")
-      << "Supported formats are 'text'.";
+                  trainer_spec_.input_format() == "text" || is_token_corpus)
+      << "Supported formats are 'text' and 'dptok'.";
 
   CHECK_OR_RETURN(
       (sentence_iterator_ != nullptr && trainer_spec_.input().empty()) ||
@@ -211,31 +218,85 @@ util::Status TrainerInterface::LoadSentences() {
 
   SentenceSelector selector(&sentences_, trainer_spec_);
 
-  std::unique_ptr<SentenceIterator> sentence_iterator_impl;
-  if (sentence_iterator_ == nullptr) {
-    LOG(INFO) << "SentenceIterator is not specified. Using "
-                 "MultiFileSentenceIterator.";
-    sentence_iterator_impl =
-        absl::make_unique<MultiFileSentenceIterator>(std::vector<std::string>(
-            trainer_spec_.input().begin(), trainer_spec_.input().end()));
-    sentence_iterator_ = sentence_iterator_impl.get();
+  // Interns the tuples of `tokens` to dense ids, one symbol per position,
+  // collapses repeats and adds the sentence. Sets `full` once the selector
+  // takes no more sentences.
+  bool full = false;
+  auto AddSentence = [&](const std::vector<char32> &tokens) -> util::Status {
+    std::vector<char32> sentence;
+    if (trainer_spec_.num_codebooks() > 1) {
+      RETURN_IF_ERROR(tuple_vocab_.AddAll(tokens, deliminator_char32_value_, &sentence));
+    } else {
+      sentence = tokens;
+    }
+
+    // the encoder collapses the input the same way, see DiscretePieceProcessor
+    if (trainer_spec_.collapse_repeats()) {
+      std::vector<char32> collapsed;
+      string_util::CollapseRepeats(sentence, deliminator_char32_value_, &collapsed, nullptr);
+      sentence.swap(collapsed);
+    }
+
+    full = !selector.Add(std::make_pair(sentence, static_cast<int64>(1)));
+    return util::OkStatus();
+  };
+
+  std::vector<char32> tokens;
+  if (is_token_corpus && sentence_iterator_ == nullptr) {
+    // Packed corpora hold the tokens, and the flattened tuples, already
+    // mapped; keys are ignored.
+    for (const auto &filename : trainer_spec_.input()) {
+      LOG(INFO) << "Loading corpus: " << filename;
+      TokenCorpus corpus;
+      RETURN_IF_ERROR(corpus.Open(filename));
+      for (size_t i = 0; i < corpus.size(); ++i) {
+        tokens.clear();
+        corpus.Append(i, &tokens);
+        if (tokens.empty()) continue;
+        CHECK_OR_RETURN(tokens.size() % trainer_spec_.num_codebooks() == 0)
+            << "each token should be a tuple of " << trainer_spec_.num_codebooks()
+            << " tokens: sequence " << i << " of " << filename;
+        RETURN_IF_ERROR(AddSentence(tokens));
+        if (full) goto END;
+      }
+    }
+    goto END;
   }
 
-  for (; !sentence_iterator_->done(); sentence_iterator_->Next()) {
-    int64 freq = 1;
-    std::string sentence_str = sentence_iterator_->value();
+  {
+    std::unique_ptr<SentenceIterator> sentence_iterator_impl;
+    if (sentence_iterator_ == nullptr) {
+      LOG(INFO) << "SentenceIterator is not specified. Using "
+                   "MultiFileSentenceIterator.";
+      sentence_iterator_impl =
+          absl::make_unique<MultiFileSentenceIterator>(std::vector<std::string>(
+              trainer_spec_.input().begin(), trainer_spec_.input().end()));
+      sentence_iterator_ = sentence_iterator_impl.get();
+    }
 
-    if (sentence_str.empty()) continue;
+    const string_util::TokenParser parser(deliminator_map_);
+    for (; !sentence_iterator_->done(); sentence_iterator_->Next()) {
+      const std::string &sentence_str = sentence_iterator_->value();
 
-    // split sentence into list of ints & mapping deliminators
-    std::vector<char32> sentence = string_util::StringToVectorChar32(sentence_str, deliminator_map_);
+      if (sentence_str.empty()) continue;
 
-    if (!selector.Add(std::make_pair(sentence, freq))) {
-      goto END;
+      // split sentence into list of ints & mapping deliminators
+      tokens.clear();
+      if (trainer_spec_.num_codebooks() > 1) {
+        CHECK_OR_RETURN(string_util::StringToTuples(sentence_str, deliminator_map_,
+                                                    trainer_spec_.num_codebooks(), &tokens))
+            << "each token should be a tuple of " << trainer_spec_.num_codebooks()
+            << " integer tokens: " << sentence_str;
+      } else {
+        CHECK_OR_RETURN(parser.Parse(sentence_str, &tokens))
+            << "tokens should be integers: " << sentence_str;
+      }
+      RETURN_IF_ERROR(AddSentence(tokens));
+      if (full) goto END;
     }
-  }
 
-  RETURN_IF_ERROR(sentence_iterator_->status());
+    RETURN_IF_ERROR(sentence_iterator_->status());
+  }
 
 END:
   // Emits error message if any.
@@ -284,7 +345,7 @@ util::Status TrainerInterface::Serialize(ModelProto *model_proto) const {
   RETURN_IF_ERROR(status());
 
   // Duplicated piece is not allowed.
-  std::unordered_set<std::vector<char32>, port::VectorChar32Hash> dup;
+  std::unordered_set<TokenSeq, TokenSeqHash> dup;
 
   model_proto->Clear();
 
@@ -293,18 +354,70 @@ util::Status TrainerInterface::Serialize(ModelProto *model_proto) const {
   CHECK_OR_RETURN(dup.insert(piece).second) << piece << " is already defined";
 
   CHECK_EQ_OR_RETURN(static_cast<int32>(final_pieces_.size()), trainer_spec_.vocab_size()) << "final piece size not equal";
+  CHECK_OR_RETURN(final_parents_.empty() || final_parents_.size() == final_pieces_.size());
   
   for (auto fid=0; fid<final_pieces_.size(); fid++) {
     const auto &w = final_pieces_[fid];
     auto *sp = model_proto->add_pieces();
     CHECK_PIECE(w.first);
     sp->set_type(ModelProto::DiscretePiece::NORMAL);
-    sp->set_piece(string_util::VectorChar32ToString(w.first, "_"));
+    sp->mutable_tokens()->Add(w.first.begin(), w.first.end());
+    if (trainer_spec_.write_legacy_piece()) {
+      sp->set_piece(string_util::VectorChar32ToString(w.first, "_"));
+    }
     sp->set_score(w.second);
+    if (!final_parents_.empty() && final_parents_[fid].first >= 0) {
+      sp->set_left_id(final_parents_[fid].first);
+      sp->set_right_id(final_parents_[fid].second);
+    }
   }
 
   *(model_proto->mutable_trainer_spec()) = trainer_spec_;
 
+  if (trainer_spec_.num_codebooks() > 1) {
+    model_proto->set_tuple_vocab(tuple_vocab_.Serialize());
+  }
+
+  return util::OkStatus();
+}
+
+util::Status TrainerInterface::BuildWordDictionary(ModelProto *model_proto) const {
+  if (trainer_spec_.word_dictionary_size() <= 0) return util::OkStatus();
+
+  absl::flat_hash_map<TokenSeq, int64, TokenSeqHash> chunk_freqs;
+  for (const auto &s : sentences_) {
+    for (const auto &w : port::VectorSplit(s.first, deliminator_char32_value_)) {
+      if (!w.empty()) chunk_freqs[TokenSeq(w)] += s.second;
+    }
+  }
+
+  std::vector<std::pair<TokenSeq, int64>> chunks(chunk_freqs.begin(), chunk_freqs.end());
+  const size_t size = std::min<size_t>(trainer_spec_.word_dictionary_size(), chunks.size());
+  std::partial_sort(chunks.begin(), chunks.begin() + size, chunks.end(),
+                    [](const std::pair<TokenSeq, int64> &a, const std::pair<TokenSeq, int64> &b) {
+                      return a.second > b.second || (a.second == b.second && a.first < b.first);
+                    });
+  chunks.resize(size);
+
+  // Chunks are encoded by the model being saved, without the dictionary.
+  const auto model = ModelFactory::Create(*model_proto);
+  CHECK_OR_RETURN(model) << "cannot create the model.";
+  RETURN_IF_ERROR(model->status());
+
+  std::vector<std::pair<TokenSeq, std::vector<int>>> entries;
+  entries.reserve(chunks.size());
+  int64 covered = 0, total = 0;
+  for (const auto &w : chunk_freqs) total += w.second;
+  for (const auto &w : chunks) {
+    std::vector<int> ids;
+    model->EncodeIds(absl::MakeConstSpan(w.first.data(), w.first.size()), &ids);
+    entries.emplace_back(w.first, std::move(ids));
+    covered += w.second;
+  }
+
+  model_proto->set_word_dictionary(WordDictionary::Build(entries));
+  LOG(INFO) << "Word dictionary: " << entries.size() << " chunks covering "
+            << covered << " of " << total << " chunk occurrences";
   return util::OkStatus();
 }
 
@@ -313,11 +426,12 @@ util::Status TrainerInterface::SaveModel(absl::string_view filename) const {
   ModelProto model_proto;
 
   RETURN_IF_ERROR(Serialize(&model_proto));
+  RETURN_IF_ERROR(BuildWordDictionary(&model_proto));
 
   auto output = filesystem::NewWritableFile(filename.data(), true);
   RETURN_IF_ERROR(output->status());
-  output->Write(model_proto.SerializeAsString());
-  return util::OkStatus();
+  CHECK_OR_RETURN(output->Write(model_proto.SerializeAsString()));
+  return output->Close();
 }
 
 util::Status TrainerInterface::SaveVocab(absl::string_view filename) const {
@@ -327,32 +441,36 @@ util::Status TrainerInterface::SaveVocab(absl::string_view filename) const {
   auto output = filesystem::NewWritableFile(filename);
   RETURN_IF_ERROR(output->status());
 
+  // Pieces of tuple models are written as their tuples, the same as
+  // DiscretePieceProcessor::IdToPieceString(), not as interned tuple ids.
+  const int num_codebooks = trainer_spec_.num_codebooks();
+  std::vector<char32> tuples;
   for (const auto &piece : model_proto.pieces()) {
-    if (piece.piece().find_first_of(" \t\r\n") != std::string::npos) {
-      LOG(WARNING) << "The piece [" << piece.piece()
-                   << "] contains escaped characters that break the format of "
-                   << filename;
+    std::string str;
+    if (num_codebooks > 1) {
+      tuples.clear();
+      RETURN_IF_ERROR(tuple_vocab_.Expand(
+          absl::MakeConstSpan(piece.tokens().data(), piece.tokens().size()),
+          deliminator_char32_value_, &tuples));
+      str = string_util::TuplesToString(tuples, num_codebooks, "_");
+    } else {
+      str = PieceToString(piece);
     }
-  }
-
-  if (trainer_spec_.vocabulary_output_piece_score()) {
-    for (const auto &piece : model_proto.pieces()) {
+    if (trainer_spec_.vocabulary_output_piece_score()) {
       std::ostringstream os;
-      os << piece.piece() << "\t" << piece.score();
-      CHECK_OR_RETURN(output->WriteLine(os.str()));
-    }
-  } else {
-    for (const auto &piece : model_proto.pieces()) {
-      CHECK_OR_RETURN(output->WriteLine(piece.piece()));
+      os << str << "\t" << piece.score();
+      str = os.str();
     }
+    CHECK_OR_RETURN(output->WriteLine(str));
   }
 
-  return util::OkStatus();
+  return output->Close();
 }
 
 util::Status TrainerInterface::Save() const {
   if (output_model_proto_) {
     RETURN_IF_ERROR(Serialize(output_model_proto_));
+    RETURN_IF_ERROR(BuildWordDictionary(output_model_proto_));
   } else {
     RETURN_IF_ERROR(SaveModel(trainer_spec_.model_prefix() + ".model"));
     RETURN_IF_ERROR(SaveVocab(trainer_spec_.model_prefix() + ".vocab"));
@@ -28,6 +28,9 @@
 #include "discretepiece_model.pb.h"
 #include "discretepiece_trainer.h"
 #include "third_party/absl/container/flat_hash_map.h"
+#include "third_party/absl/types/span.h"
+#include "token_seq.h"
+#include "tuple_vocab.h"
 #include "util.h"
 
 namespace discretepiece {
@@ -107,7 +110,7 @@ class TrainerInterface {
   // Returns true if |piece| is valid sentence piece.
   // The result is affected by
   // max_sentencepiece_length.
-  bool IsValidDiscretePiece(const std::vector<char32> &piece) const;
+  bool IsValidDiscretePiece(absl::Span<const char32> piece) const;
 
   // Splits all sentencecs by deliminator and replace the |sentences_| with tokenized ones.
   // e.g.,
@@ -123,7 +126,11 @@ class TrainerInterface {
   absl::flat_hash_map<char32, int64> required_chars_;
 
   // Final output pieces
-  std::vector<std::pair<std::vector<char32>, float>> final_pieces_;
+  std::vector<std::pair<TokenSeq, float>> final_pieces_;
+
+  // (left id, right id) of the two pieces merged into final_pieces_[i],
+  // or (-1, -1) for characters. Empty if the trainer does not merge.
+  std::vector<std::pair<int, int>> final_parents_;
 
   // All sentences.
   Sentences sentences_;
@@ -135,6 +142,10 @@ class TrainerInterface {
   absl::flat_hash_map<char, char32> deliminator_map_;
   const char32 deliminator_char32_value_ = std::numeric_limits<char32>::max();
 
+  // Dense ids of the tuples seen in the input when num_codebooks > 1.
+  // Sentences and pieces hold these ids instead of the tuples.
+  TupleVocab tuple_vocab_;
+
   // Detect errors on initialization.
   util::Status status_;
 
@@ -145,9 +156,15 @@ class TrainerInterface {
   ModelProto *output_model_proto_ = nullptr;
 
  private:
-  // Serialize final_pieces_ to |model_proto|.
+  // Serialize final_pieces_ to |model_proto|, without the word dictionary.
   util::Status Serialize(ModelProto *model_proto) const;
 
+  // Encodes the word_dictionary_size most frequent chunks with the model in
+  // |model_proto| and stores them as its word dictionary. Does nothing if
+  // word_dictionary_size is 0. Only the saved model needs it, so the
+  // vocabulary file is written without building it.
+  util::Status BuildWordDictionary(ModelProto *model_proto) const;
+
   // Saves model file.
   util::Status SaveModel(absl::string_view filename) const;
 
@@ -0,0 +1,155 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef TUPLE_VOCAB_H_
+#define TUPLE_VOCAB_H_
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "third_party/absl/container/flat_hash_map.h"
+#include "third_party/absl/strings/string_view.h"
+#include "third_party/absl/types/span.h"
+#include "token_seq.h"
+#include "util.h"
+
+namespace discretepiece {
+
+// Interns tuples of num_codebooks() tokens, e.g. the residual codebooks of
+// one frame, to dense ids 0, 1, ... in the order they are added, so that a
+// tuple is one symbol for training and encoding.
+//
+// Sequences of tuples are flattened: position i holds the tokens
+// [i * num_codebooks(), (i + 1) * num_codebooks()). A position whose first
+// token is the deliminator is a deliminator and maps to it unchanged.
+//
+// The serialized form is an array of little-endian uint32:
+//   num_codebooks, num_tuples, tuples[num_tuples * num_codebooks].
+class TupleVocab {
+ public:
+  TupleVocab() {}
+
+  explicit TupleVocab(int num_codebooks) : num_codebooks_(num_codebooks) {}
+
+  // Returns the id of `tuple`, adding it if new.
+  char32 Add(absl::Span<const char32> tuple) {
+    const auto it = ids_.emplace(TokenSeq(tuple.begin(), tuple.end()), size());
+    if (it.second) tuples_.insert(tuples_.end(), tuple.begin(), tuple.end());
+    return it.first->second;
+  }
+
+  // Maps the flattened tuples of `input` to ids appended to `ids`, adding
+  // new tuples.
+  util::Status AddAll(absl::Span<const char32> input, char32 deliminator,
+                      std::vector<char32> *ids) {
+    return Map(input, deliminator, ids,
+               [this](absl::Span<const char32> tuple, char32 *id) {
+                 *id = Add(tuple);
+                 return true;
+               });
+  }
+
+  // Same as AddAll(), but fails on unknown tuples.
+  util::Status Intern(absl::Span<const char32> input, char32 deliminator,
+                      std::vector<char32> *ids) const {
+    return Map(input, deliminator, ids,
+               [this](absl::Span<const char32> tuple, char32 *id) {
+                 const auto it = ids_.find(TokenSeq(tuple.begin(), tuple.end()));
+                 if (it == ids_.end()) return false;
+                 *id = it->second;
+                 return true;
+               });
+  }
+
+  // Appends the flattened tuples of `ids` to `tuples`.
+  util::Status Expand(absl::Span<const char32> ids, char32 deliminator,
+                      std::vector<char32> *tuples) const {
+    for (const char32 id : ids) {
+      if (id == deliminator) {
+        tuples->insert(tuples->end(), num_codebooks_, deliminator);
+        continue;
+      }
+      CHECK_LT_OR_RETURN(id, size()) << "tuple id " << id << " is out of range.";
+      const auto begin = tuples_.begin() + static_cast<size_t>(id) * num_codebooks_;
+      tuples->insert(tuples->end(), begin, begin + num_codebooks_);
+    }
+    return util::OkStatus();
+  }
+
+  std::string Serialize() const {
+    std::vector<uint32> words = {static_cast<uint32>(num_codebooks_),
+                                 static_cast<uint32>(size())};
+    words.insert(words.end(), tuples_.begin(), tuples_.end());
+    return std::string(reinterpret_cast<const char *>(words.data()),
+                       words.size() * sizeof(uint32));
+  }
+
+  // Loads tuples serialized by Serialize().
+  util::Status Init(absl::string_view data) {
+    ids_.clear();
+    tuples_.clear();
+    CHECK_OR_RETURN(data.size() % sizeof(uint32) == 0 &&
+                    data.size() >= 2 * sizeof(uint32))
+        << "broken tuple vocab.";
+    std::vector<uint32> words(data.size() / sizeof(uint32));
+    std::memcpy(words.data(), data.data(), data.size());
+    num_codebooks_ = words[0];
+    CHECK_OR_RETURN(num_codebooks_ > 0 &&
+                    words.size() == 2 + static_cast<uint64>(words[1]) * num_codebooks_)
+        << "broken tuple vocab.";
+    for (size_t i = 2; i < words.size(); i += num_codebooks_) {
+      CHECK_EQ_OR_RETURN(Add(absl::MakeConstSpan(words).subspan(i, num_codebooks_)),
+                         (i - 2) / num_codebooks_)
+          << "duplicated tuple in tuple vocab.";
+    }
+    return util::OkStatus();
+  }
+
+  int num_codebooks() const { return num_codebooks_; }
+
+  // Returns the number of tuples.
+  size_t size() const { return tuples_.size() / num_codebooks_; }
+
+ private:
+  template <typename Fn>
+  util::Status Map(absl::Span<const char32> input, char32 deliminator,
+                   std::vector<char32> *ids, Fn lookup) const {
+    CHECK_EQ_OR_RETURN(input.size() % num_codebooks_, 0)
+        << "input size is not a multiple of num_codebooks " << num_codebooks_;
+    for (size_t i = 0; i < input.size(); i += num_codebooks_) {
+      if (input[i] == deliminator) {
+        ids->push_back(deliminator);
+        continue;
+      }
+      const auto tuple = input.subspan(i, num_codebooks_);
+      char32 id = 0;
+      CHECK_OR_RETURN(lookup(tuple, &id))
+          << "unknown tuple " << string_util::VectorChar32ToString(tuple, ":");
+      ids->push_back(id);
+    }
+    return util::OkStatus();
+  }
+
+  int num_codebooks_ = 1;
+
+  // Flattened tuples in id order.
+  std::vector<char32> tuples_;
+
+  absl::flat_hash_map<TokenSeq, char32, TokenSeqHash> ids_;
+};
+
+}  // namespace discretepiece
+#endif  // TUPLE_VOCAB_H_
@@ -0,0 +1,112 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include "unigram_model.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "util.h"
+
+namespace discretepiece {
+namespace unigram {
+
+bool Viterbi(const PieceTrie &trie, absl::Span<const float> scores,
+             int max_piece_length, absl::Span<const char32> chunk,
+             std::vector<int> *ids) {
+  if (chunk.empty()) return true;
+
+  struct Node {
+    float score;  // best score of chunk[0, pos).
+    int begin;    // start of the last piece on the best path.
+    int id;       // id of the last piece on the best path.
+  };
+
+  constexpr float kUnreachable = -std::numeric_limits<float>::infinity();
+  std::vector<Node> best(chunk.size() + 1, {kUnreachable, -1, -1});
+  best[0].score = 0.0;
+
+  // End of the longest piece found so far. When no piece spans `begin`,
+  // every path passes through it and the score is reset to 0, so the
+  // result is bit-identical to segmenting both sides independently, as
+  // done for parallel windows and streaming.
+  size_t reach = 0;
+  for (size_t begin = 0; begin < chunk.size(); ++begin) {
+    if (best[begin].score == kUnreachable) continue;
+    if (reach <= begin) best[begin].score = 0.0;
+    const float base = best[begin].score;
+    trie.PrefixSearch(chunk.subspan(begin, max_piece_length),
+                      [&best, &scores, &reach, base, begin](size_t length, int id) {
+                        reach = std::max(reach, begin + length);
+                        Node &node = best[begin + length];
+                        const float score = base + scores[id];
+                        if (score > node.score) {
+                          node.score = score;
+                          node.begin = begin;
+                          node.id = id;
+                        }
+                      });
+  }
+
+  if (best.back().score == kUnreachable) return false;
+
+  // Backtracks from the end.
+  const size_t offset = ids->size();
+  for (int end = chunk.size(); end > 0; end = best[end].begin) {
+    ids->push_back(best[end].id);
+  }
+  std::reverse(ids->begin() + offset, ids->end());
+  return true;
+}
+
+Model::Model(const ModelProto &model_proto, const ModelImage *image) {
+  model_proto_ = &model_proto;
+  InitializePieces(image);
+}
+
+Model::~Model() {}
+
+EncodeResult Model::Encode(absl::Span<const char32> normalized) const {
+  std::vector<int> ids;
+  EncodeIds(normalized, &ids);
+  return PiecesFromIds(normalized, ids);
+}
+
+void Model::EncodeIds(absl::Span<const char32> normalized,
+                      std::vector<int> *ids) const {
+  if (!status().ok() || normalized.empty()) {
+    return;
+  }
+
+  // Pieces never cross a deliminator, so each chunk is segmented
+  // independently.
+  size_t begin = 0;
+  for (size_t i = 0; i <= normalized.size(); ++i) {
+    if (i == normalized.size() || normalized[i] == deliminator_char32_value_) {
+      const auto chunk = normalized.subspan(begin, i - begin);
+      if (!chunk.empty() && word_dictionary_.Lookup(chunk, ids)) {
+        begin = i + 1;
+        continue;
+      }
+      CHECK(Viterbi(trie_, scores_.span(), max_piece_length_, chunk, ids))
+          << string_util::VectorChar32ToString(chunk, " ")
+          << " contains a token which cannot found";
+      begin = i + 1;
+    }
+  }
+}
+
+}  // namespace unigram
+}  // namespace discretepiece
@@ -0,0 +1,57 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef UNIGRAM_MODEL_H_
+#define UNIGRAM_MODEL_H_
+
+#include <vector>
+
+#include "discretepiece_model.pb.h"
+#include "model_interface.h"
+#include "piece_trie.h"
+
+namespace discretepiece {
+namespace unigram {
+
+// Returns the Viterbi segmentation of `chunk` under the unigram language
+// model whose pieces are in `trie` with log probabilities `scores`, as
+// piece ids. `chunk` must not contain deliminators. Returns false if some
+// token is not covered by any piece.
+bool Viterbi(const PieceTrie &trie, absl::Span<const float> scores,
+             int max_piece_length, absl::Span<const char32> chunk,
+             std::vector<int> *ids);
+
+// Segmentation model with unigram language model.
+// Details:
+// Subword Regularization: Improving Neural Network Translation Models with
+// Multiple Subword Candidates
+// https://arxiv.org/abs/1804.10959
+class Model : public ModelInterface {
+ public:
+  // Tables are taken from `image` if not null, see ModelImage.
+  explicit Model(const ModelProto &model_proto,
+                 const ModelImage *image = nullptr);
+
+  ~Model() override;
+
+  // Splits `normalized` by the deliminator and finds the most likely
+  // segmentation of every chunk with a single Viterbi pass over the trie.
+  EncodeResult Encode(absl::Span<const char32> normalized) const override;
+
+  void EncodeIds(absl::Span<const char32> normalized,
+                 std::vector<int> *ids) const override;
+};
+}  // namespace unigram
+}  // namespace discretepiece
+#endif  // UNIGRAM_MODEL_H_
@@ -0,0 +1,483 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#include "unigram_model_trainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "third_party/absl/container/flat_hash_map.h"
+#include "third_party/absl/memory/memory.h"
+#include "third_party/esaxx/esa.hxx"  // Suffix array library.
+#include "unigram_model.h"
+#include "util.h"
+
+namespace discretepiece {
+namespace unigram {
+namespace {
+
+// Maximum number of seed pieces extracted from the suffix array.
+constexpr size_t kSeedPiecesSize = 1000000;
+
+// Pieces whose expected frequency is lower than this are dropped in the
+// M-step.
+constexpr float kExpectedFrequencyThreshold = 0.5;
+
+// Each pruning step keeps this ratio of the pieces.
+constexpr float kShrinkingFactor = 0.75;
+
+// EM iterations stop at vocab_size * kDesiredVocabSizeRatio pieces, and the
+// final pieces are selected from them by score.
+constexpr float kDesiredVocabSizeRatio = 1.1;
+
+constexpr double kNegativeInfinity = -std::numeric_limits<double>::infinity();
+
+// Returns log(exp(x) + exp(y)).
+double LogSumExp(double x, double y) {
+  if (x == kNegativeInfinity) return y;
+  if (y == kNegativeInfinity) return x;
+  const double vmax = std::max(x, y);
+  const double vmin = std::min(x, y);
+  return vmax + std::log1p(std::exp(vmin - vmax));
+}
+
+// Digamma function, used in the Bayesian M-step.
+double Digamma(double x) {
+  double result = 0.0;
+  for (; x < 7; ++x) result -= 1 / x;
+  x -= 1.0 / 2.0;
+  const double xx = 1.0 / x;
+  const double xx2 = xx * xx;
+  const double xx4 = xx2 * xx2;
+  result += std::log(x) + (1.0 / 24.0) * xx2 - (7.0 / 960.0) * xx4 +
+            (31.0 / 8064.0) * xx4 * xx2 - (127.0 / 30720.0) * xx4 * xx4;
+  return result;
+}
+
+// Converts frequencies to log probabilities.
+template <typename T>
+void ToLogProb(T begin, T end) {
+  float sum = 0.0;
+  for (auto it = begin; it != end; ++it) {
+    sum += it->second;
+  }
+  const float logsum = std::log(sum);
+  for (auto it = begin; it != end; ++it) {
+    it->second = std::log(it->second) - logsum;
+  }
+}
+
+}  // namespace
+
+Trainer::PieceModel::PieceModel(Pieces pieces) : pieces_(std::move(pieces)) {
+  std::vector<std::pair<TokenSeq, int>> trie_pieces;
+  trie_pieces.reserve(pieces_.size());
+  scores_.reserve(pieces_.size());
+  for (size_t i = 0; i < pieces_.size(); ++i) {
+    trie_pieces.emplace_back(pieces_[i].first, i);
+    scores_.push_back(pieces_[i].second);
+    max_piece_length_ = std::max<int>(max_piece_length_, pieces_[i].first.size());
+  }
+  status_ = trie_.Build(trie_pieces);
+}
+
+void Trainer::RunSharded(
+    const std::function<void(int shard, size_t begin, size_t end)> &fn) const {
+  const int num_threads = trainer_spec_.num_threads();
+  const size_t shard_size = (sentences_.size() + num_threads - 1) / num_threads;
+  ThreadPool pool(num_threads);
+  for (int n = 0; n < num_threads; ++n) {
+    const size_t begin = std::min(sentences_.size(), n * shard_size);
+    const size_t end = std::min(sentences_.size(), begin + shard_size);
+    pool.Schedule([&fn, n, begin, end]() { fn(n, begin, end); });
+  }
+}
+
+util::Status Trainer::MakeSeedPieces(Pieces *seed_pieces) const {
+  // Concatenates all chunks into one array of dense token ids in [1, K].
+  // 0 separates the chunks, so no substring spans two of them.
+  constexpr int kChunkBoundary = 0;
+  absl::flat_hash_map<char32, int> dense_ids;
+  std::vector<char32> tokens = {0};
+  std::vector<int> array;
+  for (const auto &w : sentences_) {
+    for (const char32 c : w.first) {
+      auto it = dense_ids.find(c);
+      if (it == dense_ids.end()) {
+        it = dense_ids.emplace(c, tokens.size()).first;
+        tokens.push_back(c);
+      }
+      array.push_back(it->second);
+    }
+    array.push_back(kChunkBoundary);
+  }
+
+  const int n = array.size();
+  const int k = tokens.size();
+  std::vector<int> SA(n);  // suffix array
+  std::vector<int> L(n);   // left boundaries of internal node
+  std::vector<int> R(n);   // right boundaries of internal node
+  std::vector<int> D(n);   // depths of internal node
+
+  LOG(INFO) << "Making suffix array...";
+  int node_num = 0;
+  CHECK_EQ_OR_RETURN(0, esaxx(array.begin(), SA.begin(), L.begin(), R.begin(),
+                              D.begin(), n, k, node_num));
+
+  LOG(INFO) << "Extracting frequent sub strings...";
+  std::vector<std::pair<int, int64>> substr_index;
+  for (int i = 0; i < node_num; ++i) {
+    const int offset = SA[L[i]];
+    const int len = D[i];
+    if (len <= 1 || len > trainer_spec_.max_discretepiece_length()) {
+      continue;
+    }
+    const auto begin = array.begin() + offset;
+    if (std::find(begin, begin + len, kChunkBoundary) != begin + len) {
+      continue;
+    }
+    // Weighted by the length, as a longer piece saves more tokens.
+    const int64 freq = R[i] - L[i];
+    substr_index.emplace_back(i, freq * len);
+  }
+
+  // All characters must be in the seed.
+  seed_pieces->clear();
+  for (const auto &c : Sorted(required_chars_)) {
+    seed_pieces->emplace_back(TokenSeq{c.first}, c.second);
+  }
+
+  std::sort(substr_index.begin(), substr_index.end(),
+            [](const std::pair<int, int64> &a, const std::pair<int, int64> &b) {
+              return a.second > b.second || (a.second == b.second && a.first < b.first);
+            });
+  for (const auto &p : substr_index) {
+    if (seed_pieces->size() >= kSeedPiecesSize) break;
+    const auto begin = array.begin() + SA[L[p.first]];
+    TokenSeq piece;
+    for (auto it = begin; it != begin + D[p.first]; ++it) {
+      piece.push_back(tokens[*it]);
+    }
+    if (!IsValidDiscretePiece(piece)) continue;
+    seed_pieces->emplace_back(std::move(piece), p.second);
+  }
+
+  ToLogProb(seed_pieces->begin(), seed_pieces->end());
+
+  LOG(INFO) << "Initialized " << seed_pieces->size() << " seed pieces";
+  return util::OkStatus();
+}
+
+std::vector<float> Trainer::RunEStep(const PieceModel &model, float *objective,
+                                     int64 *num_tokens) const {
+  const int num_threads = trainer_spec_.num_threads();
+  const auto &scores = model.scores();
+  std::vector<std::vector<float>> expected(num_threads);
+  std::vector<double> objs(num_threads, 0.0);
+  std::vector<int64> ntokens(num_threads, 0);
+
+  RunSharded([&](int shard, size_t begin, size_t end) {
+    struct Edge {
+      int begin;
+      int end;
+      int id;
+    };
+    std::vector<Edge> edges;
+    std::vector<double> alpha, beta;
+    std::vector<int> viterbi;
+    expected[shard].resize(scores.size(), 0.0);
+
+    for (size_t sid = begin; sid < end; ++sid) {
+      const auto &w = sentences_[sid];
+      const absl::Span<const char32> chunk(w.first);
+      const size_t n = chunk.size();
+      if (n == 0) continue;
+
+      // Edges are collected in the order of their start.
+      edges.clear();
+      for (size_t b = 0; b < n; ++b) {
+        model.trie().PrefixSearch(chunk.subspan(b, model.max_piece_length()),
+                                  [&edges, b](size_t length, int id) {
+                                    edges.push_back({static_cast<int>(b),
+                                                     static_cast<int>(b + length), id});
+                                  });
+      }
+
+      alpha.assign(n + 1, kNegativeInfinity);
+      alpha[0] = 0.0;
+      for (const auto &e : edges) {
+        alpha[e.end] = LogSumExp(alpha[e.end], alpha[e.begin] + scores[e.id]);
+      }
+      beta.assign(n + 1, kNegativeInfinity);
+      beta[n] = 0.0;
+      for (auto it = edges.rbegin(); it != edges.rend(); ++it) {
+        beta[it->begin] = LogSumExp(beta[it->begin], beta[it->end] + scores[it->id]);
+      }
+
+      const double z = alpha[n];
+      if (z == kNegativeInfinity) continue;
+      for (const auto &e : edges) {
+        expected[shard][e.id] +=
+            w.second * std::exp(alpha[e.begin] + scores[e.id] + beta[e.end] - z);
+      }
+      objs[shard] -= w.second * z;
+
+      viterbi.clear();
+      Viterbi(model.trie(), scores, model.max_piece_length(), chunk, &viterbi);
+      ntokens[shard] += viterbi.size();
+    }
+  });
+
+  // Merges expectations.
+  for (int n = 1; n < num_threads; ++n) {
+    for (size_t i = 0; i < expected[0].size(); ++i) {
+      expected[0][i] += expected[n][i];
+    }
+  }
+
+  double all_sentence_freq = 0.0;
+  for (const auto &w : sentences_) all_sentence_freq += w.second;
+
+  *objective = 0.0;
+  *num_tokens = 0;
+  for (int n = 0; n < num_threads; ++n) {
+    *objective += objs[n] / all_sentence_freq;
+    *num_tokens += ntokens[n];
+  }
+
+  return std::move(expected[0]);
+}
+
+Trainer::Pieces Trainer::RunMStep(const PieceModel &model,
+                                  const std::vector<float> &expected) const {
+  const auto &pieces = model.pieces();
+  CHECK_EQ(pieces.size(), expected.size());
+
+  Pieces new_pieces;
+  double sum = 0.0;
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    float freq = expected[i];
+    if (freq < kExpectedFrequencyThreshold) {
+      // Characters keep the segmentation possible.
+      if (pieces[i].first.size() > 1) continue;
+      freq = kExpectedFrequencyThreshold;
+    }
+    new_pieces.emplace_back(pieces[i].first, freq);
+    sum += freq;
+  }
+
+  // Here we do not use the original EM, but use the
+  // Bayesianified/DPified EM algorithm.
+  // https://cs.stanford.edu/~pliang/papers/tutorial-acl2007-talk.pdf
+  // This modification will act as a sparse prior.
+  const float logsum = Digamma(sum);
+  for (auto &w : new_pieces) {
+    w.second = Digamma(w.second) - logsum;
+  }
+
+  return new_pieces;
+}
+
+Trainer::Pieces Trainer::PruneDiscretePieces(const PieceModel &model) const {
+  const auto &pieces = model.pieces();
+
+  // Finds the second best segmentation of every piece, i.e. the
+  // segmentation without the piece itself. It replaces the piece when the
+  // piece is removed.
+  std::vector<std::vector<int>> alternatives(pieces.size());
+  std::vector<float> scores = model.scores();
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    if (pieces[i].first.size() <= 1) continue;
+    const float score = scores[i];
+    scores[i] = -std::numeric_limits<float>::infinity();
+    Viterbi(model.trie(), scores, model.max_piece_length(), pieces[i].first,
+            &alternatives[i]);
+    scores[i] = score;
+  }
+
+  // Segments all chunks to compute the Viterbi frequency of every piece and
+  // the chunks where it appears.
+  const int num_threads = trainer_spec_.num_threads();
+  std::vector<std::vector<float>> freqs(num_threads);
+  std::vector<std::vector<std::vector<int>>> inverteds(num_threads);
+  std::vector<float> vsums(num_threads, 0.0);
+  RunSharded([&](int shard, size_t begin, size_t end) {
+    freqs[shard].resize(pieces.size(), 0.0);
+    inverteds[shard].resize(pieces.size());
+    std::vector<int> ids;
+    for (size_t sid = begin; sid < end; ++sid) {
+      const auto &w = sentences_[sid];
+      ids.clear();
+      Viterbi(model.trie(), model.scores(), model.max_piece_length(), w.first, &ids);
+      for (const int id : ids) {
+        freqs[shard][id] += w.second;
+        inverteds[shard][id].push_back(sid);
+      }
+      vsums[shard] += w.second * ids.size();
+    }
+  });
+
+  std::vector<float> freq(pieces.size(), 0.0);
+  std::vector<std::vector<int>> inverted(pieces.size());
+  float vsum = 0.0;
+  for (int n = 0; n < num_threads; ++n) {
+    vsum += vsums[n];
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      freq[i] += freqs[n][i];
+      std::copy(inverteds[n][i].begin(), inverteds[n][i].end(),
+                std::back_inserter(inverted[i]));
+    }
+  }
+
+  const float sum = std::accumulate(freq.begin(), freq.end(), 0.0);
+  const float logsum = std::log(sum);
+  std::vector<std::pair<int, float>> candidates;
+  Pieces new_pieces;
+
+  // Computes how likely the corpus gets worse when the piece is removed,
+  // approximated with the alternative segmentation.
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    if (alternatives[i].empty()) {
+      // Characters are always kept.
+      if (pieces[i].first.size() <= 1) new_pieces.push_back(pieces[i]);
+      continue;
+    }
+    if (freq[i] == 0) {
+      // Not found in any Viterbi path. Can remove this entry safely.
+      continue;
+    }
+
+    float F = 0.0;  // the frequency of chunks containing the piece.
+    for (const int n : inverted[i]) {
+      F += sentences_[n].second;
+    }
+    F /= vsum;
+
+    // The logprob with the piece.
+    const float logprob_sp = std::log(static_cast<double>(freq[i])) - logsum;
+
+    // After removing the piece, its frequency freq[i] is re-assigned to
+    // the alternatives.
+    const float logsum_alt = std::log(
+        static_cast<double>(sum + freq[i] * (alternatives[i].size() - 1)));
+
+    // The logprobs of the alternatives.
+    float logprob_alt = 0.0;
+    for (const int n : alternatives[i]) {
+      logprob_alt += (std::log(static_cast<double>(freq[n] + freq[i])) - logsum_alt);
+    }
+
+    // loss: the diff of likelihood after removing the piece.
+    const float loss = F * (logprob_sp - logprob_alt);
+    candidates.emplace_back(i, loss);
+  }
+
+  const size_t pruned_size = std::max<size_t>(
+      desired_vocab_size_, kShrinkingFactor * pieces.size());
+
+  // Keeps the pieces with the largest loss.
+  for (const auto &w : Sorted(candidates)) {
+    if (new_pieces.size() >= pruned_size) break;
+    new_pieces.push_back(pieces[w.first]);
+  }
+
+  return new_pieces;
+}
+
+util::Status Trainer::FinalizeDiscretePieces(const PieceModel &model) {
+  const int vocab_size = trainer_spec_.vocab_size();
+
+  // Characters come first, then the pieces with the highest scores.
+  absl::flat_hash_map<TokenSeq, float, TokenSeqHash> final_pieces;
+  float min_score = 0.0;
+  for (const auto &w : model.pieces()) {
+    min_score = std::min(min_score, w.second);
+  }
+  for (const auto &c : required_chars_) {
+    final_pieces.emplace(TokenSeq{c.first}, min_score);
+  }
+  for (const auto &w : model.pieces()) {
+    if (w.first.size() == 1) final_pieces[w.first] = w.second;
+  }
+  for (const auto &w : Sorted(model.pieces())) {
+    if (final_pieces.size() >= static_cast<size_t>(vocab_size)) break;
+    final_pieces.emplace(w.first, w.second);
+  }
+
+  CHECK_EQ_OR_RETURN(final_pieces.size(), static_cast<size_t>(vocab_size))
+      << "Vocabulary size is too high. Please set it to a value <= "
+      << final_pieces.size() << ".";
+
+  final_pieces_ = Sorted(final_pieces);
+  return util::OkStatus();
+}
+
+util::Status Trainer::Train() {
+  RETURN_IF_ERROR(status());
+
+  RETURN_IF_ERROR(LoadSentences());
+
+  // split by deliminator into chunks
+  SplitSentencesByWhitespace();
+
+  CHECK_GE_OR_RETURN(trainer_spec_.vocab_size(), required_chars_.size())
+      << "Vocabulary size is smaller than the number of characters.";
+  desired_vocab_size_ = trainer_spec_.vocab_size() * kDesiredVocabSizeRatio;
+
+  Pieces seed_pieces;
+  RETURN_IF_ERROR(MakeSeedPieces(&seed_pieces));
+  auto model = absl::make_unique<PieceModel>(std::move(seed_pieces));
+  RETURN_IF_ERROR(model->status());
+
+  while (true) {
+    // Sub-EM iteration.
+    for (int iter = 0; iter < trainer_spec_.num_sub_iterations(); ++iter) {
+      // Executes E step
+      float objective = 0.0;
+      int64 num_tokens = 0;
+      const auto expected = RunEStep(*model, &objective, &num_tokens);
+
+      // Executes M step.
+      model = absl::make_unique<PieceModel>(RunMStep(*model, expected));
+      RETURN_IF_ERROR(model->status());
+
+      LOG(INFO) << "EM sub_iter=" << iter << " size=" << model->pieces().size()
+                << " obj=" << objective << " num_tokens=" << num_tokens
+                << " num_tokens/piece="
+                << 1.0 * num_tokens / model->pieces().size();
+    }  // end of Sub EM iteration
+
+    // Stops the iteration when the size of pieces reaches to
+    // the desired vocabulary size.
+    if (model->pieces().size() <= static_cast<size_t>(desired_vocab_size_)) break;
+
+    // Prunes pieces.
+    model = absl::make_unique<PieceModel>(PruneDiscretePieces(*model));
+    RETURN_IF_ERROR(model->status());
+  }  // end of EM iteration
+
+  // Finally, adjusts the size of pieces to be |vocab_size|.
+  RETURN_IF_ERROR(FinalizeDiscretePieces(*model));
+
+  return Save();
+}
+
+}  // namespace unigram
+}  // namespace discretepiece
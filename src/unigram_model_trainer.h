@@ -0,0 +1,95 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef UNIGRAM_MODEL_TRAINER_H_
+#define UNIGRAM_MODEL_TRAINER_H_
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "discretepiece_model.pb.h"
+#include "piece_trie.h"
+#include "token_seq.h"
+#include "trainer_interface.h"
+
+namespace discretepiece {
+namespace unigram {
+
+// Trainer class for unigram language model.
+// Starts from frequent substrings found with a suffix array, then
+// alternates EM sub-iterations with pruning of the pieces whose removal
+// hurts the likelihood least, until the vocabulary is small enough.
+class Trainer : public TrainerInterface {
+ public:
+  Trainer(const TrainerSpec &trainer_spec)
+      : TrainerInterface::TrainerInterface(trainer_spec) {}
+
+  util::Status Train() override;
+
+ private:
+  // Pieces with scores. Scores are log probabilities after the first
+  // M-step.
+  using Pieces = std::vector<std::pair<TokenSeq, float>>;
+
+  // Pieces of the model being trained, with a trie over them.
+  class PieceModel {
+   public:
+    explicit PieceModel(Pieces pieces);
+
+    const Pieces &pieces() const { return pieces_; }
+    const std::vector<float> &scores() const { return scores_; }
+    const PieceTrie &trie() const { return trie_; }
+    int max_piece_length() const { return max_piece_length_; }
+    util::Status status() const { return status_; }
+
+   private:
+    Pieces pieces_;
+    std::vector<float> scores_;
+    PieceTrie trie_;
+    int max_piece_length_ = 0;
+    util::Status status_;
+  };
+
+  // Extracts the most frequent substrings of the chunks with an enhanced
+  // suffix array, together with all characters.
+  util::Status MakeSeedPieces(Pieces *seed_pieces) const;
+
+  // Computes the expected frequency of every piece with the
+  // forward-backward algorithm. `objective` is the negative log likelihood
+  // per chunk and `num_tokens` the number of pieces in the Viterbi paths.
+  std::vector<float> RunEStep(const PieceModel &model, float *objective,
+                              int64 *num_tokens) const;
+
+  // Re-estimates the scores from the expected frequencies and drops rare
+  // pieces. Characters are never dropped.
+  Pieces RunMStep(const PieceModel &model,
+                  const std::vector<float> &expected) const;
+
+  // Keeps the pieces whose removal would increase the loss most.
+  Pieces PruneDiscretePieces(const PieceModel &model) const;
+
+  // Selects exactly vocab_size pieces, all characters included.
+  util::Status FinalizeDiscretePieces(const PieceModel &model);
+
+  // Runs `fn(begin, end)` over shards of sentences_ with num_threads.
+  void RunSharded(const std::function<void(int shard, size_t begin, size_t end)> &fn) const;
+
+  // Vocabulary size which EM iterations shrink the seed pieces to, before
+  // the final selection.
+  int desired_vocab_size_ = 0;
+};
+}  // namespace unigram
+}  // namespace discretepiece
+#endif  // UNIGRAM_MODEL_TRAINER_H_
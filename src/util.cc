@@ -19,6 +19,10 @@
 #include <atomic>
 #include <iostream>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace discretepiece {
 
 namespace {
@@ -167,27 +171,245 @@ char32 SimpleStoi(absl::string_view str) {
   return ret;
 }
 
-std::string VectorChar32ToString(const std::vector<char32> &vec, std::string_view out_deliminator) {
-  std::vector<int> int32_vec(vec.size());
-  std::transform(vec.begin(), vec.end(), int32_vec.begin(), [](char32 c)->int {return static_cast<int>(c); });
-  return absl::StrJoin(int32_vec, out_deliminator);
+std::string VectorChar32ToString(absl::Span<const char32> vec, std::string_view out_deliminator) {
+  std::string result;
+  AppendInts(vec, out_deliminator, &result);
+  return result;
 }
 
 std::vector<char32> StringToVectorChar32(absl::string_view str, const absl::flat_hash_map<char, char32> &special_mapping, char deliminator) {
-  const std::vector<std::string> num_strs = absl::StrSplit(str, deliminator, false);
   std::vector<char32> result;
-  for (const std::string &num_str: num_strs) {
-    char32 num;
-    if (num_str.size() == 1  && special_mapping.find(num_str[0]) != special_mapping.end()) {
-      num = special_mapping.find(num_str[0])->second;
-    } else {
-      num = string_util::SimpleStoi(num_str);
+  TokenParser(special_mapping, deliminator).Parse(str, &result);
+  return result;
+}
+
+namespace {
+
+// Parses `token`, a decimal int32 with an optional leading '-', as the
+// char32 of the same bits, so that -1 gives the deliminator.
+inline bool ParseInt32Token(absl::string_view token, char32 *value) {
+  const bool negative = !token.empty() && token[0] == '-';
+  if (negative) token.remove_prefix(1);
+  if (token.empty() || token.size() > 10) return false;
+  uint64 magnitude = 0;
+  for (const char c : token) {
+    const uint32 digit = static_cast<unsigned char>(c) - '0';
+    if (digit > 9) return false;
+    magnitude = magnitude * 10 + digit;
+  }
+  if (magnitude > (negative ? 0x80000000ULL : 0x7FFFFFFFULL)) return false;
+  *value = static_cast<char32>(negative ? 0 - magnitude : magnitude);
+  return true;
+}
+
+// Returns the mask of the bytes of data[0, 64) equal to `c`.
+inline uint64 ByteMask64(const char *data, char c) {
+#if defined(__SSE2__)
+  const __m128i target = _mm_set1_epi8(c);
+  uint64 mask = 0;
+  for (int k = 0; k < 4; ++k) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * k));
+    mask |= static_cast<uint64>(static_cast<uint16>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(v, target))))
+            << (16 * k);
+  }
+  return mask;
+#else
+  uint64 mask = 0;
+  for (int k = 0; k < 64; ++k) mask |= static_cast<uint64>(data[k] == c) << k;
+  return mask;
+#endif
+}
+
+// Returns the index of the lowest set bit of `x`, which is not 0.
+inline int CountTrailingZeros64(uint64 x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+// "00" to "99".
+constexpr char kTwoDigits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes `value` to `out` and returns the end.
+inline char *FormatInt32(int32 value, char *out) {
+  uint32 u = static_cast<uint32>(value);
+  if (value < 0) {
+    *out++ = '-';
+    u = 0u - u;
+  }
+  char buf[10];
+  char *p = buf + sizeof(buf);
+  while (u >= 100) {
+    const uint32 r = u % 100;
+    u /= 100;
+    p -= 2;
+    memcpy(p, kTwoDigits + 2 * r, 2);
+  }
+  if (u >= 10) {
+    p -= 2;
+    memcpy(p, kTwoDigits + 2 * u, 2);
+  } else {
+    *--p = static_cast<char>('0' + u);
+  }
+  const size_t size = buf + sizeof(buf) - p;
+  memcpy(out, p, size);
+  return out + size;
+}
+
+template <typename T>
+void AppendIntsImpl(absl::Span<const T> values, absl::string_view deliminator,
+                    std::string *output) {
+  if (values.empty()) return;
+  const size_t begin = output->size();
+  output->resize(begin + values.size() * (11 + deliminator.size()));
+  char *out = &(*output)[begin];
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) {
+      memcpy(out, deliminator.data(), deliminator.size());
+      out += deliminator.size();
+    }
+    out = FormatInt32(static_cast<int32>(values[i]), out);
+  }
+  output->resize(out - output->data());
+}
+
+}  // namespace
+
+TokenParser::TokenParser(const absl::flat_hash_map<char, char32> &special_mapping,
+                         char deliminator)
+    : deliminator_(deliminator) {
+  std::fill(is_special_, is_special_ + 256, false);
+  std::fill(special_, special_ + 256, 0);
+  for (const auto &it : special_mapping) {
+    is_special_[static_cast<unsigned char>(it.first)] = true;
+    special_[static_cast<unsigned char>(it.first)] = it.second;
+  }
+}
+
+bool TokenParser::Parse(absl::string_view str, char32 *output,
+                        size_t *num_tokens) const {
+  // Lines of CRLF files end with '\r', which std::stoi used to ignore.
+  if (!str.empty() && str.back() == '\r') str.remove_suffix(1);
+  const char *data = str.data();
+  size_t n = 0;
+  bool ok = true;
+  auto Emit = [&](size_t begin, size_t end) {
+    const unsigned char first = static_cast<unsigned char>(data[begin]);
+    if (end - begin == 1 && is_special_[first]) {
+      output[n++] = special_[first];
+      return;
+    }
+    char32 value = 0;
+    if (!ParseInt32Token(absl::string_view(data + begin, end - begin), &value)) {
+      ok = false;
+    }
+    output[n++] = value;
+  };
+
+  // Walks the transitions between deliminators and tokens in the masks
+  // of 64-byte blocks. The last block is padded with deliminators.
+  bool in_token = false;
+  size_t token_begin = 0;
+  for (size_t base = 0; base < str.size(); base += 64) {
+    const char *block = data + base;
+    char tail[64];
+    if (str.size() - base < 64) {
+      memset(tail, deliminator_, sizeof(tail));
+      memcpy(tail, block, str.size() - base);
+      block = tail;
+    }
+    const uint64 deliminators = ByteMask64(block, deliminator_);
+    for (int pos = 0; pos < 64;) {
+      const uint64 next = (in_token ? deliminators : ~deliminators) & (~0ULL << pos);
+      if (next == 0) break;
+      pos = CountTrailingZeros64(next);
+      if (in_token) {
+        Emit(token_begin, base + pos);
+      } else {
+        token_begin = base + pos;
+      }
+      in_token = !in_token;
     }
-    result.push_back(num);
+  }
+  if (in_token) Emit(token_begin, str.size());
+  *num_tokens = n;
+  return ok;
+}
+
+bool TokenParser::Parse(absl::string_view str, std::vector<char32> *output) const {
+  const size_t begin = output->size();
+  output->resize(begin + MaxTokens(str));
+  size_t num_tokens = 0;
+  const bool ok = Parse(str, output->data() + begin, &num_tokens);
+  output->resize(begin + num_tokens);
+  return ok;
+}
+
+void AppendInts(absl::Span<const char32> values, absl::string_view deliminator,
+                std::string *output) {
+  AppendIntsImpl(values, deliminator, output);
+}
+
+void AppendInts(absl::Span<const int> values, absl::string_view deliminator,
+                std::string *output) {
+  AppendIntsImpl(values, deliminator, output);
+}
+
+bool StringToTuples(absl::string_view str,
+                    const absl::flat_hash_map<char, char32> &special_mapping,
+                    int num_codebooks, std::vector<char32> *tuples) {
+  if (!str.empty() && str.back() == '\r') str.remove_suffix(1);
+  for (const absl::string_view token : absl::StrSplit(str, ' ', false)) {
+    if (token.size() == 1 && special_mapping.find(token[0]) != special_mapping.end()) {
+      tuples->insert(tuples->end(), num_codebooks, special_mapping.find(token[0])->second);
+      continue;
+    }
+    const std::vector<absl::string_view> nums = absl::StrSplit(token, ':', false);
+    if (nums.size() != static_cast<size_t>(num_codebooks)) return false;
+    for (const absl::string_view num : nums) {
+      char32 value = 0;
+      if (!ParseInt32Token(num, &value)) return false;
+      tuples->push_back(value);
+    }
+  }
+  return true;
+}
+
+std::string TuplesToString(absl::Span<const char32> tuples, int num_codebooks,
+                           std::string_view out_deliminator) {
+  std::string result;
+  for (size_t i = 0; i + num_codebooks <= tuples.size(); i += num_codebooks) {
+    if (i > 0) result.append(out_deliminator.data(), out_deliminator.size());
+    AppendInts(tuples.subspan(i, num_codebooks), ":", &result);
   }
   return result;
 }
 
+void CollapseRepeats(absl::Span<const char32> input, char32 deliminator,
+                     std::vector<char32> *collapsed,
+                     std::vector<int> *durations) {
+  for (size_t begin = 0; begin < input.size();) {
+    size_t end = begin + 1;
+    while (end < input.size() && input[end] == input[begin]) ++end;
+    collapsed->push_back(input[begin]);
+    if (durations != nullptr && input[begin] != deliminator) {
+      durations->push_back(end - begin);
+    }
+    begin = end;
+  }
+}
+
 }  // namespace string_util
 
 namespace random {
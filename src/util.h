@@ -31,6 +31,7 @@
 #include "common.h"
 #include "third_party/absl/strings/string_view.h"
 #include "third_party/absl/container/flat_hash_map.h"
+#include "third_party/absl/types/span.h"
 
 #ifdef SPM_NO_THREADLOCAL
 #include <pthread.h>
@@ -187,12 +188,71 @@ UnicodeText UTF8ToUnicodeText(absl::string_view utf8);
 
 std::string UnicodeTextToUTF8(const UnicodeText &utext);
 
-std::string VectorChar32ToString(const std::vector<char32> &vec, std::string_view out_deliminator);
+std::string VectorChar32ToString(absl::Span<const char32> vec, std::string_view out_deliminator);
 
 std::vector<char32> StringToVectorChar32(absl::string_view str, 
                                          const absl::flat_hash_map<char, char32> &special_mapping = {}, 
                                          char deliminator = ' '); 
 
+// Parses `deliminator`-separated tokens into char32 values, the same as
+// StringToVectorChar32(): runs of deliminators are skipped, a
+// single-character token found in `special_mapping` gives its value, and
+// any other token must be a decimal int32, optionally negative, e.g. the
+// -1 written for the deliminator by AppendInts(). A trailing '\r', as left
+// by the lines of CRLF files, is ignored. Deliminators are
+// found 64 bytes at a time with SSE2 and the digits are converted straight
+// into the output, without splitting the string. Build one parser and
+// reuse it for every line.
+class TokenParser {
+ public:
+  explicit TokenParser(const absl::flat_hash_map<char, char32> &special_mapping = {},
+                       char deliminator = ' ');
+
+  // Upper bound of the number of tokens in `str`.
+  static size_t MaxTokens(absl::string_view str) { return (str.size() + 1) / 2; }
+
+  // Writes the tokens of `str` to `output`, which has room for
+  // MaxTokens(str) values, and their number to `num_tokens`. Returns false
+  // if a token is not a number; it is then written as 0.
+  bool Parse(absl::string_view str, char32 *output, size_t *num_tokens) const;
+
+  // Appends the tokens of `str` to `output`. Returns false if a token is not
+  // a number.
+  bool Parse(absl::string_view str, std::vector<char32> *output) const;
+
+ private:
+  char deliminator_;
+  bool is_special_[256];
+  char32 special_[256];
+};
+
+// Appends `values` as decimal int32, the same as VectorChar32ToString(),
+// joined by `deliminator` to `output`. Digits are written two at a time
+// from a table into one buffer.
+void AppendInts(absl::Span<const char32> values, absl::string_view deliminator,
+                std::string *output);
+void AppendInts(absl::Span<const int> values, absl::string_view deliminator,
+                std::string *output);
+
+// Parses whitespace-separated tuples "a:b:c" of `num_codebooks` tokens and
+// appends them flattened to `tuples`. A single-character token found in
+// `special_mapping` fills a whole position with its value. Returns false
+// if a tuple has a different number of tokens.
+bool StringToTuples(absl::string_view str,
+                    const absl::flat_hash_map<char, char32> &special_mapping,
+                    int num_codebooks, std::vector<char32> *tuples);
+
+// Formats flattened tuples as "a:b:c" joined by `out_deliminator`.
+std::string TuplesToString(absl::Span<const char32> tuples, int num_codebooks,
+                           std::string_view out_deliminator);
+
+// Collapses every run of the same token of `input` into one token and
+// appends it to `collapsed`. The run lengths of tokens other than
+// `deliminator` are appended to `durations` unless it is null.
+void CollapseRepeats(absl::Span<const char32> input, char32 deliminator,
+                     std::vector<char32> *collapsed,
+                     std::vector<int> *durations);
+
 }  // namespace string_util
 
 // other map/ptr utilties
@@ -292,6 +352,21 @@ inline uint64 FingerprintCat(uint64 x, uint64 y) {
   return y;
 }
 
+// Returns a 64-bit fingerprint of `data`, folded 8 bytes at a time with
+// FingerprintCat().
+inline uint64 Fingerprint(absl::string_view data) {
+  uint64 h = data.size();
+  size_t i = 0;
+  for (; i + sizeof(uint64) <= data.size(); i += sizeof(uint64)) {
+    uint64 word = 0;
+    memcpy(&word, data.data() + i, sizeof(word));
+    h = FingerprintCat(h, word);
+  }
+  uint64 tail = 0;
+  memcpy(&tail, data.data() + i, data.size() - i);
+  return FingerprintCat(h, tail);
+}
+
 }  // namespace port
 
 namespace random {
@@ -0,0 +1,163 @@
+// Copyright 2016 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.!
+
+#ifndef WORD_DICTIONARY_H_
+#define WORD_DICTIONARY_H_
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "flat_array.h"
+#include "third_party/absl/strings/string_view.h"
+#include "third_party/absl/types/span.h"
+#include "token_seq.h"
+#include "util.h"
+
+namespace discretepiece {
+
+// Read-only open addressing hash from chunks to their piece ids, built by
+// the trainer for the most frequent chunks and stored in
+// ModelProto.word_dictionary.
+//
+// The serialized form is an array of little-endian uint32, swapped on
+// big-endian hosts since it is also stored in the portable ModelProto:
+//   num_buckets (a power of 2), num_entries,
+//   buckets[num_buckets]: 1 + offset of the entry in the entry area, or 0,
+//   entries: chunk size, number of ids, chunk tokens, ids.
+class WordDictionary {
+ public:
+  WordDictionary() {}
+
+  // Serializes (chunk, ids) pairs. Chunks must be unique.
+  static std::string Build(
+      const std::vector<std::pair<TokenSeq, std::vector<int>>> &entries) {
+    uint32 num_buckets = 1;
+    while (num_buckets < 2 * entries.size()) num_buckets *= 2;
+
+    std::vector<uint32> buckets(num_buckets, 0);
+    std::vector<uint32> area;
+    for (const auto &e : entries) {
+      uint32 b = HashTokens(e.first.data(), e.first.size()) & (num_buckets - 1);
+      while (buckets[b] != 0) b = (b + 1) & (num_buckets - 1);
+      buckets[b] = area.size() + 1;
+      area.push_back(e.first.size());
+      area.push_back(e.second.size());
+      area.insert(area.end(), e.first.begin(), e.first.end());
+      area.insert(area.end(), e.second.begin(), e.second.end());
+    }
+
+    std::vector<uint32> words = {num_buckets,
+                                 static_cast<uint32>(entries.size())};
+    words.insert(words.end(), buckets.begin(), buckets.end());
+    words.insert(words.end(), area.begin(), area.end());
+#ifdef IS_BIG_ENDIAN
+    for (auto &w : words) w = util::Swap32(w);
+#endif
+    return std::string(reinterpret_cast<const char *>(words.data()),
+                       words.size() * sizeof(uint32));
+  }
+
+  // Returns the loaded dictionary in the form of Build().
+  std::string Serialize() const {
+#ifdef IS_BIG_ENDIAN
+    std::vector<uint32> words(words_.begin(), words_.end());
+    for (auto &w : words) w = util::Swap32(w);
+    return std::string(reinterpret_cast<const char *>(words.data()),
+                       words.size() * sizeof(uint32));
+#else
+    return std::string(words_.bytes());
+#endif
+  }
+
+  // Loads a dictionary serialized by Build() for a model of `num_pieces`
+  // pieces. An empty `data` gives an empty dictionary. `data` must outlive
+  // the dictionary.
+  util::Status Init(absl::string_view data, int num_pieces) {
+    words_.clear();
+    num_buckets_ = 0;
+    if (data.empty()) return util::OkStatus();
+
+    CHECK_OR_RETURN(words_.InitFromBytes(data) && words_.size() >= 2)
+        << "broken word dictionary.";
+#ifdef IS_BIG_ENDIAN
+    std::vector<uint32> words(words_.begin(), words_.end());
+    for (auto &w : words) w = util::Swap32(w);
+    words_.assign(std::move(words));
+#endif
+
+    num_buckets_ = words_[0];
+    CHECK_OR_RETURN(num_buckets_ > 0 && (num_buckets_ & (num_buckets_ - 1)) == 0 &&
+                    words_.size() >= 2 + num_buckets_)
+        << "broken word dictionary.";
+    const size_t area_size = words_.size() - 2 - num_buckets_;
+    bool has_empty = false;
+    for (uint32 b = 0; b < num_buckets_; ++b) {
+      const uint64 offset = words_[2 + b];
+      if (offset == 0) {
+        has_empty = true;
+        continue;
+      }
+      CHECK_OR_RETURN(offset + 1 <= area_size &&
+                      offset + 1 + Area()[offset - 1] + Area()[offset] <=
+                          area_size)
+          << "broken word dictionary.";
+      const uint32 *entry = Area() + offset - 1;
+      for (uint32 i = 0; i < entry[1]; ++i) {
+        CHECK_OR_RETURN(entry[2 + entry[0] + i] <
+                        static_cast<uint32>(num_pieces))
+            << "broken word dictionary.";
+      }
+    }
+    // Lookup() stops at an empty bucket.
+    CHECK_OR_RETURN(has_empty) << "broken word dictionary.";
+    return util::OkStatus();
+  }
+
+  // Appends the ids of `chunk` to `ids` and returns true if `chunk` is in
+  // the dictionary.
+  bool Lookup(absl::Span<const char32> chunk, std::vector<int> *ids) const {
+    if (num_buckets_ == 0) return false;
+    const uint32 *area = Area();
+    for (uint32 b = HashTokens(chunk.data(), chunk.size()) &
+                    (num_buckets_ - 1);;
+         b = (b + 1) & (num_buckets_ - 1)) {
+      const uint32 offset = words_[2 + b];
+      if (offset == 0) return false;
+      const uint32 *entry = area + offset - 1;
+      if (entry[0] == chunk.size() &&
+          std::equal(chunk.begin(), chunk.end(), entry + 2)) {
+        ids->insert(ids->end(), entry + 2 + entry[0],
+                    entry + 2 + entry[0] + entry[1]);
+        return true;
+      }
+    }
+  }
+
+  // Returns the number of chunks.
+  size_t size() const { return words_.empty() ? 0 : words_[1]; }
+
+  bool empty() const { return size() == 0; }
+
+ private:
+  const uint32 *Area() const { return words_.data() + 2 + num_buckets_; }
+
+  FlatArray<uint32> words_;
+  uint32 num_buckets_ = 0;
+};
+
+}  // namespace discretepiece
+#endif  // WORD_DICTIONARY_H_
@@ -0,0 +1,177 @@
+//
+// Copyright 2017 The Abseil Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// -----------------------------------------------------------------------------
+// File: span.h
+// -----------------------------------------------------------------------------
+//
+// This file contains a reduced version of `absl::Span`, a non-owning view of
+// a contiguous array of `T`. It is a drop-in replacement for the parts of the
+// C++20 `std::span` used in this project.
+#ifndef ABSL_TYPES_SPAN_H_
+#define ABSL_TYPES_SPAN_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+
+namespace absl {
+
+template <typename T>
+class Span {
+ private:
+  // Used to determine whether a Span can be constructed from a container of
+  // type C.
+  template <typename C>
+  using EnableIfConvertibleFrom = typename std::enable_if<
+      std::is_convertible<decltype(std::declval<C &>().data()), T *>::value &&
+      std::is_integral<decltype(std::declval<C &>().size())>::value>::type;
+
+  // Used to SFINAE-enable a function when the slice elements are const.
+  template <typename U>
+  using EnableIfConstView =
+      typename std::enable_if<std::is_const<T>::value, U>::type;
+
+ public:
+  using element_type = T;
+  using value_type = typename std::remove_cv<T>::type;
+  using pointer = T *;
+  using const_pointer = const T *;
+  using reference = T &;
+  using const_reference = const T &;
+  using iterator = pointer;
+  using const_iterator = const_pointer;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+
+  static const size_type npos = ~(size_type(0));
+
+  constexpr Span() noexcept : Span(nullptr, 0) {}
+  constexpr Span(pointer array, size_type length) noexcept
+      : ptr_(array), len_(length) {}
+
+  // Implicit conversion constructors
+  template <size_t N>
+  constexpr Span(T (&a)[N]) noexcept  // NOLINT(runtime/explicit)
+      : Span(a, N) {}
+
+  // Explicit reference constructor for a mutable `Span<T>` type.
+  template <typename V, typename LazyT = T,
+            typename = EnableIfConvertibleFrom<V>,
+            typename = typename std::enable_if<!std::is_const<LazyT>::value>::type>
+  explicit Span(V &v) noexcept  // NOLINT(runtime/references)
+      : Span(v.data(), v.size()) {}
+
+  // Implicit reference constructor for a read-only `Span<const T>` type
+  template <typename V, typename = EnableIfConvertibleFrom<const V>,
+            typename = EnableIfConstView<V>>
+  constexpr Span(const V &v) noexcept  // NOLINT(runtime/explicit)
+      : Span(v.data(), v.size()) {}
+
+  // Implicit constructor from an initializer list of `const T`. The list must
+  // outlive the span, so this is only safe for function arguments.
+  template <typename LazyT = T, typename = EnableIfConstView<LazyT>>
+  Span(std::initializer_list<value_type> v) noexcept  // NOLINT
+      : Span(v.begin(), v.size()) {}
+
+  // Conversion from `Span<U>` to `Span<const U>`.
+  template <typename U,
+            typename = typename std::enable_if<
+                std::is_same<const U, T>::value>::type>
+  constexpr Span(Span<U> other) noexcept  // NOLINT(runtime/explicit)
+      : Span(other.data(), other.size()) {}
+
+  constexpr pointer data() const noexcept { return ptr_; }
+  constexpr size_type size() const noexcept { return len_; }
+  constexpr size_type length() const noexcept { return size(); }
+  constexpr bool empty() const noexcept { return size() == 0; }
+
+  constexpr reference operator[](size_type i) const noexcept { return ptr_[i]; }
+  constexpr reference front() const noexcept { return *data(); }
+  constexpr reference back() const noexcept { return *(data() + size() - 1); }
+
+  constexpr iterator begin() const noexcept { return data(); }
+  constexpr const_iterator cbegin() const noexcept { return begin(); }
+  constexpr iterator end() const noexcept { return data() + size(); }
+  constexpr const_iterator cend() const noexcept { return end(); }
+  reverse_iterator rbegin() const noexcept { return reverse_iterator(end()); }
+  reverse_iterator rend() const noexcept { return reverse_iterator(begin()); }
+
+  void remove_prefix(size_type n) noexcept {
+    ptr_ += n;
+    len_ -= n;
+  }
+
+  void remove_suffix(size_type n) noexcept { len_ -= n; }
+
+  // Returns a `Span` starting at element `pos` and of length `len`, clipped
+  // to the end of this span.
+  constexpr Span subspan(size_type pos = 0, size_type len = npos) const {
+    return Span(ptr_ + std::min(pos, len_),
+                std::min(len_ - std::min(pos, len_), len));
+  }
+
+  constexpr Span first(size_type len) const { return Span(ptr_, len); }
+
+  constexpr Span last(size_type len) const {
+    return Span(ptr_ + len_ - len, len);
+  }
+
+ private:
+  pointer ptr_;
+  size_type len_;
+};
+
+template <typename T>
+const typename Span<T>::size_type Span<T>::npos;
+
+template <typename T>
+bool operator==(Span<T> a, Span<T> b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+template <typename T>
+bool operator!=(Span<T> a, Span<T> b) {
+  return !(a == b);
+}
+
+template <typename T>
+constexpr Span<T> MakeSpan(T *ptr, size_t size) noexcept {
+  return Span<T>(ptr, size);
+}
+
+template <typename C>
+constexpr auto MakeSpan(C &c) noexcept
+    -> decltype(absl::MakeSpan(c.data(), c.size())) {
+  return MakeSpan(c.data(), c.size());
+}
+
+template <typename T>
+constexpr Span<const T> MakeConstSpan(T *ptr, size_t size) noexcept {
+  return Span<const T>(ptr, size);
+}
+
+template <typename C>
+constexpr auto MakeConstSpan(const C &c) noexcept -> decltype(MakeSpan(c)) {
+  return MakeSpan(c);
+}
+
+}  // namespace absl
+
+#endif  // ABSL_TYPES_SPAN_H_